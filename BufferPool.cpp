@@ -0,0 +1,164 @@
+#include "BufferPool.h"
+#include <new>
+
+PacketBuffer::PacketBuffer() : slab(nullptr) {}
+
+PacketBuffer::PacketBuffer(Slab* slab) : slab(slab) {}
+
+PacketBuffer::PacketBuffer(const PacketBuffer& other) : slab(other.slab) {
+    if (slab)
+        slab->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+PacketBuffer::PacketBuffer(PacketBuffer&& other) noexcept : slab(other.slab) {
+    other.slab = nullptr;
+}
+
+PacketBuffer& PacketBuffer::operator=(const PacketBuffer& other) {
+    if (this != &other) {
+        PacketBuffer copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+PacketBuffer& PacketBuffer::operator=(PacketBuffer&& other) noexcept {
+    if (this != &other) {
+        Reset();
+        slab = other.slab;
+        other.slab = nullptr;
+    }
+    return *this;
+}
+
+PacketBuffer::~PacketBuffer() {
+    Reset();
+}
+
+char* PacketBuffer::Data() {
+    return slab ? slab->Data() : nullptr;
+}
+
+const char* PacketBuffer::Data() const {
+    return slab ? slab->Data() : nullptr;
+}
+
+int PacketBuffer::Size() const {
+    return slab ? slab->size : 0;
+}
+
+void PacketBuffer::SetSize(int size) {
+    if (slab)
+        slab->size = size;
+}
+
+int PacketBuffer::Capacity() const {
+    return slab ? slab->capacity : 0;
+}
+
+void PacketBuffer::Reset() {
+    if (slab && slab->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        BufferPool::Instance().Release(slab);
+    slab = nullptr;
+}
+
+PacketBuffer::operator bool() const {
+    return slab != nullptr;
+}
+
+// per-thread front of the pool, hands its slabs back when the thread exits
+struct ThreadCache {
+    std::vector<Slab*> slabs[BufferPool::CLASSES];
+
+    ~ThreadCache() {
+        BufferPool& pool = BufferPool::Instance();
+        std::lock_guard<std::mutex> lk(pool.lock);
+        for (int c = 0; c < BufferPool::CLASSES; c++)
+            pool.shared[c].insert(pool.shared[c].end(), slabs[c].begin(), slabs[c].end());
+    }
+};
+
+static thread_local ThreadCache cache;
+
+BufferPool::BufferPool() : created(0) {}
+
+BufferPool::~BufferPool() {
+    for (auto& list : shared)
+        for (Slab* slab : list)
+            ::operator delete(slab);
+}
+
+// never destroyed: threads hand their caches back as they exit, and the
+// reactor's and detached workers' can exit after static destructors ran
+BufferPool& BufferPool::Instance() {
+    static BufferPool* pool = new BufferPool;
+    return *pool;
+}
+
+int BufferPool::classFor(int size) {
+    int sizeClass = 0;
+    while (sizeClass < CLASSES && classSize(sizeClass) < size)
+        sizeClass++;
+    return (sizeClass < CLASSES) ? sizeClass : -1;
+}
+
+int BufferPool::classSize(int sizeClass) {
+    return 1 << (MINSHIFT + 2 * sizeClass);
+}
+
+Slab* BufferPool::create(int sizeClass, int capacity) {
+    created.fetch_add(1, std::memory_order_relaxed);
+    void* memory = ::operator new(sizeof(Slab) + capacity);
+    Slab* slab = new (memory) Slab;
+    slab->sizeClass = sizeClass;
+    slab->capacity = capacity;
+    return slab;
+}
+
+PacketBuffer BufferPool::Acquire(int size) {
+    int sizeClass = classFor(size);
+    Slab* slab = nullptr;
+
+    if (sizeClass < 0) {
+        slab = create(-1, size);
+    }
+    else if (!cache.slabs[sizeClass].empty()) {
+        slab = cache.slabs[sizeClass].back();
+        cache.slabs[sizeClass].pop_back();
+    }
+    else {
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            if (!shared[sizeClass].empty()) {
+                slab = shared[sizeClass].back();
+                shared[sizeClass].pop_back();
+            }
+        }
+        if (!slab)
+            slab = create(sizeClass, classSize(sizeClass));
+    }
+
+    slab->refs.store(1, std::memory_order_relaxed);
+    slab->size = 0;
+    return PacketBuffer(slab);
+}
+
+void BufferPool::Release(Slab* slab) {
+    if (slab->sizeClass < 0) {
+        ::operator delete(slab);
+        return;
+    }
+
+    std::vector<Slab*>& local = cache.slabs[slab->sizeClass];
+    if (local.size() < CACHED) {
+        local.push_back(slab);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lk(lock);
+    shared[slab->sizeClass].push_back(slab);
+}
+
+size_t BufferPool::Created() const {
+    return created.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// one pooled block, the payload follows the header in the same allocation
+struct Slab {
+    std::atomic<int> refs;
+    int sizeClass;          // -1 for oversize blocks that bypass the pool
+    int capacity;
+    int size;
+    char* Data() { return reinterpret_cast<char*>(this + 1); }
+};
+
+// Ref-counted handle to a pooled slab. Copies share the same bytes, the
+// slab goes back to the pool when the last handle lets go, so one receive
+// can be handed to parsing and any number of consumers without copying.
+class PacketBuffer {
+private:
+    Slab* slab;
+
+public:
+    PacketBuffer();
+    explicit PacketBuffer(Slab* slab);
+    PacketBuffer(const PacketBuffer& other);
+    PacketBuffer(PacketBuffer&& other) noexcept;
+    PacketBuffer& operator=(const PacketBuffer& other);
+    PacketBuffer& operator=(PacketBuffer&& other) noexcept;
+    ~PacketBuffer();
+
+    char* Data();
+    const char* Data() const;
+    int Size() const;
+    void SetSize(int size);
+    int Capacity() const;
+    void Reset();
+    explicit operator bool() const;
+};
+
+// Process-wide pool of size-classed slabs (64 B to 64 KiB).
+// Each thread keeps a small cache per class in front of the shared lists,
+// so steady-state acquire/release takes no lock.
+class BufferPool {
+public:
+    static const int CLASSES = 6;
+    static const int MINSHIFT = 6;          // smallest class is 1 << MINSHIFT bytes
+    static const size_t CACHED = 32;        // slabs per class kept by each thread
+
+private:
+    std::mutex lock;
+    std::vector<Slab*> shared[CLASSES];
+    std::atomic<size_t> created;
+
+    BufferPool();
+    ~BufferPool();
+
+    static int classFor(int size);
+    static int classSize(int sizeClass);
+    Slab* create(int sizeClass, int capacity);
+
+    friend struct ThreadCache;
+
+public:
+    static BufferPool& Instance();
+
+    PacketBuffer Acquire(int size);
+    void Release(Slab* slab);
+    size_t Created() const;                 // slabs ever allocated, flat once warm
+};
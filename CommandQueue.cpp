@@ -0,0 +1,115 @@
+#include "CommandQueue.h"
+#include "Trace.h"
+
+constexpr std::chrono::milliseconds CommandQueue::INTERVAL;
+
+CommandQueue::CommandQueue(Sender send, const CommandLimits& limits)
+    : send(std::move(send)), limits(limits), running(true)
+{
+    worker = std::thread(&CommandQueue::run, this);
+}
+
+CommandQueue::~CommandQueue() {
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        running = false;
+    }
+    wakeup.notify_all();
+    worker.join();
+}
+
+bool CommandQueue::Push(std::vector<Command>& batch, int& retryAfter) {
+    auto now = Clock::now();
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        size_t depth = (size_t)limits.depth.load();
+        if (batch.size() > depth) {
+            stats.rejected += batch.size();
+            retryAfter = 0;
+            return false;
+        }
+        if (pending.size() + batch.size() > depth) {
+            stats.rejected += batch.size();
+            int rate = limits.ratePerSec;
+            retryAfter = (rate > 0) ? (int)((pending.size() + rate - 1) / rate) : 1;
+            if (retryAfter < 1)
+                retryAfter = 1;
+            return false;
+        }
+
+        for (auto& command : batch) {
+            command.queued = now;
+            pending.push_back(std::move(command));
+        }
+    }
+    wakeup.notify_one();
+    return true;
+}
+
+CommandQueueStats CommandQueue::Stats() {
+    std::lock_guard<std::mutex> lk(lock);
+    CommandQueueStats out = stats;
+    out.waiting = pending.size();
+    out.shedding = overloaded;
+    return out;
+}
+
+// one interval's shortest wait decides whether the next interval sheds
+bool CommandQueue::stale(Clock::time_point now, const Command& command) {
+    auto delay = now - command.queued;
+    auto target = std::chrono::milliseconds(limits.targetMs.load());
+
+    if (now >= intervalEnd) {
+        overloaded = (intervalEnd != Clock::time_point() && minDelay > target);
+        intervalEnd = now + INTERVAL;
+        minDelay = delay;
+    }
+    else if (delay < minDelay) {
+        minDelay = delay;
+    }
+    return overloaded && delay > 2 * target;
+}
+
+// head of the queue that is still worth sending, false when all were shed
+bool CommandQueue::dequeue(Clock::time_point now, Command& out) {
+    while (!pending.empty()) {
+        out = std::move(pending.front());
+        pending.pop_front();
+        if (!stale(now, out))
+            return true;
+        stats.shed++;
+    }
+    return false;
+}
+
+void CommandQueue::run() {
+    std::unique_lock<std::mutex> lk(lock);
+    while (running) {
+        if (pending.empty()) {
+            wakeup.wait(lk);
+            continue;
+        }
+
+        auto now = Clock::now();
+        if (now < nextSend) {
+            wakeup.wait_until(lk, nextSend);
+            continue;
+        }
+
+        Command command;
+        if (!dequeue(now, command))
+            continue;
+
+        int rate = limits.ratePerSec;
+        nextSend = (rate > 0) ? now + std::chrono::microseconds(1000000 / rate) : now;
+        stats.sent++;
+
+        lk.unlock();
+        {
+            TraceSpan span("command send");
+            send(command);
+        }
+        command.data.Reset();
+        lk.lock();
+    }
+}
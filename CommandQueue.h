@@ -0,0 +1,81 @@
+#pragma once
+#include "BufferPool.h"
+#include "PktDef.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// limits every robot's queue reads live, owned by the config
+struct CommandLimits {
+    std::atomic<int> depth{ 32 };           // commands waiting per robot before 429
+    std::atomic<int> ratePerSec{ 50 };      // sends a robot link takes per second, 0 for unpaced
+    std::atomic<int> targetMs{ 20 };        // queue delay tolerated before shedding
+};
+
+// one telecommand waiting for the link
+struct Command {
+    CMDType cmd = CMDType::DRIVE;
+    bool raw = false;                       // data is a whole client-built frame
+    PacketBuffer data;                      // body, or the frame when raw, empty for none
+    std::chrono::steady_clock::time_point queued;
+};
+
+struct CommandQueueStats {
+    size_t waiting = 0;
+    uint64_t sent = 0;
+    uint64_t rejected = 0;                  // refused with 429
+    uint64_t shed = 0;                      // dropped by the delay controller
+    bool shedding = false;                  // queue delay standing over target
+};
+
+// Bounded per-robot command queue. A sender thread drains it at ratePerSec,
+// a full queue refuses new commands so the caller can answer 429.
+// Queue delay is controlled CoDel style, in the form used for server request
+// queues: when even the shortest wait seen over an INTERVAL was above
+// targetMs the queue is standing rather than a burst, and while it stands
+// any command that waited over twice the target is dropped at the head
+// instead of sent. Clients do not back off the way TCP does, so the drops
+// are immediate rather than ramped. A stale drive command is worse than none.
+class CommandQueue {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Sender = std::function<void(Command&)>;
+    static constexpr std::chrono::milliseconds INTERVAL{ 100 };
+
+private:
+    Sender send;
+    const CommandLimits& limits;
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::deque<Command> pending;
+    bool running;
+    Clock::time_point nextSend;
+
+    // controller state, sender thread only
+    bool overloaded = false;
+    Clock::duration minDelay;               // shortest wait this interval
+    Clock::time_point intervalEnd;
+
+    CommandQueueStats stats;
+    std::thread worker;
+
+    void run();
+    bool stale(Clock::time_point now, const Command& command);
+    bool dequeue(Clock::time_point now, Command& out);
+
+public:
+    CommandQueue(Sender send, const CommandLimits& limits);
+    ~CommandQueue();
+
+    // all of the batch or none of it. false when it does not fit, retryAfter
+    // is then the whole seconds until the queue should have drained, or 0
+    // when the batch is deeper than the queue and can never fit
+    bool Push(std::vector<Command>& batch, int& retryAfter);
+    CommandQueueStats Stats();
+};
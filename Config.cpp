@@ -0,0 +1,277 @@
+#include "Config.h"
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+static std::string trim(const std::string& s) {
+    size_t first = s.find_first_not_of(" \t\r");
+    if (first == std::string::npos)
+        return "";
+    size_t last = s.find_last_not_of(" \t\r");
+    return s.substr(first, last - first + 1);
+}
+
+// --http-threads and http_threads name the same key
+static std::string keyName(std::string key) {
+    for (char& c : key)
+        if (c == '-')
+            c = '_';
+    return key;
+}
+
+static bool readFile(const std::string& path, std::map<std::string, std::string>& values, std::string& error) {
+    std::ifstream file(path);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    std::string line;
+    int number = 0;
+    while (std::getline(file, line)) {
+        number++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+            continue;
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            error = path + ":" + std::to_string(number) + ": expected key = value";
+            return false;
+        }
+        values[keyName(trim(line.substr(0, eq)))] = trim(line.substr(eq + 1));
+    }
+    return true;
+}
+
+static bool parseInt(const std::string& key, const std::string& text, int min, int max, int& out, std::string& error) {
+    char* end;
+    errno = 0;
+    long value = strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end || errno || value < min || value > max) {
+        error = key + " must be a number from " + std::to_string(min) + " to " + std::to_string(max);
+        return false;
+    }
+    out = (int)value;
+    return true;
+}
+
+static bool parseCpus(const std::string& text, std::vector<int>& out, std::string& error) {
+    out.clear();
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        int cpu;
+        if (!parseInt("cpus", trim(item), 0, 1023, cpu, error))
+            return false;
+        out.push_back(cpu);
+    }
+    return true;
+}
+
+static std::string joinCpus(const std::vector<int>& cpus) {
+    std::string text;
+    for (size_t i = 0; i < cpus.size(); i++)
+        text += (i ? "," : "") + std::to_string(cpus[i]);
+    return text;
+}
+
+// everything is parsed before anything is stored, a bad file changes nothing
+bool Config::apply(const std::map<std::string, std::string>& values, bool startup,
+                   std::vector<std::string>& needsRestart, std::string& error) {
+    int port = httpPort;
+    int threads = httpThreads;
+    std::vector<int> cpuList = cpus;
+    std::string dir = publicDir;
+    int size = receiveSize;
+    int stream = streamPort;
+    std::string store = storeDir;
+    int writer = writerCpu;
+    int shared = sharedSockets;
+    int sharedLocalPort = sharedPort;
+    int release = releaseCpu;
+    int timeout = receiveTimeoutMs;
+    int buffer = socketBufferBytes;
+    bool uring = uringSockets;
+    int history = missionHistory;
+    int pollMs = telemetryPollMs;
+    int backlog = streamBacklog;
+    int storeFlush = storeFlushMs;
+    int heartbeat = heartbeatMs;
+    int livenessTimeout = livenessTimeoutMs;
+    int queueDepth = commands.depth;
+    int commandRate = commands.ratePerSec;
+    int commandTarget = commands.targetMs;
+
+    for (auto& [key, value] : values) {
+        bool ok = true;
+        if (key == "http_port")
+            ok = parseInt(key, value, 1, 65535, port, error);
+        else if (key == "http_threads")
+            ok = parseInt(key, value, 0, 1024, threads, error);
+        else if (key == "cpus")
+            ok = parseCpus(value, cpuList, error);
+        else if (key == "public_dir")
+            dir = value;
+        else if (key == "receive_size")
+            ok = parseInt(key, value, 64, 65536, size, error);
+        else if (key == "stream_port")
+            ok = parseInt(key, value, 0, 65535, stream, error);
+        else if (key == "store_dir")
+            store = value;
+        else if (key == "writer_cpu")
+            ok = parseInt(key, value, -1, 1023, writer, error);
+        else if (key == "shared_sockets")
+            ok = parseInt(key, value, 0, 64, shared, error);
+        else if (key == "shared_port")
+            ok = parseInt(key, value, 0, 65535, sharedLocalPort, error);
+        else if (key == "release_cpu")
+            ok = parseInt(key, value, -1, 1023, release, error);
+        else if (key == "receive_timeout_ms")
+            ok = parseInt(key, value, 0, 3600000, timeout, error);
+        else if (key == "socket_buffer_bytes")
+            ok = parseInt(key, value, 0, INT_MAX, buffer, error);
+        else if (key == "socket_backend") {
+            ok = (value == "blocking" || value == "io_uring");
+            uring = (value == "io_uring");
+            if (!ok)
+                error = "socket_backend must be blocking or io_uring";
+        }
+        else if (key == "mission_history")
+            ok = parseInt(key, value, 1, 1000000, history, error);
+        else if (key == "telemetry_poll_ms")
+            ok = parseInt(key, value, 10, 60000, pollMs, error);
+        else if (key == "stream_backlog")
+            ok = parseInt(key, value, 1, 100000, backlog, error);
+        else if (key == "store_flush_ms")
+            ok = parseInt(key, value, 10, 3600000, storeFlush, error);
+        else if (key == "heartbeat_ms")
+            ok = parseInt(key, value, 0, 3600000, heartbeat, error);
+        else if (key == "liveness_timeout_ms")
+            ok = parseInt(key, value, 1, 60000, livenessTimeout, error);
+        else if (key == "command_queue_depth")
+            ok = parseInt(key, value, 1, 100000, queueDepth, error);
+        else if (key == "command_rate")
+            ok = parseInt(key, value, 0, 1000000, commandRate, error);
+        else if (key == "command_target_ms")
+            ok = parseInt(key, value, 1, 60000, commandTarget, error);
+        else {
+            ok = false;
+            error = "unknown setting " + key;
+        }
+        if (!ok)
+            return false;
+    }
+
+    if (startup) {
+        httpPort = port;
+        httpThreads = threads;
+        cpus = cpuList;
+        publicDir = dir;
+        receiveSize = size;
+        streamPort = stream;
+        storeDir = store;
+        writerCpu = writer;
+        sharedSockets = shared;
+        sharedPort = sharedLocalPort;
+        releaseCpu = release;
+    }
+    else {
+        if (port != httpPort) needsRestart.push_back("http_port");
+        if (threads != httpThreads) needsRestart.push_back("http_threads");
+        if (cpuList != cpus) needsRestart.push_back("cpus");
+        if (dir != publicDir) needsRestart.push_back("public_dir");
+        if (size != receiveSize) needsRestart.push_back("receive_size");
+        if (stream != streamPort) needsRestart.push_back("stream_port");
+        if (store != storeDir) needsRestart.push_back("store_dir");
+        if (writer != writerCpu) needsRestart.push_back("writer_cpu");
+        if (shared != sharedSockets) needsRestart.push_back("shared_sockets");
+        if (sharedLocalPort != sharedPort) needsRestart.push_back("shared_port");
+        if (release != releaseCpu) needsRestart.push_back("release_cpu");
+    }
+
+    receiveTimeoutMs = timeout;
+    socketBufferBytes = buffer;
+    uringSockets = uring;
+    missionHistory = history;
+    telemetryPollMs = pollMs;
+    streamBacklog = backlog;
+    storeFlushMs = storeFlush;
+    heartbeatMs = heartbeat;
+    livenessTimeoutMs = livenessTimeout;
+    commands.depth = queueDepth;
+    commands.ratePerSec = commandRate;
+    commands.targetMs = commandTarget;
+    return true;
+}
+
+bool Config::Load(int argc, char* argv[], std::string& error) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+            error = "expected --key=value, got " + arg;
+            return false;
+        }
+
+        std::string key = keyName(arg.substr(2, eq - 2));
+        if (key == "config")
+            path = arg.substr(eq + 1);
+        else
+            overrides[key] = arg.substr(eq + 1);
+    }
+
+    std::map<std::string, std::string> values;
+    if (!path.empty() && !readFile(path, values, error))
+        return false;
+    for (auto& [key, value] : overrides)
+        values[key] = value;
+
+    std::vector<std::string> unused;
+    return apply(values, true, unused, error);
+}
+
+bool Config::Reload(std::vector<std::string>& needsRestart, std::string& error) {
+    if (path.empty()) {
+        error = "started without --config, nothing to reload";
+        return false;
+    }
+
+    std::map<std::string, std::string> values;
+    if (!readFile(path, values, error))
+        return false;
+    for (auto& [key, value] : overrides)
+        values[key] = value;
+
+    return apply(values, false, needsRestart, error);
+}
+
+std::string Config::Dump() const {
+    std::string out;
+    out += "http_port = " + std::to_string(httpPort) + "\n";
+    out += "http_threads = " + std::to_string(httpThreads) + "\n";
+    out += "cpus = " + joinCpus(cpus) + "\n";
+    out += "public_dir = " + publicDir + "\n";
+    out += "receive_size = " + std::to_string(receiveSize) + "\n";
+    out += "stream_port = " + std::to_string(streamPort) + "\n";
+    out += "store_dir = " + storeDir + "\n";
+    out += "writer_cpu = " + std::to_string(writerCpu) + "\n";
+    out += "shared_sockets = " + std::to_string(sharedSockets) + "\n";
+    out += "shared_port = " + std::to_string(sharedPort) + "\n";
+    out += "release_cpu = " + std::to_string(releaseCpu) + "\n";
+    out += "receive_timeout_ms = " + std::to_string(receiveTimeoutMs.load()) + "\n";
+    out += "socket_buffer_bytes = " + std::to_string(socketBufferBytes.load()) + "\n";
+    out += std::string("socket_backend = ") + (uringSockets ? "io_uring" : "blocking") + "\n";
+    out += "mission_history = " + std::to_string(missionHistory.load()) + "\n";
+    out += "telemetry_poll_ms = " + std::to_string(telemetryPollMs.load()) + "\n";
+    out += "stream_backlog = " + std::to_string(streamBacklog.load()) + "\n";
+    out += "store_flush_ms = " + std::to_string(storeFlushMs.load()) + "\n";
+    out += "heartbeat_ms = " + std::to_string(heartbeatMs.load()) + "\n";
+    out += "liveness_timeout_ms = " + std::to_string(livenessTimeoutMs.load()) + "\n";
+    out += "command_queue_depth = " + std::to_string(commands.depth.load()) + "\n";
+    out += "command_rate = " + std::to_string(commands.ratePerSec.load()) + "\n";
+    out += "command_target_ms = " + std::to_string(commands.targetMs.load()) + "\n";
+    return out;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "CommandQueue.h"
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+// Server settings: defaults, then an optional key = value file (--config=path),
+// then --key=value arguments. Structural settings are fixed once the server
+// is up. Live settings are atomics that Reload() updates in place so they can
+// be tuned under load, readers just load them.
+class Config {
+public:
+    // structural, a change needs a restart
+    int httpPort = 8080;
+    int httpThreads = 0;                        // Crow workers, 0 for one per core
+    std::vector<int> cpus;                      // pin the process to these, empty for no pinning
+    std::string publicDir = "../public";
+    int receiveSize = 1024;                     // robot socket buffer, largest frame accepted
+    int streamPort = 8081;                      // telemetry SSE listener, 0 turns streaming off
+    std::string storeDir;                       // telemetry history, empty turns recording off
+    int writerCpu = -1;                         // pin every robot's send writer here, -1 for no pinning
+    int sharedSockets = 0;                      // robots share this many UDP sockets, 0 for one each
+    int sharedPort = 0;                         // local port of the shared sockets, 0 for any
+    int releaseCpu = -1;                        // pin the fleet command release thread here, -1 for no pinning
+
+    // live, applied to connected robots on reload
+    std::atomic<int> receiveTimeoutMs{ 0 };     // robot reply wait, 0 for livenessTimeoutMs
+    std::atomic<int> socketBufferBytes{ 0 };    // SO_RCVBUF/SO_SNDBUF, 0 for kernel default
+    std::atomic<bool> uringSockets{ false };    // backend for robots connected from now on
+    std::atomic<int> missionHistory{ 1024 };    // finished missions kept for status
+    std::atomic<int> telemetryPollMs{ 100 };    // sample rate for robots with open streams
+    std::atomic<int> streamBacklog{ 64 };       // events held for a stream that stopped reading
+    std::atomic<int> storeFlushMs{ 5000 };      // longest a recorded sample waits for disk
+    std::atomic<int> heartbeatMs{ 1000 };       // probe robots idle this long, 0 for no probes
+    std::atomic<int> livenessTimeoutMs{ 500 };  // reply wait before an exchange counts as missed
+    CommandLimits commands;                     // telecommand queue depth, link rate, delay target
+
+private:
+    std::string path;
+    std::map<std::string, std::string> overrides;   // command line, still wins on reload
+
+    bool apply(const std::map<std::string, std::string>& values, bool startup,
+               std::vector<std::string>& needsRestart, std::string& error);
+
+public:
+    bool Load(int argc, char* argv[], std::string& error);
+    // rereads the file, structural keys that changed are listed and left alone,
+    // keys dropped from the file keep their current value
+    bool Reload(std::vector<std::string>& needsRestart, std::string& error);
+    std::string Dump() const;
+};
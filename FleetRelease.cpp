@@ -0,0 +1,127 @@
+#include "FleetRelease.h"
+#include "FlightRecorder.h"
+#include <algorithm>
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+FleetRelease::FleetRelease(int cpu) : running(true) {
+    worker = std::thread(&FleetRelease::run, this, cpu);
+}
+
+FleetRelease::~FleetRelease() {
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        running = false;
+    }
+    changed.notify_one();
+    worker.join();
+}
+
+void FleetRelease::Schedule(Clock::time_point at, std::vector<ReleaseFrame> frames, Done done) {
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        pending.emplace(at, Burst{ std::move(frames), std::move(done) });
+    }
+    changed.notify_one();
+}
+
+void FleetRelease::run(int cpu) {
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    std::unique_lock<std::mutex> lk(lock);
+    while (running) {
+        if (pending.empty()) {
+            changed.wait(lk);
+            continue;
+        }
+        // an earlier burst scheduled meanwhile wakes us for itself
+        auto wake = pending.begin()->first - std::chrono::microseconds(SPINUS);
+        if (Clock::now() < wake) {
+            changed.wait_until(lk, wake);
+            continue;
+        }
+
+        Clock::time_point at = pending.begin()->first;
+        Burst burst = std::move(pending.begin()->second);
+        pending.erase(pending.begin());
+        lk.unlock();
+        ReleaseReport report = release(at, burst.frames);
+        burst.done(report);
+        lk.lock();
+    }
+}
+
+ReleaseReport FleetRelease::release(Clock::time_point at, std::vector<ReleaseFrame>& frames) {
+    // laid out before the target: frames grouped by socket, one mmsghdr each
+    std::vector<size_t> order(frames.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return frames[a].fd < frames[b].fd; });
+
+    std::vector<iovec> vectors(frames.size());
+    std::vector<mmsghdr> messages(frames.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        ReleaseFrame& frame = frames[order[i]];
+        vectors[i].iov_base = frame.frame.Data();
+        vectors[i].iov_len = frame.frame.Size();
+        messages[i] = {};
+        messages[i].msg_hdr.msg_name = &frame.peer;
+        messages[i].msg_hdr.msg_namelen = sizeof(frame.peer);
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    std::vector<Clock::time_point> done(frames.size());
+    std::vector<bool> sent(frames.size(), false);
+
+    ReleaseReport report{ true, (int)frames.size(), 0, 0, 0.0, 0.0, {} };
+    while (Clock::now() < at)
+        ;
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < order.size();) {
+        int fd = frames[order[i]].fd;
+        size_t end = i;
+        while (end < order.size() && end - i < MAXBATCH && frames[order[end]].fd == fd)
+            end++;
+
+        int n = sendmmsg(fd, &messages[i], (unsigned)(end - i), 0);
+        Clock::time_point now = Clock::now();
+        report.syscalls++;
+        if (n <= 0) {
+            // this frame is lost, the rest of the socket's frames are tried again
+            if (n < 0)
+                FlightRecorder::RecordText(FlightKind::SOCKET_ERROR, frames[order[i]].robot, errno, fd, "sendmmsg", 8);
+            done[i] = now;
+            i++;
+            continue;
+        }
+        for (size_t j = i; j < i + n; j++) {
+            done[j] = now;
+            sent[j] = true;
+        }
+        report.sent += n;
+        i += n;
+    }
+
+    // the flight recorder only once the burst is out
+    Clock::time_point last = start;
+    for (size_t i = 0; i < order.size(); i++) {
+        ReleaseFrame& frame = frames[order[i]];
+        if (sent[i])
+            FlightRecorder::Packet(FlightKind::PACKET_SENT, frame.robot, frame.frame.Data(), frame.frame.Size());
+        last = std::max(last, done[i]);
+        report.results.push_back({ frame.robot, (bool)sent[i],
+            std::chrono::duration<double, std::micro>(done[i] - at).count() });
+    }
+    report.lateUs = std::chrono::duration<double, std::micro>(start - at).count();
+    report.skewUs = std::chrono::duration<double, std::micro>(last - start).count();
+    return report;
+}
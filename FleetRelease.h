@@ -0,0 +1,75 @@
+#pragma once
+#include "BufferPool.h"
+#include <netinet/in.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// one robot's pre-encoded frame and where it goes
+struct ReleaseFrame {
+    int robot;
+    int fd;                     // the robot's socket, shared ones batch together
+    sockaddr_in peer;
+    PacketBuffer frame;
+};
+
+struct ReleaseResult {
+    int robot;
+    bool sent;                  // taken by the kernel
+    double offsetUs;            // its sendmmsg returned this long after the target
+};
+
+struct ReleaseReport {
+    bool released;              // false when the burst was cancelled
+    int robots;
+    int sent;
+    int syscalls;               // sendmmsg calls
+    double lateUs;              // target to the first sendmmsg call
+    double skewUs;              // first sendmmsg call to the last one returning
+    std::vector<ReleaseResult> results;
+};
+
+// Releases a burst of frames, one per robot, at a target time from a
+// thread of its own. Everything is encoded and laid out as mmsghdr arrays
+// before the target; the thread sleeps until SPINUS before it and spins
+// the rest, so the burst starts on time instead of a scheduler tick late.
+// Frames on the same socket go out in one sendmmsg each (all of them with
+// a UdpMux), so the send skew is a few syscalls rather than a request per
+// robot. Times are taken around each call, an upper bound on when each
+// frame left.
+class FleetRelease {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Done = std::function<void(const ReleaseReport&)>;
+
+    static constexpr int SPINUS = 2000;        // spun, not slept, before a target
+    static constexpr int MAXBATCH = 1024;      // frames per sendmmsg, UIO_MAXIOV
+
+private:
+    struct Burst {
+        std::vector<ReleaseFrame> frames;
+        Done done;
+    };
+
+    std::mutex lock;
+    std::condition_variable changed;
+    std::multimap<Clock::time_point, Burst> pending;
+    bool running;
+    std::thread worker;
+
+    void run(int cpu);
+    static ReleaseReport release(Clock::time_point at, std::vector<ReleaseFrame>& frames);
+
+public:
+    // cpu >= 0 pins the release thread
+    explicit FleetRelease(int cpu = -1);
+    // bursts not yet released are dropped, their Done never runs
+    ~FleetRelease();
+
+    // done runs on the release thread once the burst is out
+    void Schedule(Clock::time_point at, std::vector<ReleaseFrame> frames, Done done);
+};
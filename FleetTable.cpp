@@ -0,0 +1,113 @@
+#include "FleetTable.h"
+#include <algorithm>
+
+FleetTable::FleetTable() : size(0) {}
+
+// never destroyed, sessions may still report while statics go away
+FleetTable& FleetTable::Instance() {
+    static FleetTable* table = new FleetTable;
+    return *table;
+}
+
+uint32_t FleetTable::Attach(int robot) {
+    std::lock_guard<std::mutex> lk(lock);
+    auto it = slots.find(robot);
+    if (it != slots.end())
+        return it->second;
+
+    uint32_t slot = (uint32_t)size++;
+    if (size > reporting.size()) {
+        size_t padded = (size + BLOCK - 1) / BLOCK * BLOCK * 2;
+        for (auto* column : { &reporting, &commanded, &lastPktCounter, &currentGrade, &hitCount, &lastCmd, &lastCmdValue, &lastCmdSpeed })
+            column->resize(padded, 0);
+    }
+    slots.emplace(robot, slot);
+    return slot;
+}
+
+void FleetTable::Update(uint32_t slot, const telemetry& sample) {
+    std::lock_guard<std::mutex> lk(lock);
+    reporting[slot] = 1;
+    // a real drive always has a direction, all zero is a robot nobody drove yet
+    commanded[slot] = sample.LastCmd != (uint8_t)CMDType::DRIVE || sample.LastCmdValue != 0 || sample.LastCmdSpeed != 0;
+    lastPktCounter[slot] = sample.LastPktCounter;
+    currentGrade[slot] = sample.CurrentGrade;
+    hitCount[slot] = sample.HitCount;
+    lastCmd[slot] = sample.LastCmd;
+    lastCmdValue[slot] = sample.LastCmdValue;
+    lastCmdSpeed[slot] = sample.LastCmdSpeed;
+}
+
+bool FleetTable::Latest(int robot, telemetry& sample) {
+    std::lock_guard<std::mutex> lk(lock);
+    auto it = slots.find(robot);
+    if (it == slots.end() || !reporting[it->second])
+        return false;
+    uint32_t slot = it->second;
+    sample = { lastPktCounter[slot], currentGrade[slot], hitCount[slot],
+               lastCmd[slot], lastCmdValue[slot], lastCmdSpeed[slot] };
+    return true;
+}
+
+// One column op per loop with a fixed BLOCK trip count: GCC's cheap
+// vectorizer at -O2 takes these (a loop doing several reductions at once it
+// leaves scalar), each becomes a few 16 byte loads and adds or min/max.
+static uint32_t sumBlock(const uint8_t* column) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i < FleetTable::BLOCK; i++)
+        sum += column[i];
+    return sum;
+}
+
+static uint8_t maxBlock(const uint8_t* column) {
+    uint8_t most = 0;
+    for (size_t i = 0; i < FleetTable::BLOCK; i++)
+        most = column[i] > most ? column[i] : most;
+    return most;
+}
+
+// reporting is 0 or 1, so reporting - 1 is all ones exactly on the empty slots
+static uint8_t minReportingBlock(const uint8_t* column, const uint8_t* reporting) {
+    uint8_t least = 255;
+    for (size_t i = 0; i < FleetTable::BLOCK; i++) {
+        uint8_t value = column[i] | (uint8_t)(reporting[i] - 1);
+        least = value < least ? value : least;
+    }
+    return least;
+}
+
+static uint32_t countReportingBlock(const uint8_t* column, const uint8_t* reporting, uint8_t value) {
+    uint32_t count = 0;
+    for (size_t i = 0; i < FleetTable::BLOCK; i++)
+        count += reporting[i] & (column[i] == value);
+    return count;
+}
+
+FleetSummary FleetTable::Summarize() {
+    std::lock_guard<std::mutex> lk(lock);
+    uint64_t reportingTotal = 0, gradeTotal = 0, hitTotal = 0, driving = 0, sleeping = 0;
+    uint8_t minGrade = 255, maxGrade = 0, maxHits = 0;
+    for (size_t base = 0; base < size; base += BLOCK) {
+        const uint8_t* has = &reporting[base];
+        reportingTotal += sumBlock(has);
+        gradeTotal += sumBlock(&currentGrade[base]);
+        hitTotal += sumBlock(&hitCount[base]);
+        driving += countReportingBlock(&lastCmd[base], &commanded[base], (uint8_t)CMDType::DRIVE);
+        sleeping += countReportingBlock(&lastCmd[base], has, (uint8_t)CMDType::SLEEP);
+        minGrade = std::min(minGrade, minReportingBlock(&currentGrade[base], has));
+        maxGrade = std::max(maxGrade, maxBlock(&currentGrade[base]));
+        maxHits = std::max(maxHits, maxBlock(&hitCount[base]));
+    }
+
+    FleetSummary summary;
+    summary.robots = (uint32_t)size;
+    summary.reporting = (uint32_t)reportingTotal;
+    summary.meanGrade = reportingTotal ? (double)gradeTotal / reportingTotal : 0.0;
+    summary.minGrade = reportingTotal ? minGrade : 0;
+    summary.maxGrade = maxGrade;
+    summary.totalHits = hitTotal;
+    summary.maxHits = maxHits;
+    summary.driving = (uint32_t)driving;
+    summary.sleeping = (uint32_t)sleeping;
+    return summary;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "PktDef.h"
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct FleetSummary {
+    uint32_t robots;            // slots, every robot ever connected
+    uint32_t reporting;         // robots with a sample
+    double meanGrade;
+    uint8_t minGrade;
+    uint8_t maxGrade;
+    uint64_t totalHits;
+    uint8_t maxHits;
+    uint32_t driving;           // LastCmd drive, robots never commanded excluded
+    uint32_t sleeping;          // LastCmd sleep
+};
+
+// Latest telemetry of every robot, struct-of-arrays: one contiguous uint8_t
+// column per telemetry field, indexed by a slot each robot keeps for good.
+// An aggregate over the fleet is then a straight pass over one or two
+// columns instead of a pointer chase through every session. The columns
+// are padded to whole blocks and empty slots stay zero, so Summarize needs
+// no masks for its sums and no tail loop. Updates come from the receive
+// path; one lock, held for a single store or one pass.
+class FleetTable {
+public:
+    static const size_t BLOCK = 64;         // slots per pass of the inner loop
+
+private:
+    std::mutex lock;
+    std::unordered_map<int, uint32_t> slots;
+    size_t size;                            // slots in use
+    std::vector<uint8_t> reporting;         // 1 once the slot has a sample
+    std::vector<uint8_t> commanded;         // 1 while the sample shows a command, DRIVE is also LastCmd's zero value
+    std::vector<uint8_t> lastPktCounter;
+    std::vector<uint8_t> currentGrade;
+    std::vector<uint8_t> hitCount;
+    std::vector<uint8_t> lastCmd;
+    std::vector<uint8_t> lastCmdValue;
+    std::vector<uint8_t> lastCmdSpeed;
+
+public:
+    FleetTable();
+
+    // process-wide table the robot sessions report into
+    static FleetTable& Instance();
+
+    // the robot's slot, the same one on every reconnect
+    uint32_t Attach(int robot);
+    void Update(uint32_t slot, const telemetry& sample);
+    bool Latest(int robot, telemetry& sample);
+    FleetSummary Summarize();
+};
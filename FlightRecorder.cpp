@@ -0,0 +1,331 @@
+#include "FlightRecorder.h"
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+// One event in one cache line. seq is a seqlock as in Trace: odd while the
+// owning thread writes, so a reader racing it skips the slot. words hold
+// the time, kind/tid/robot, the four values and the text.
+struct alignas(64) FlightSlot {
+    std::atomic<uint64_t> seq{ 0 };
+    std::atomic<uint64_t> words[7] = {};
+};
+
+struct FlightRing {
+    std::atomic<bool> leased{ false };
+    std::atomic<uint64_t> head{ 0 };
+    FlightSlot slots[FlightRecorder::RINGSIZE];
+};
+
+struct FlightEvent {
+    int64_t time;
+    FlightKind kind;
+    int tid;
+    int robot;
+    uint32_t values[4];
+    char text[FlightRecorder::TEXTSIZE + 1];
+};
+
+// Rings are never freed and a finished thread hands its ring back, the next
+// new thread takes it over and overwrites what it still holds. A fixed
+// table, so the crash handler can walk it without a lock.
+static std::atomic<FlightRing*> rings[FlightRecorder::MAXTHREADS];
+static std::atomic<int> ringCount{ 0 };
+static std::mutex growLock;
+
+struct RingLease {
+    FlightRing* ring = nullptr;
+    int tid = 0;
+    bool tried = false;
+
+    ~RingLease() {
+        if (ring)
+            ring->leased.store(false, std::memory_order_release);
+    }
+};
+
+static thread_local RingLease lease;
+
+// steady clock for ordering, shifted to wall time when written out
+static const int64_t wallOffset =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count() -
+    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+static FlightRing* ring() {
+    if (lease.ring || lease.tried)
+        return lease.ring;
+    lease.tried = true;
+    lease.tid = (int)syscall(SYS_gettid);
+
+    std::lock_guard<std::mutex> lk(growLock);
+    int count = ringCount.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+        FlightRing* r = rings[i].load(std::memory_order_relaxed);
+        bool free = false;
+        if (r->leased.compare_exchange_strong(free, true, std::memory_order_acquire)) {
+            lease.ring = r;
+            return r;
+        }
+    }
+    if (count == FlightRecorder::MAXTHREADS)
+        return nullptr;
+
+    FlightRing* r = new FlightRing;
+    r->leased.store(true, std::memory_order_relaxed);
+    rings[count].store(r, std::memory_order_release);
+    ringCount.store(count + 1, std::memory_order_release);
+    lease.ring = r;
+    return r;
+}
+
+static void store(FlightRing& r, uint64_t header, uint64_t values0, uint64_t values1, const uint64_t* text) {
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    uint64_t index = r.head.load(std::memory_order_relaxed);
+    FlightSlot& slot = r.slots[index % FlightRecorder::RINGSIZE];
+
+    uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.words[0].store((uint64_t)now, std::memory_order_relaxed);
+    slot.words[1].store(header, std::memory_order_relaxed);
+    slot.words[2].store(values0, std::memory_order_relaxed);
+    slot.words[3].store(values1, std::memory_order_relaxed);
+    for (int i = 0; i < 3; i++)
+        slot.words[4 + i].store(text ? text[i] : 0, std::memory_order_relaxed);
+    slot.seq.store(seq + 2, std::memory_order_release);
+
+    r.head.store(index + 1, std::memory_order_release);
+}
+
+static uint64_t header(FlightKind kind, int tid, int robot) {
+    return (uint64_t)kind | ((uint64_t)(tid & 0xffffff) << 8) | ((uint64_t)(uint32_t)robot << 32);
+}
+
+void FlightRecorder::Record(FlightKind kind, int robot, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    FlightRing* r = ring();
+    if (r)
+        store(*r, header(kind, lease.tid, robot), a | ((uint64_t)b << 32), c | ((uint64_t)d << 32), nullptr);
+}
+
+void FlightRecorder::RecordText(FlightKind kind, int robot, uint32_t a, uint32_t b, const char* text, size_t length) {
+    FlightRing* r = ring();
+    if (!r)
+        return;
+    uint64_t packed[3] = {};
+    memcpy(packed, text, std::min<size_t>(length, TEXTSIZE));
+    store(*r, header(kind, lease.tid, robot), a | ((uint64_t)b << 32), 0, packed);
+}
+
+// PktCount, flag byte and length byte straight off the wire layout
+void FlightRecorder::Packet(FlightKind kind, int robot, const char* frame, int size) {
+    const unsigned char* bytes = (const unsigned char*)frame;
+    uint16_t count = 0;
+    if (size >= 2)
+        memcpy(&count, bytes, sizeof(count));
+    Record(kind, robot, count, size >= 3 ? bytes[2] : 0, size >= 4 ? bytes[3] : 0, (uint32_t)std::max(size, 0));
+}
+
+static bool load(const FlightSlot& slot, FlightEvent& event) {
+    uint64_t before = slot.seq.load(std::memory_order_acquire);
+    uint64_t words[7];
+    for (int i = 0; i < 7; i++)
+        words[i] = slot.words[i].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (before == 0 || (before & 1) || before != slot.seq.load(std::memory_order_relaxed))
+        return false;   // never written, or being overwritten right now
+
+    event.time = (int64_t)words[0];
+    event.kind = (FlightKind)(words[1] & 0xff);
+    event.tid = (int)((words[1] >> 8) & 0xffffff);
+    event.robot = (int)(uint32_t)(words[1] >> 32);
+    event.values[0] = (uint32_t)words[2];
+    event.values[1] = (uint32_t)(words[2] >> 32);
+    event.values[2] = (uint32_t)words[3];
+    event.values[3] = (uint32_t)(words[3] >> 32);
+    memcpy(event.text, &words[4], FlightRecorder::TEXTSIZE);
+    event.text[FlightRecorder::TEXTSIZE] = 0;
+    return true;
+}
+
+// one JSON object in a fixed buffer, no allocation or stdio so the crash handler can use it
+struct Line {
+    char data[256];
+    size_t size = 0;
+
+    void put(char c) {
+        if (size < sizeof(data))
+            data[size++] = c;
+    }
+    void text(const char* s) {
+        while (*s)
+            put(*s++);
+    }
+    void number(uint64_t value, int width = 0) {
+        char digits[20];
+        int n = 0;
+        do {
+            digits[n++] = (char)('0' + value % 10);
+            value /= 10;
+        } while (value);
+        for (; n < width; width--)
+            put('0');
+        while (n)
+            put(digits[--n]);
+    }
+    void signedNumber(int64_t value) {
+        if (value < 0) {
+            put('-');
+            number((uint64_t)-value);
+        }
+        else {
+            number((uint64_t)value);
+        }
+    }
+    void field(const char* name, uint64_t value) {
+        put(',');
+        put('"');
+        text(name);
+        text("\":");
+        number(value);
+    }
+    void quoted(const char* name, const char* value) {
+        put(',');
+        put('"');
+        text(name);
+        text("\":\"");
+        for (; *value; value++) {
+            unsigned char c = (unsigned char)*value;
+            if (c == '"' || c == '\\')
+                put('\\');
+            put(c < 0x20 ? '?' : (char)c);
+        }
+        put('"');
+    }
+};
+
+static void format(const FlightEvent& e, Line& line) {
+    static const char* names[] = { "sent", "received", "crc_failed", "socket_error", "exchange", "http" };
+    int64_t wall = e.time + wallOffset;
+    line.text("{\"t\":");
+    line.number((uint64_t)(wall / 1000000000));
+    line.put('.');
+    line.number((uint64_t)(wall % 1000000000) / 1000, 6);
+    line.field("tid", (uint64_t)e.tid);
+    line.text(",\"event\":\"");
+    line.text((size_t)e.kind < sizeof(names) / sizeof(names[0]) ? names[(size_t)e.kind] : "unknown");
+    line.put('"');
+    if (e.robot >= 0)
+        line.field("robot", (uint64_t)e.robot);
+
+    switch (e.kind) {
+    case FlightKind::PACKET_SENT:
+    case FlightKind::PACKET_RECEIVED:
+        line.field("count", e.values[0]);
+        line.field("flags", e.values[1]);
+        line.field("length", e.values[2]);
+        line.field("size", e.values[3]);
+        break;
+    case FlightKind::CRC_FAILED:
+        line.field("size", e.values[0]);
+        break;
+    case FlightKind::SOCKET_ERROR:
+        line.field("errno", e.values[0]);
+        line.field("fd", e.values[1]);
+        line.quoted("call", e.text);
+        break;
+    case FlightKind::EXCHANGE:
+        line.field("us", e.values[0]);
+        line.text(",\"bytes\":");
+        line.signedNumber((int32_t)e.values[1]);
+        line.field("errno", e.values[2]);
+        break;
+    case FlightKind::HTTP:
+        line.field("status", e.values[0]);
+        line.field("us", e.values[1]);
+        line.quoted("route", e.text);
+        break;
+    }
+    line.put('}');
+}
+
+std::string FlightRecorder::Export() {
+    std::vector<FlightEvent> events;
+    int count = ringCount.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        const FlightRing& r = *rings[i].load(std::memory_order_acquire);
+        uint64_t head = r.head.load(std::memory_order_acquire);
+        for (uint64_t j = head - std::min<uint64_t>(head, RINGSIZE); j < head; j++) {
+            FlightEvent event;
+            if (load(r.slots[j % RINGSIZE], event))
+                events.push_back(event);
+        }
+    }
+    std::sort(events.begin(), events.end(), [](const FlightEvent& a, const FlightEvent& b) {
+        return a.time < b.time;
+    });
+
+    std::string out = "{\"events\":[";
+    for (size_t i = 0; i < events.size(); i++) {
+        Line line;
+        format(events[i], line);
+        if (i)
+            out += ',';
+        out.append(line.data, line.size);
+    }
+    out += "]}";
+    return out;
+}
+
+// sorting would need memory, so each thread's events come out in its own order
+void FlightRecorder::Dump(int fd) {
+    int count = ringCount.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        const FlightRing& r = *rings[i].load(std::memory_order_acquire);
+        uint64_t head = r.head.load(std::memory_order_acquire);
+        for (uint64_t j = head - std::min<uint64_t>(head, RINGSIZE); j < head; j++) {
+            FlightEvent event;
+            if (!load(r.slots[j % RINGSIZE], event))
+                continue;
+            Line line;
+            format(event, line);
+            line.put('\n');
+            (void)!write(fd, line.data, line.size);
+        }
+    }
+}
+
+static int crashFd = 2;
+static std::atomic<bool> crashing{ false };
+
+static void onCrash(int sig) {
+    // a second thread crashing meanwhile waits for the first to take the process down
+    if (crashing.exchange(true)) {
+        while (true)
+            pause();
+    }
+    Line line;
+    line.text("{\"flight_recorder\":\"dump\"");
+    line.field("signal", (uint64_t)sig);
+    line.text("}\n");
+    (void)!write(crashFd, line.data, line.size);
+    FlightRecorder::Dump(crashFd);
+    raise(sig);     // SA_RESETHAND put the default action back
+}
+
+void FlightRecorder::InstallCrashHandler(int fd) {
+    crashFd = fd;
+    struct sigaction action {};
+    action.sa_handler = onCrash;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESETHAND;
+    for (int sig : { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT })
+        sigaction(sig, &action, nullptr);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// what an event's values mean
+enum class FlightKind : uint8_t {
+    PACKET_SENT,        // a PktCount, b flag bits, c length byte, d datagram size
+    PACKET_RECEIVED,    // same
+    CRC_FAILED,         // a datagram size
+    SOCKET_ERROR,       // a errno, b fd, text the call
+    EXCHANGE,           // a us, b bytes back (-1 none), c errno
+    HTTP                // a status, b us, text method and path
+};
+
+// Always-on flight recorder. Unlike Trace it never switches off: every
+// thread writes the events it sees into its own fixed ring (single writer,
+// seqlock slots, no locks or allocation after the thread's first event),
+// oldest overwritten, so there is always a recent history to look at after
+// something went wrong in the field. An event is one cache line and costs a
+// clock read and a handful of relaxed stores.
+class FlightRecorder {
+public:
+    static const int RINGSIZE = 4096;       // events kept per thread
+    static const int MAXTHREADS = 256;      // threads beyond this record nothing
+    static const int TEXTSIZE = 24;         // longer text is cut
+
+    static void Record(FlightKind kind, int robot, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t d = 0);
+    static void RecordText(FlightKind kind, int robot, uint32_t a, uint32_t b, const char* text, size_t length);
+    // header fields of a PktDef frame, what there is of them
+    static void Packet(FlightKind kind, int robot, const char* frame, int size);
+
+    // every thread's events merged oldest first, as JSON
+    static std::string Export();
+    // async-signal-safe: one JSON line per event, thread by thread
+    static void Dump(int fd);
+    // dumps to fd on SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT, then dies of the signal
+    static void InstallCrashHandler(int fd = 2);
+};
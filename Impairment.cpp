@@ -0,0 +1,242 @@
+#include "Impairment.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <sstream>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static bool parseNumber(const std::string& key, const std::string& text, double min, double max,
+                        double& out, std::string& error) {
+    char* end;
+    double value = strtod(text.c_str(), &end);
+    if (text.empty() || *end || value < min || value > max) {
+        error = key + " must be from " + std::to_string(min) + " to " + std::to_string(max);
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+bool parseImpairment(const std::string& spec, ImpairmentProfile& profile, std::string& error) {
+    std::stringstream list(spec);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        if (item.empty())
+            continue;
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            error = "expected key=value, got " + item;
+            return false;
+        }
+
+        std::string key = item.substr(0, eq);
+        std::string text = item.substr(eq + 1);
+        bool probability = (key == "loss" || key == "dup" || key == "reorder" || key == "corrupt");
+        bool millis = (key == "delay" || key == "jitter");
+        if (!probability && !millis && key != "rate") {
+            error = "unknown impairment " + key;
+            return false;
+        }
+
+        double value;
+        if (!parseNumber(key, text, 0, probability ? 1 : millis ? 60000 : 1e9, value, error))
+            return false;
+
+        if (key == "loss") profile.loss = value;
+        else if (key == "dup") profile.duplicate = value;
+        else if (key == "reorder") profile.reorder = value;
+        else if (key == "corrupt") profile.corrupt = value;
+        else if (key == "delay") profile.delayMs = (int)value;
+        else if (key == "jitter") profile.jitterMs = (int)value;
+        else profile.rateBytesPerSec = (int)value;
+    }
+    return true;
+}
+
+Impairment::Impairment(const ImpairmentProfile& profile, uint64_t seed)
+    : profile(profile), rng(seed)
+{
+}
+
+ImpairmentStats Impairment::Stats() const {
+    return stats;
+}
+
+void Impairment::Apply(const char* data, int size, Clock::time_point now, std::vector<Delivery>& out) {
+    // drawn up front, the same count whatever happens to the packet
+    std::uniform_real_distribution<double> chance(0, 1);
+    double lossRoll = chance(rng);
+    double dupRoll = chance(rng);
+    double reorderRoll = chance(rng);
+    double corruptRoll = chance(rng);
+    double jitter[2] = { chance(rng), chance(rng) };
+    uint64_t bit = rng();
+
+    stats.packets++;
+    if (lossRoll < profile.loss) {
+        stats.lost++;
+        return;
+    }
+
+    // behind the rate cap the packet waits for the link, too long a wait is a drop
+    auto departs = now;
+    if (profile.rateBytesPerSec > 0) {
+        departs = std::max(now, linkFree);
+        if (departs - now > std::chrono::milliseconds(MAXBACKLOGMS)) {
+            stats.overflowed++;
+            return;
+        }
+        linkFree = departs + std::chrono::microseconds((int64_t)size * 1000000 / profile.rateBytesPerSec);
+        departs = linkFree;
+    }
+
+    std::string bytes(data, size);
+    if (corruptRoll < profile.corrupt && size > 0) {
+        stats.corrupted++;
+        bytes[(bit >> 3) % size] ^= (char)(1 << (bit & 7));
+    }
+
+    int copies = (dupRoll < profile.duplicate) ? 2 : 1;
+    if (copies == 2)
+        stats.duplicated++;
+
+    for (int i = 0; i < copies; i++) {
+        double delay = profile.delayMs + jitter[i] * profile.jitterMs;
+        // long enough that packets sent shortly after overtake it
+        if (i == 0 && reorderRoll < profile.reorder) {
+            stats.reordered++;
+            delay += std::max(10, 2 * (profile.delayMs + profile.jitterMs));
+        }
+        auto at = departs + std::chrono::microseconds((int64_t)(delay * 1000));
+        if (i + 1 < copies)
+            out.push_back({ at, bytes });
+        else
+            out.push_back({ at, std::move(bytes) });
+    }
+}
+
+static int udpSocket(int port) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+ImpairmentProxy::ImpairmentProxy(int listenPort, const std::string& robotIp, int robotPort,
+                                 const ImpairmentProfile& upProfile, const ImpairmentProfile& downProfile, uint64_t seed)
+    : haveClient(false), client{}, up(upProfile, seed), down(downProfile, seed + 1), order(0), running(true)
+{
+    frontFd = udpSocket(listenPort);
+    backFd = udpSocket(0);
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    struct sockaddr_in robot = {};
+    robot.sin_family = AF_INET;
+    robot.sin_port = htons(robotPort);
+    inet_pton(AF_INET, robotIp.c_str(), &robot.sin_addr);
+    if (backFd >= 0 && connect(backFd, (struct sockaddr*)&robot, sizeof(robot)) != 0) {
+        close(backFd);
+        backFd = -1;
+    }
+
+    if (Ok())
+        worker = std::thread(&ImpairmentProxy::run, this);
+}
+
+ImpairmentProxy::~ImpairmentProxy() {
+    running = false;
+    if (worker.joinable()) {
+        uint64_t one = 1;
+        (void)!write(wakeFd, &one, sizeof(one));
+        worker.join();
+    }
+    for (int fd : { frontFd, backFd, wakeFd })
+        if (fd >= 0)
+            close(fd);
+}
+
+bool ImpairmentProxy::Ok() const {
+    return frontFd >= 0 && backFd >= 0 && wakeFd >= 0;
+}
+
+ImpairmentStats ImpairmentProxy::UpStats() {
+    std::lock_guard<std::mutex> lk(lock);
+    return up.Stats();
+}
+
+ImpairmentStats ImpairmentProxy::DownStats() {
+    std::lock_guard<std::mutex> lk(lock);
+    return down.Stats();
+}
+
+void ImpairmentProxy::receive(int fd, bool toRobot) {
+    char buffer[65536];
+    std::vector<Impairment::Delivery> deliveries;
+    while (true) {
+        struct sockaddr_in from;
+        socklen_t fromLen = sizeof(from);
+        ssize_t size = recvfrom(fd, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr*)&from, &fromLen);
+        if (size < 0)
+            return;
+        if (toRobot) {
+            client = from;
+            haveClient = true;
+        }
+
+        deliveries.clear();
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            (toRobot ? up : down).Apply(buffer, (int)size, Impairment::Clock::now(), deliveries);
+        }
+        for (auto& delivery : deliveries)
+            pending.push({ delivery.at, order++, toRobot, std::move(delivery.bytes) });
+    }
+}
+
+void ImpairmentProxy::run() {
+    struct pollfd fds[3] = {
+        { frontFd, POLLIN, 0 },
+        { backFd, POLLIN, 0 },
+        { wakeFd, POLLIN, 0 },
+    };
+
+    while (running) {
+        // send everything that is due, then sleep until the next one
+        auto now = Impairment::Clock::now();
+        while (!pending.empty() && pending.top().at <= now) {
+            const Scheduled& next = pending.top();
+            if (next.toRobot)
+                send(backFd, next.bytes.data(), next.bytes.size(), 0);
+            else if (haveClient)
+                sendto(frontFd, next.bytes.data(), next.bytes.size(), 0, (struct sockaddr*)&client, sizeof(client));
+            pending.pop();
+        }
+
+        int timeout = -1;
+        if (!pending.empty()) {
+            auto wait = std::chrono::duration_cast<std::chrono::microseconds>(pending.top().at - now).count();
+            timeout = (int)((wait + 999) / 1000);
+        }
+
+        if (poll(fds, 3, timeout) < 0 && errno != EINTR)
+            return;
+        if (fds[0].revents & POLLIN)
+            receive(frontFd, true);
+        if (fds[1].revents & POLLIN)
+            receive(backFd, false);
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <netinet/in.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What a bad link does to each packet. Probabilities are 0 to 1.
+struct ImpairmentProfile {
+    double loss = 0;
+    double duplicate = 0;
+    double reorder = 0;         // held back long enough for later packets to pass
+    double corrupt = 0;         // one flipped bit, always fails the popcount CRC
+    int delayMs = 0;
+    int jitterMs = 0;           // uniform 0..jitterMs on top of delay
+    int rateBytesPerSec = 0;    // serialization cap, 0 for none
+};
+
+// "loss=0.1,dup=0.01,reorder=0.05,corrupt=0.01,delay=5,jitter=20,rate=20000"
+bool parseImpairment(const std::string& spec, ImpairmentProfile& profile, std::string& error);
+
+struct ImpairmentStats {
+    uint64_t packets = 0;
+    uint64_t lost = 0;
+    uint64_t duplicated = 0;
+    uint64_t reordered = 0;
+    uint64_t corrupted = 0;
+    uint64_t overflowed = 0;    // dropped behind the rate cap
+};
+
+// One direction of a link. Every packet draws the same number of values
+// from a generator seeded once, so a given seed and packet sequence always
+// meets the same fate whatever the timing.
+class Impairment {
+public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr int MAXBACKLOGMS = 1000;  // longest wait behind the rate cap
+
+    struct Delivery {
+        Clock::time_point at;
+        std::string bytes;
+    };
+
+private:
+    ImpairmentProfile profile;
+    std::mt19937_64 rng;
+    Clock::time_point linkFree;
+    ImpairmentStats stats;
+
+public:
+    Impairment(const ImpairmentProfile& profile, uint64_t seed);
+
+    // the copies of the packet that will arrive, and when, appended to out
+    void Apply(const char* data, int size, Clock::time_point now, std::vector<Delivery>& out);
+    ImpairmentStats Stats() const;
+};
+
+// Loopback UDP relay that puts an impaired link in front of a robot.
+// Whoever sends to listenPort is forwarded to the robot through `up`,
+// replies come back through `down` to whoever sent last.
+class ImpairmentProxy {
+private:
+    struct Scheduled {
+        Impairment::Clock::time_point at;
+        uint64_t order;                     // keeps equal times in arrival order
+        bool toRobot;
+        std::string bytes;
+        bool operator>(const Scheduled& other) const {
+            return at != other.at ? at > other.at : order > other.order;
+        }
+    };
+
+    int frontFd;
+    int backFd;
+    int wakeFd;
+    bool haveClient;
+    struct sockaddr_in client;
+    std::mutex lock;                        // guards the impairments for Stats
+    Impairment up;
+    Impairment down;
+    std::priority_queue<Scheduled, std::vector<Scheduled>, std::greater<Scheduled>> pending;
+    uint64_t order;
+    std::atomic<bool> running;
+    std::thread worker;
+
+    void run();
+    void receive(int fd, bool toRobot);
+
+public:
+    ImpairmentProxy(int listenPort, const std::string& robotIp, int robotPort,
+                    const ImpairmentProfile& upProfile, const ImpairmentProfile& downProfile, uint64_t seed);
+    ~ImpairmentProxy();
+
+    bool Ok() const;
+    ImpairmentStats UpStats();
+    ImpairmentStats DownStats();
+};
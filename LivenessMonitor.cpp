@@ -0,0 +1,81 @@
+#include "LivenessMonitor.h"
+#include "RobotSession.h"
+#include "Reactor.h"
+#include "Trace.h"
+#include <algorithm>
+
+LivenessMonitor::LivenessMonitor(std::atomic<int>& heartbeatMs, std::atomic<int>& timeoutMs)
+    : heartbeatMs(heartbeatMs), timeoutMs(timeoutMs), running(true)
+{
+    worker = std::thread(&LivenessMonitor::run, this);
+}
+
+LivenessMonitor::~LivenessMonitor() {
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        running = false;
+    }
+    wakeup.notify_all();
+    worker.join();
+}
+
+Task<void> LivenessMonitor::probe(int robot, int timeoutMs) {
+    auto session = getSession(robot);
+    if (!session)
+        co_return;
+    PacketBuffer reply;
+    co_await session->Telemetry(reply, timeoutMs);
+}
+
+Task<size_t> LivenessMonitor::probeAll(std::vector<int> robots, int timeoutMs) {
+    TaskGroup group;
+    for (int robot : robots)
+        group.Spawn(probe(robot, timeoutMs));
+    co_await group.Wait();
+    co_return robots.size();
+}
+
+// robots in use are kept current by their own traffic, only idle ones are
+// probed. returns when the next robot goes idle, so none waits a whole
+// extra interval for its probe
+std::chrono::steady_clock::time_point LivenessMonitor::probeIdle() {
+    auto idle = std::chrono::milliseconds(heartbeatMs.load());
+    auto next = std::chrono::steady_clock::now() + idle;
+
+    std::vector<int> due;
+    forEachSession([idle, &next, &due](RobotSession& session) {
+        auto at = session.LastExchange() + idle;
+        if (std::chrono::steady_clock::now() >= at)
+            due.push_back(session.GetId());
+        else
+            next = std::min(next, at);
+    });
+    if (due.empty())
+        return next;
+
+    {
+        TraceRequest traced;
+        TraceSpan span("liveness probe");
+        Reactor::Instance().Run(probeAll(due, timeoutMs));
+    }
+    for (int robot : due)
+        if (auto session = getSession(robot))
+            next = std::min(next, session->LastExchange() + idle);
+    return next;
+}
+
+void LivenessMonitor::run() {
+    std::unique_lock<std::mutex> lk(lock);
+    while (running) {
+        // switched off, look again in a second in case a reload turns it on
+        auto next = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+
+        if (heartbeatMs > 0) {
+            lk.unlock();
+            next = probeIdle();
+            lk.lock();
+        }
+
+        wakeup.wait_until(lk, next, [this] { return !running; });
+    }
+}
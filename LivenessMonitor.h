@@ -0,0 +1,34 @@
+#pragma once
+#include "Task.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Heartbeat for connected robots. Every heartbeatMs it sends a status request
+// to each robot that has had no exchange for that long, waiting timeoutMs
+// for the reply, so a robot nobody is talking to still has a current
+// liveness state and a down robot is noticed when it answers again.
+// heartbeatMs 0 stops probing, the breaker is then fed by requests alone.
+// The probes due together go out together on the reactor, ten down robots
+// cost one timeout rather than ten.
+class LivenessMonitor {
+private:
+    std::atomic<int>& heartbeatMs;
+    std::atomic<int>& timeoutMs;
+    bool running;
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::thread worker;
+
+    void run();
+    std::chrono::steady_clock::time_point probeIdle();
+    static Task<void> probe(int robot, int timeoutMs);
+    static Task<size_t> probeAll(std::vector<int> robots, int timeoutMs);
+
+public:
+    LivenessMonitor(std::atomic<int>& heartbeatMs, std::atomic<int>& timeoutMs);
+    ~LivenessMonitor();
+};
@@ -0,0 +1,121 @@
+#include "MissionScheduler.h"
+
+MissionScheduler::MissionScheduler(Dispatch dispatch)
+    : dispatch(std::move(dispatch)), history(MAXFINISHED), nextId(1)
+{
+}
+
+void MissionScheduler::arm(int id, Mission& mission) {
+    auto deadline = mission.start + mission.steps[mission.next].at;
+    mission.timer = wheel.Schedule(deadline, [this, id] { fire(id); });
+}
+
+void MissionScheduler::retire(int id, Mission& mission, MissionState state) {
+    mission.state = state;
+    finished.push_back(id);
+    while (finished.size() > history) {
+        missions.erase(finished.front());
+        finished.pop_front();
+    }
+}
+
+void MissionScheduler::fire(int id) {
+    std::unique_lock<std::mutex> lk(lock);
+    auto it = missions.find(id);
+    if (it == missions.end() || it->second.state != MissionState::RUNNING)
+        return;
+
+    MissionStep step = it->second.steps[it->second.next];
+    int robot = it->second.robot;
+    auto deadline = it->second.start + step.at;
+
+    // send outside the lock so a slow socket never holds up other missions
+    lk.unlock();
+    long lateUs = std::chrono::duration_cast<std::chrono::microseconds>(TimerWheel::Clock::now() - deadline).count();
+    bool sent = dispatch(robot, step);
+    lk.lock();
+
+    // it may have been cancelled, or even trimmed from the map, meanwhile
+    it = missions.find(id);
+    if (it == missions.end() || it->second.state != MissionState::RUNNING)
+        return;
+
+    Mission& mission = it->second;
+
+    if (lateUs > mission.maxLateUs)
+        mission.maxLateUs = lateUs;
+
+    if (!sent) {
+        retire(id, mission, MissionState::FAILED);
+        return;
+    }
+
+    mission.next++;
+    if (mission.next == mission.steps.size())
+        retire(id, mission, MissionState::DONE);
+    else
+        arm(id, mission);
+}
+
+int MissionScheduler::Start(int robot, std::vector<MissionStep> steps, std::chrono::milliseconds delay) {
+    std::lock_guard<std::mutex> lk(lock);
+    int id = nextId++;
+
+    Mission& mission = missions[id];
+    mission.robot = robot;
+    mission.steps = std::move(steps);
+    mission.start = TimerWheel::Clock::now() + delay;
+    mission.next = 0;
+    mission.state = MissionState::RUNNING;
+    mission.timer = 0;
+    mission.maxLateUs = 0;
+
+    if (mission.steps.empty())
+        retire(id, mission, MissionState::DONE);
+    else
+        arm(id, mission);
+    return id;
+}
+
+bool MissionScheduler::Cancel(int id) {
+    std::lock_guard<std::mutex> lk(lock);
+    auto it = missions.find(id);
+    if (it == missions.end() || it->second.state != MissionState::RUNNING)
+        return false;
+
+    wheel.Cancel(it->second.timer);
+    retire(id, it->second, MissionState::CANCELLED);
+    return true;
+}
+
+bool MissionScheduler::GetStatus(int id, MissionStatus& status) {
+    std::lock_guard<std::mutex> lk(lock);
+    auto it = missions.find(id);
+    if (it == missions.end())
+        return false;
+
+    const Mission& mission = it->second;
+    status.id = id;
+    status.robot = mission.robot;
+    status.stepsSent = mission.next;
+    status.stepsTotal = mission.steps.size();
+    status.state = mission.state;
+    status.maxLateUs = mission.maxLateUs;
+    return true;
+}
+
+// takes effect on the next retire, a smaller limit trims the oldest then
+void MissionScheduler::SetHistory(size_t count) {
+    std::lock_guard<std::mutex> lk(lock);
+    history = count;
+}
+
+const char* missionStateName(MissionState state) {
+    switch (state) {
+        case MissionState::RUNNING: return "running";
+        case MissionState::DONE: return "done";
+        case MissionState::CANCELLED: return "cancelled";
+        case MissionState::FAILED: return "failed";
+    }
+    return "unknown";
+}
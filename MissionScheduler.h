@@ -0,0 +1,69 @@
+#pragma once
+#include "PktDef.h"
+#include "TimerWheel.h"
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+enum class MissionState { RUNNING, DONE, CANCELLED, FAILED };
+
+// one timed command, at is the offset from mission start so steps never drift
+struct MissionStep {
+    CMDType cmd;                        // DRIVE or SLEEP
+    driveBody body;                     // DRIVE only
+    std::chrono::milliseconds at;
+};
+
+struct MissionStatus {
+    int id;
+    int robot;
+    size_t stepsSent;
+    size_t stepsTotal;
+    MissionState state;
+    long maxLateUs;                     // worst dispatch lateness so far
+};
+
+// Runs uploaded missions on a timer wheel, one armed timer per mission.
+class MissionScheduler {
+public:
+    // sends one step, returns false when the robot is gone and the mission fails
+    using Dispatch = std::function<bool(int robot, const MissionStep& step)>;
+
+private:
+    static const size_t MAXFINISHED = 1024;    // default count of finished missions kept for status
+
+    struct Mission {
+        int robot;
+        std::vector<MissionStep> steps;
+        TimerWheel::Clock::time_point start;
+        size_t next;
+        MissionState state;
+        uint64_t timer;
+        long maxLateUs;
+    };
+
+    Dispatch dispatch;
+    std::mutex lock;
+    std::unordered_map<int, Mission> missions;
+    std::deque<int> finished;
+    size_t history;
+    int nextId;
+    TimerWheel wheel;                   // last, so its thread stops first
+
+    void arm(int id, Mission& mission);
+    void fire(int id);
+    void retire(int id, Mission& mission, MissionState state);
+
+public:
+    MissionScheduler(Dispatch dispatch);
+
+    int Start(int robot, std::vector<MissionStep> steps, std::chrono::milliseconds delay);
+    bool Cancel(int id);
+    bool GetStatus(int id, MissionStatus& status);
+    void SetHistory(size_t count);
+};
+
+const char* missionStateName(MissionState state);
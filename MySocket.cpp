@@ -1,14 +1,40 @@
 #include "MySocket.h"
+#include "PktDef.h"
+#include "FlightRecorder.h"
+#include <cerrno>
 #include <iostream>
 #include <cstring>
 #include <unistd.h> 
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <linux/filter.h>
+#include <linux/sock_diag.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#ifdef MYSOCKET_IO_URING
+#include "UringBackend.h"
+#endif
+
+static const unsigned int RINGSIZE = 1 << 16;   // framed receive ring, power of two
+static const size_t QUEUELIMIT = 1 << 16;       // queued bytes that force a flush
+static const int FLUSHWAITMS = 100;             // a full send buffer is waited on this long per flush
+
+// real failures go to the flight recorder, a receive timeout is not one
+static void recordError(const char* call, int fd) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+        FlightRecorder::RecordText(FlightKind::SOCKET_ERROR, -1, errno, fd, call, strlen(call));
+}
 
 MySocket::MySocket(SocketType type, std::string ip, unsigned int port, ConnectionType conn, unsigned int size)
-    : mySocket(type), IPAddr(ip), Port(port), connectionType(conn), bTCPConnect(false)
+    : mySocket(type), IPAddr(ip), Port(port), connectionType(conn), bTCPConnect(false),
+      backend(SocketBackend::BLOCKING), uring(nullptr), syscalls(0), sent(0), received(0),
+      filtered(false), busyPollUs(0), shared(false), framed(false), recvRing(nullptr), ringHead(0), ringTail(0)
 {
     MaxSize = (size > 0) ? size : DEFAULT_SIZE;
-    Buffer = new char[MaxSize];
-    memset(Buffer, 0, MaxSize);
 
     if (connectionType == ConnectionType::TCP)
         connectionSocket = socket(AF_INET, SOCK_STREAM, 0);
@@ -24,11 +50,32 @@ MySocket::MySocket(SocketType type, std::string ip, unsigned int port, Connectio
         bind(welcomeSocket, (struct sockaddr*)&SvrAddr, sizeof(SvrAddr));
         listen(welcomeSocket, SOMAXCONN);
     }
+    // a UDP server receives on its own port, replies go to whoever sent last
+    else if (type == SocketType::SERVER) {
+        bind(connectionSocket, (struct sockaddr*)&SvrAddr, sizeof(SvrAddr));
+    }
+
+    const char* env = getenv("MYSOCKET_BACKEND");
+    if (env && std::string(env) == "io_uring" && type == SocketType::CLIENT && conn == ConnectionType::UDP)
+        SetBackend(SocketBackend::IO_URING);
+}
+
+MySocket::MySocket(int fd, std::string ip, unsigned int port, unsigned int size)
+    : connectionSocket(fd), mySocket(SocketType::CLIENT), IPAddr(ip), Port(port), connectionType(ConnectionType::UDP),
+      bTCPConnect(false), backend(SocketBackend::BLOCKING), uring(nullptr), syscalls(0), sent(0), received(0),
+      filtered(false), busyPollUs(0), shared(true), framed(false), recvRing(nullptr), ringHead(0), ringTail(0)
+{
+    MaxSize = (size > 0) ? size : DEFAULT_SIZE;
+    SvrAddr.sin_family = AF_INET;
+    SvrAddr.sin_port = htons(port);
+    inet_pton(AF_INET, ip.c_str(), &SvrAddr.sin_addr);
 }
 
 MySocket::~MySocket() {
-    delete[] Buffer;
-    close(connectionSocket);
+    SetBackend(SocketBackend::BLOCKING);
+    delete[] recvRing;
+    if (!shared)
+        close(connectionSocket);
     if (mySocket == SocketType::SERVER && connectionType == ConnectionType::TCP)
         close(welcomeSocket);
 }
@@ -45,49 +92,286 @@ void MySocket::ConnectTCP() {
         connectionSocket = accept(welcomeSocket, (struct sockaddr*)&SvrAddr, &size);
         bTCPConnect = true;
     }
+
+    ringHead = ringTail = 0;
+    {
+        // a tail left by the old connection may start mid-frame
+        std::lock_guard<std::mutex> lk(sendLock);
+        sendQueue.clear();
+    }
+    if (framed)
+        setNoDelay();
 }
 
 void MySocket::DisconnectTCP() {
+    SetBackend(SocketBackend::BLOCKING);
     close(connectionSocket);
     bTCPConnect = false;
 }
 
 void MySocket::SendData(const char* data, int size) {
+    sent++;
+    if (framed) {
+        // anything already queued has to go out first to keep frame order
+        std::lock_guard<std::mutex> lk(sendLock);
+        sendQueue.append(data, size);
+        flushQueue();
+        return;
+    }
+#ifdef MYSOCKET_IO_URING
+    if (uring) {
+        if (!uring->Send(data, size, true))
+            recordError("io_uring send", connectionSocket);
+        return;
+    }
+#endif
+    syscalls++;
     if (connectionType == ConnectionType::TCP) {
-        send(connectionSocket, data, size, 0);
+        if (send(connectionSocket, data, size, 0) < 0)
+            recordError("send", connectionSocket);
     }
     else {
-        sendto(connectionSocket, data, size, 0, (struct sockaddr*)&SvrAddr, sizeof(SvrAddr));
+        if (sendto(connectionSocket, data, size, 0, (struct sockaddr*)&SvrAddr, sizeof(SvrAddr)) < 0)
+            recordError("sendto", connectionSocket);
+    }
+}
+
+// io_uring holds queued sends until Flush (or the next SendData), the
+// blocking backend has nothing to batch and sends right away
+void MySocket::QueueData(const char* data, int size) {
+    if (framed) {
+        std::lock_guard<std::mutex> lk(sendLock);
+        sent++;
+        sendQueue.append(data, size);
+        if (sendQueue.size() >= QUEUELIMIT)
+            flushQueue();
+        return;
+    }
+#ifdef MYSOCKET_IO_URING
+    if (uring) {
+        sent++;
+        if (!uring->Send(data, size, false))
+            recordError("io_uring send", connectionSocket);
+        return;
+    }
+#endif
+    SendData(data, size);
+}
+
+bool MySocket::Flush() {
+    if (framed) {
+        std::lock_guard<std::mutex> lk(sendLock);
+        return flushQueue();
     }
+#ifdef MYSOCKET_IO_URING
+    if (uring)
+        uring->Flush();
+#endif
+    return true;
 }
 
 int MySocket::GetData(char* dest) {
     int bytes = 0;
+    if (framed) {
+        bytes = getFrame(dest);
+        if (bytes > 0)
+            received++;
+        return bytes;
+    }
+#ifdef MYSOCKET_IO_URING
+    if (uring) {
+        bytes = uring->Receive(dest, MaxSize);
+        if (bytes > 0)
+            received++;
+        return bytes;
+    }
+#endif
+    if (busyPollUs > 0) {
+        // the blocking call only once the spin has found nothing
+        auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(busyPollUs);
+        do {
+            bytes = receive(dest, MSG_DONTWAIT);
+            if (bytes >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                return bytes;
+        } while (std::chrono::steady_clock::now() < until);
+    }
+    return receive(dest, 0);
+}
+
+// straight into the caller's memory, dest must hold MaxSize bytes
+int MySocket::receive(char* dest, int flags) {
+    int bytes;
+    syscalls++;
     if (connectionType == ConnectionType::TCP) {
-        bytes = recv(connectionSocket, Buffer, MaxSize, 0);
+        bytes = recv(connectionSocket, dest, MaxSize, flags);
     }
     else {
         socklen_t addrLen = sizeof(SvrAddr);
-        bytes = recvfrom(connectionSocket, Buffer, MaxSize, 0, (struct sockaddr*)&SvrAddr, &addrLen);
+        bytes = recvfrom(connectionSocket, dest, MaxSize, flags, (struct sockaddr*)&SvrAddr, &addrLen);
     }
-    memcpy(dest, Buffer, bytes);
+    if (bytes > 0)
+        received++;
+    else if (bytes < 0)
+        recordError(connectionType == ConnectionType::TCP ? "recv" : "recvfrom", connectionSocket);
+    return bytes;
+}
+
+// receives into a pooled slab, the handle can be shared on without copying
+int MySocket::GetData(PacketBuffer& dest) {
+    dest = BufferPool::Instance().Acquire(MaxSize);
+    int bytes = GetData(dest.Data());
+    dest.SetSize(bytes > 0 ? bytes : 0);
+    return bytes;
+}
+
+int MySocket::TryGetData(PacketBuffer& dest) {
+    dest = BufferPool::Instance().Acquire(MaxSize);
+    syscalls++;
+    int bytes = recv(connectionSocket, dest.Data(), MaxSize, MSG_DONTWAIT);
+    if (bytes > 0)
+        received++;
+    else if (bytes < 0)
+        recordError("recv", connectionSocket);
+    dest.SetSize(bytes > 0 ? bytes : 0);
     return bytes;
 }
 
+int MySocket::GetHandle() const {
+    return connectionSocket;
+}
+
+bool MySocket::WaitForData(int ms) {
+    if (uring)
+        return true;
+    // a whole frame may already be waiting in the reassembly ring
+    unsigned int avail = ringTail - ringHead;
+    if (framed && avail > LENGTHOFFSET && avail >= (unsigned char)recvRing[(ringHead + LENGTHOFFSET) & (RINGSIZE - 1)])
+        return true;
+
+    struct pollfd fd = { connectionSocket, POLLIN, 0 };
+    if (busyPollUs > 0) {
+        // the spin counts against ms
+        auto start = std::chrono::steady_clock::now();
+        auto spin = std::chrono::microseconds(busyPollUs);
+        if (ms >= 0)
+            spin = std::min<std::chrono::microseconds>(spin, std::chrono::milliseconds(ms));
+        do {
+            syscalls++;
+            if (poll(&fd, 1, 0) > 0)
+                return true;
+        } while (std::chrono::steady_clock::now() - start < spin);
+        if (ms >= 0)
+            ms = std::max(0, ms - (int)std::chrono::duration_cast<std::chrono::milliseconds>(spin).count());
+    }
+
+    syscalls++;
+    return poll(&fd, 1, ms) > 0;
+}
+
+// All queued frames in as few sends as the kernel allows, caller holds
+// sendLock. A full send buffer is waited out for FLUSHWAITMS; whatever is
+// still unsent then stays queued, in order, for the next flush.
+bool MySocket::flushQueue() {
+    size_t offset = 0;
+    bool ok = true;
+    while (offset < sendQueue.size()) {
+        syscalls++;
+        ssize_t bytes = send(connectionSocket, sendQueue.data() + offset, sendQueue.size() - offset, MSG_NOSIGNAL);
+        if (bytes > 0) {
+            offset += bytes;
+            continue;
+        }
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            pollfd fd{ connectionSocket, POLLOUT, 0 };
+            syscalls++;
+            if (poll(&fd, 1, FLUSHWAITMS) > 0 && !(fd.revents & (POLLERR | POLLHUP)))
+                continue;
+        }
+        else if (bytes < 0) {
+            recordError("send", connectionSocket);
+        }
+        ok = false;
+        break;
+    }
+    sendQueue.erase(0, offset);
+    return ok;
+}
+
+// one whole frame from the stream, reading only when the ring holds no complete frame
+int MySocket::getFrame(char* dest) {
+    const unsigned int mask = RINGSIZE - 1;
+    while (true) {
+        unsigned int avail = ringTail - ringHead;
+        if (avail > LENGTHOFFSET) {
+            unsigned int size = (unsigned char)recvRing[(ringHead + LENGTHOFFSET) & mask];
+            if (size < MINFRAMESIZE || (int)size > MaxSize) {
+                ringHead = ringTail;    // length byte is garbage, stream sync is lost
+                return -1;
+            }
+
+            if (avail >= size) {
+                unsigned int start = ringHead & mask;
+                unsigned int first = std::min(size, RINGSIZE - start);
+                memcpy(dest, recvRing + start, first);
+                memcpy(dest + first, recvRing, size - first);
+                ringHead += size;
+                return size;
+            }
+        }
+
+        // fill all free space, both halves in one readv when it wraps
+        unsigned int tail = ringTail & mask;
+        unsigned int space = RINGSIZE - avail;
+        iovec iov[2];
+        iov[0].iov_base = recvRing + tail;
+        iov[0].iov_len = std::min(space, RINGSIZE - tail);
+        iov[1].iov_base = recvRing;
+        iov[1].iov_len = space - iov[0].iov_len;
+
+        syscalls++;
+        ssize_t bytes = readv(connectionSocket, iov, iov[1].iov_len ? 2 : 1);
+        if (bytes <= 0) {
+            if (bytes < 0)
+                recordError("readv", connectionSocket);
+            return (int)bytes;
+        }
+        ringTail += bytes;
+    }
+}
+
+void MySocket::setNoDelay() {
+    int on = 1;
+    setsockopt(connectionSocket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
 std::string MySocket::GetIPAddr() const {
     return IPAddr;
 }
 
+const sockaddr_in& MySocket::GetPeer() const {
+    return SvrAddr;
+}
+
 void MySocket::SetIPAddr(std::string ip) {
     if (bTCPConnect) return;
     IPAddr = ip;
     inet_pton(AF_INET, ip.c_str(), &SvrAddr.sin_addr);
+    if (uring)
+        connect(connectionSocket, (struct sockaddr*)&SvrAddr, sizeof(SvrAddr));
+    if (filtered)
+        attachFilter();
 }
 
 void MySocket::SetPort(int port) {
     if (bTCPConnect) return;
     Port = port;
     SvrAddr.sin_port = htons(port);
+    if (uring)
+        connect(connectionSocket, (struct sockaddr*)&SvrAddr, sizeof(SvrAddr));
+    if (filtered)
+        attachFilter();
 }
 
 int MySocket::GetPort() const {
@@ -103,3 +387,160 @@ void MySocket::SetType(SocketType type) {
     mySocket = type;
 }
 
+bool MySocket::SetBackend(SocketBackend type) {
+    if (type == backend)
+        return true;
+
+#ifdef MYSOCKET_IO_URING
+    if (type == SocketBackend::BLOCKING) {
+        delete uring;
+        uring = nullptr;
+        backend = type;
+        return true;
+    }
+
+    // connecting a shared socket would cut it off from every other peer
+    if (framed || shared)
+        return false;
+
+    if (connectionType == ConnectionType::UDP) {
+        // fixed buffer writes carry no address, so the peer is connected instead
+        if (mySocket != SocketType::CLIENT)
+            return false;
+        if (connect(connectionSocket, (struct sockaddr*)&SvrAddr, sizeof(SvrAddr)) < 0)
+            return false;
+    }
+    else if (!bTCPConnect) {
+        return false;
+    }
+
+    uring = new UringBackend(connectionSocket, MaxSize, syscalls);
+    if (!uring->Ok()) {
+        delete uring;
+        uring = nullptr;
+        return false;
+    }
+    backend = type;
+    return true;
+#else
+    return type == SocketBackend::BLOCKING;
+#endif
+}
+
+SocketBackend MySocket::GetBackend() const {
+    return backend;
+}
+
+SocketStats MySocket::GetStats() const {
+    uint32_t meminfo[SK_MEMINFO_VARS] = {};
+    socklen_t size = sizeof(meminfo);
+    getsockopt(connectionSocket, SOL_SOCKET, SO_MEMINFO, meminfo, &size);
+    return { syscalls.load(), sent.load(), received.load(), meminfo[SK_MEMINFO_DROPS] };
+}
+
+bool MySocket::SetFramed(bool on) {
+    if (connectionType != ConnectionType::TCP || backend != SocketBackend::BLOCKING)
+        return false;
+
+    std::lock_guard<std::mutex> lk(sendLock);
+    if (framed && !on)
+        flushQueue();
+    if (on && !recvRing)
+        recvRing = new char[RINGSIZE];
+
+    framed = on;
+    ringHead = ringTail = 0;
+    if (on && bTCPConnect)
+        setNoDelay();
+    return true;
+}
+
+bool MySocket::GetFramed() const {
+    return framed;
+}
+
+bool MySocket::attachFilter() {
+    return AttachPacketFilter(connectionSocket, (mySocket == SocketType::CLIENT) ? &SvrAddr : nullptr);
+}
+
+// Classic BPF, run on each datagram before it is queued. Offset 0 is the
+// UDP header, the frame starts at 8, the IP header is reached through
+// SKF_NET_OFF, and loads come back in host order. With a peer the program
+// starts with the peer check, without one it skips it: jumps are relative,
+// so the tail alone is still a whole program.
+bool MySocket::AttachPacketFilter(int fd, const sockaddr_in* peer) {
+    const uint32_t UDP = 8;
+    const uint32_t COMMANDFLAGS = 0x0F;                 // drive, status, sleep, ack
+    const uint32_t PEERCHECK = 4;                       // instructions before the frame checks
+    uint32_t ip = peer ? ntohl(peer->sin_addr.s_addr) : 0;
+    uint32_t port = peer ? ntohs(peer->sin_port) : 0;
+
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)SKF_NET_OFF + 12),    // source address
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ip, 0, 11),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 0),                              // source port
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 0, 9),
+
+        BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),                              // frame size
+        BPF_STMT(BPF_ALU | BPF_SUB | BPF_K, UDP),
+        BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, MINFRAMESIZE, 0, 6),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, UDP + LENGTHOFFSET),             // its length byte
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_X, 0, 0, 3),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, UDP + FLAGSOFFSET),              // command flags
+        BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, COMMANDFLAGS, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+
+    uint32_t skip = peer ? 0 : PEERCHECK;
+    struct sock_fprog program;
+    program.len = (unsigned short)(sizeof(code) / sizeof(code[0]) - skip);
+    program.filter = code + skip;
+    return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) == 0;
+}
+
+// a shared socket's filter is its owner's, it cannot check one peer
+bool MySocket::SetPacketFilter(bool on) {
+    if (connectionType != ConnectionType::UDP || shared)
+        return false;
+    if (!on) {
+        if (filtered)
+            setsockopt(connectionSocket, SOL_SOCKET, SO_DETACH_FILTER, nullptr, 0);
+        filtered = false;
+        return true;
+    }
+    filtered = attachFilter();
+    return filtered;
+}
+
+bool MySocket::GetPacketFilter() const {
+    return filtered;
+}
+
+bool MySocket::SetBusyPoll(int us) {
+    if (us < 0 || framed || uring)
+        return false;
+    busyPollUs = us;
+    // best effort, the spin in user space works without it
+    setsockopt(connectionSocket, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us));
+    return true;
+}
+
+int MySocket::GetBusyPoll() const {
+    return busyPollUs;
+}
+
+bool MySocket::SetReceiveTimeout(int ms) {
+    struct timeval tv;
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    return setsockopt(connectionSocket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0;
+}
+
+bool MySocket::SetBufferSize(int bytes) {
+    if (bytes <= 0)
+        return true;
+    return setsockopt(connectionSocket, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes)) == 0 &&
+           setsockopt(connectionSocket, SOL_SOCKET, SO_SNDBUF, &bytes, sizeof(bytes)) == 0;
+}
@@ -5,18 +5,32 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 
+#include "BufferPool.h"
+
+#include <atomic>
+#include <mutex>
 #include <string>
 
 #pragma comment(lib, "Ws2_32.lib")
 
 enum class SocketType { CLIENT, SERVER };
 enum class ConnectionType { TCP, UDP };
+enum class SocketBackend { BLOCKING, IO_URING };
 
 const int DEFAULT_SIZE = 1024;
 
+// kernel calls and packets through one socket, for benchmarks and diagnostics
+struct SocketStats {
+    unsigned long long syscalls;
+    unsigned long long sent;
+    unsigned long long received;
+    unsigned long long dropped;     // by the kernel: packet filter rejects and a full receive buffer
+};
+
+class UringBackend;
+
 class MySocket {
 private:
-    char* Buffer;
     int welcomeSocket;
     int connectionSocket;
     struct sockaddr_in SvrAddr;
@@ -26,20 +40,96 @@ private:
     ConnectionType connectionType;
     bool bTCPConnect;
     int MaxSize;
+    SocketBackend backend;
+    UringBackend* uring;
+    std::atomic<unsigned long long> syscalls;
+    std::atomic<unsigned long long> sent;
+    std::atomic<unsigned long long> received;
+    bool filtered;
+    int busyPollUs;
+    bool shared;                    // the socket belongs to someone else, never closed here
+
+    // framed TCP: reassembly ring for whole PktDef frames, coalesced sends
+    bool framed;
+    char* recvRing;
+    unsigned int ringHead;
+    unsigned int ringTail;
+    std::string sendQueue;
+    std::mutex sendLock;
+
+    int getFrame(char*);
+    bool flushQueue();
+    void setNoDelay();
+    bool attachFilter();
+    int receive(char*, int flags);
 
 public:
     MySocket(SocketType, std::string, unsigned int, ConnectionType, unsigned int);
+    // UDP client sending on a socket owned elsewhere (UdpMux), left open on
+    // destruction. Its receives would take other peers' datagrams too.
+    MySocket(int, std::string, unsigned int, unsigned int);
     ~MySocket();
 
     void ConnectTCP();
     void DisconnectTCP();
     void SendData(const char*, int);
+    void QueueData(const char*, int);
+    // false when framed frames are still queued (the peer is not reading,
+    // or the connection failed), they go out first on the next send
+    bool Flush();
     int GetData(char*);
+    int GetData(PacketBuffer&);
+    // true once GetData would not block, false after ms without data.
+    // io_uring sockets always report ready and leave the wait to GetData.
+    bool WaitForData(int);
+    // GetData that never blocks, -1 with errno EAGAIN when nothing is waiting.
+    // A plain recv for event loops that wait on GetHandle themselves, it
+    // bypasses io_uring and framing and must not be mixed with GetData.
+    int TryGetData(PacketBuffer&);
+    int GetHandle() const;
 
     std::string GetIPAddr() const;
+    // where SendData sends, for callers batching sends on GetHandle themselves
+    const sockaddr_in& GetPeer() const;
     void SetIPAddr(std::string);
     void SetPort(int);
     int GetPort() const;
     SocketType GetType() const;
     void SetType(SocketType);
+
+    // io_uring needs a connected peer: a UDP client or a connected TCP socket.
+    // MYSOCKET_BACKEND=io_uring in the environment selects it for new UDP clients.
+    bool SetBackend(SocketBackend);
+    SocketBackend GetBackend() const;
+    SocketStats GetStats() const;
+
+    // TCP only: GetData returns exactly one PktDef frame (cut on its length
+    // byte), Nagle is off and QueueData coalesces frames into one write
+    bool SetFramed(bool);
+    bool GetFramed() const;
+
+    // GetData gives up after ms and returns -1 (errno EAGAIN), 0 blocks forever.
+    // Blocking backend only, io_uring receives ignore it.
+    bool SetReceiveTimeout(int);
+    // SO_RCVBUF and SO_SNDBUF, 0 leaves the kernel default
+    bool SetBufferSize(int);
+
+    // UDP only: a BPF program in the kernel drops datagrams that cannot be a
+    // PktDef frame before they are queued, so they never wake a reader. Kept:
+    // at least MINFRAMESIZE bytes, length byte equal to the datagram size and
+    // a command flag set, and on a client only datagrams from the peer.
+    bool SetPacketFilter(bool);
+    bool GetPacketFilter() const;
+    // the same program on any UDP socket, the peer check only when peer is given
+    static bool AttachPacketFilter(int fd, const sockaddr_in* peer);
+
+    // Low-latency receive: GetData and WaitForData spin on non-blocking
+    // calls for up to us microseconds before they block, trading a core for
+    // the wakeup and scheduling latency of a sleeping reader. SO_BUSY_POLL
+    // is set as well, so on a NAPI device the kernel polls the driver
+    // during those calls (not on loopback, and raising it past
+    // net.core.busy_read needs CAP_NET_ADMIN). For a thread on a core of its
+    // own, 0 turns it off. Blocking backend, not framed.
+    bool SetBusyPoll(int us);
+    int GetBusyPoll() const;
 };
@@ -156,3 +156,25 @@ unsigned char* PktDef::genPacket() {
     return RawBuffer;
 }
 
+//same precedence as getCMD
+CMDType frameCommand(const unsigned char* frame) {
+	uint8_t flags = frame[FLAGSOFFSET];
+	if (flags & 0x01) return CMDType::DRIVE;
+	if (flags & 0x04) return CMDType::SLEEP;
+	if (flags & 0x02) return CMDType::RESPONSE;
+	return CMDType::DRIVE;
+}
+
+bool validFrame(const unsigned char* frame, int size) {
+	if (size < MINFRAMESIZE || size > 255 || frame[LENGTHOFFSET] != size)
+		return false;
+	PktDef pkt;
+	return pkt.checkCRC((unsigned char*)frame, (unsigned char)size);
+}
+
+bool frameTelemetry(const unsigned char* frame, int size, telemetry& sample) {
+	if (size < (int)(HEADERSIZE + sizeof(telemetry) + 1) || !validFrame(frame, size) || frameCommand(frame) != CMDType::RESPONSE)
+		return false;
+	memcpy(&sample, frame + HEADERSIZE, sizeof(sample));
+	return true;
+}
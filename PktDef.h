@@ -15,6 +15,9 @@ const unsigned char RIGHT = 3;
 const unsigned char LEFT = 4;
 
 const unsigned char HEADERSIZE = 4;		//updated
+const unsigned char FLAGSOFFSET = 2;			//wire offset of header.cmdFlags, after PktCount
+const unsigned char LENGTHOFFSET = HEADERSIZE - 1;	//wire offset of header.length (whole frame size)
+const unsigned char MINFRAMESIZE = HEADERSIZE + 1;	//header + CRC, no body
 
 //header
 struct Header {
@@ -71,4 +74,15 @@ public:
 	void calcCRC();				//counting number of 1s
 	unsigned char* genPacket();
 	~PktDef();
-};
\ No newline at end of file
+};
+
+//Decoding straight off a wire frame (header, body, CRC). The raw
+//constructor above takes the body length from the first body byte, so it
+//must not be used on received frames.
+CMDType frameCommand(const unsigned char* frame);	//frame holds at least HEADERSIZE bytes
+//length byte matches size and the CRC is good; frames over 255 bytes
+//cannot carry their own length and are never valid
+bool validFrame(const unsigned char* frame, int size);
+//true for a whole RESPONSE frame with a good CRC and a telemetry body,
+//which is copied out from HEADERSIZE
+bool frameTelemetry(const unsigned char* frame, int size, telemetry& sample);
@@ -0,0 +1,148 @@
+#include "Reactor.h"
+#include <algorithm>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+Reactor& Reactor::Instance() {
+    static Reactor reactor;
+    return reactor;
+}
+
+Reactor::Reactor() : running(true) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+    worker = std::thread(&Reactor::run, this);
+    threadId = worker.get_id();
+}
+
+// coroutines still suspended at exit are left where they are
+Reactor::~Reactor() {
+    running = false;
+    uint64_t one = 1;
+    (void)!write(wakeFd, &one, sizeof(one));
+    worker.join();
+    close(wakeFd);
+    close(epollFd);
+}
+
+bool Reactor::InReactor() const {
+    return std::this_thread::get_id() == threadId;
+}
+
+void Reactor::Post(std::coroutine_handle<> handle) {
+    {
+        std::lock_guard<std::mutex> lk(postLock);
+        posted.push_back(handle);
+    }
+    uint64_t one = 1;
+    (void)!write(wakeFd, &one, sizeof(one));
+}
+
+Detached Reactor::start(Reactor& reactor, Task<void> task) {
+    co_await reactor.Schedule();
+    co_await task;
+}
+
+void Reactor::Spawn(Task<void> task) {
+    start(*this, std::move(task));
+}
+
+// false resumes the awaiting coroutine at once, the fd could not be watched
+bool Reactor::watch(Waiter& waiter, int timeoutMs) {
+    if (waiter.fd >= 0) {
+        // one-shot, so a reply nobody waits for any more never wakes us.
+        // a closed fd leaves the set by itself, its number may come back as a new socket
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLONESHOT;
+        event.data.fd = waiter.fd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_MOD, waiter.fd, &event) != 0 &&
+            (errno != ENOENT || epoll_ctl(epollFd, EPOLL_CTL_ADD, waiter.fd, &event) != 0)) {
+            waiter.ready = true;
+            return false;
+        }
+        readers[waiter.fd] = &waiter;
+    }
+    if (timeoutMs >= 0) {
+        waiter.timed = true;
+        waiter.deadline = deadlines.emplace(Clock::now() + std::chrono::milliseconds(timeoutMs), &waiter);
+    }
+    return true;
+}
+
+void Reactor::expire(Clock::time_point now, std::vector<std::coroutine_handle<>>& ready) {
+    while (!deadlines.empty() && deadlines.begin()->first <= now) {
+        Waiter* waiter = deadlines.begin()->second;
+        deadlines.erase(deadlines.begin());
+        waiter->timed = false;
+        if (waiter->fd >= 0)
+            readers.erase(waiter->fd);
+        if (waiter->parked)
+            waiter->parked->waiter = nullptr;
+        ready.push_back(waiter->handle);
+    }
+}
+
+void Reactor::Wake(Parking& parking) {
+    Waiter* waiter = parking.waiter;
+    if (!waiter)
+        return;
+    parking.waiter = nullptr;
+    waiter->parked = nullptr;
+    if (waiter->timed) {
+        deadlines.erase(waiter->deadline);
+        waiter->timed = false;
+    }
+    waiter->ready = true;
+    woken.push_back(waiter->handle);
+}
+
+void Reactor::run() {
+    epoll_event events[64];
+    std::vector<std::coroutine_handle<>> ready;
+
+    while (running) {
+        int timeout = -1;
+        if (!deadlines.empty()) {
+            auto wait = std::chrono::ceil<std::chrono::milliseconds>(deadlines.begin()->first - Clock::now()).count();
+            timeout = (int)std::max<long long>(wait, 0);
+        }
+        if (!woken.empty())
+            timeout = 0;
+
+        int n = epoll_wait(epollFd, events, 64, timeout);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == wakeFd) {
+                uint64_t count;
+                (void)!read(wakeFd, &count, sizeof(count));
+                continue;
+            }
+            auto it = readers.find(fd);
+            if (it == readers.end())
+                continue;
+            Waiter* waiter = it->second;
+            readers.erase(it);
+            if (waiter->timed)
+                deadlines.erase(waiter->deadline);
+            waiter->ready = true;
+            ready.push_back(waiter->handle);
+        }
+        expire(Clock::now(), ready);
+        ready.insert(ready.end(), woken.begin(), woken.end());
+        woken.clear();
+        {
+            std::lock_guard<std::mutex> lk(postLock);
+            ready.insert(ready.end(), posted.begin(), posted.end());
+            posted.clear();
+        }
+
+        for (auto handle : ready)
+            handle.resume();
+        ready.clear();
+    }
+}
@@ -0,0 +1,180 @@
+#pragma once
+#include "Task.h"
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// One thread that resumes coroutines when a socket turns readable, a
+// deadline passes or another thread hands one over. A coroutine waiting on
+// a robot costs a frame and an epoll registration, not a thread, so one
+// reactor carries any number of outstanding robot requests. Everything a
+// coroutine does between awaits runs on this thread, state touched only
+// from coroutines needs no lock.
+class Reactor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    struct Waiter;
+
+public:
+    // where a coroutine parked by Park waits to be found by Wake
+    struct Parking {
+        Waiter* waiter = nullptr;
+    };
+
+private:
+    // one suspended coroutine, lives in the awaiting frame
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        int fd = -1;                        // -1 for a plain sleep
+        bool ready = false;                 // readable or woken, false when the deadline came first
+        bool timed = false;
+        std::multimap<Clock::time_point, Waiter*>::iterator deadline;
+        Parking* parked = nullptr;          // set while parked, so the deadline can clear it
+    };
+
+    int epollFd;
+    int wakeFd;
+    std::atomic<bool> running;
+    std::thread::id threadId;
+
+    // reactor thread only
+    std::unordered_map<int, Waiter*> readers;
+    std::multimap<Clock::time_point, Waiter*> deadlines;
+
+    std::vector<std::coroutine_handle<>> woken;     // by Wake, resumed on the next pass
+
+    std::mutex postLock;
+    std::vector<std::coroutine_handle<>> posted;
+    std::thread worker;
+
+    Reactor();
+    ~Reactor();
+
+    void run();
+    bool watch(Waiter& waiter, int timeoutMs);
+    void expire(Clock::time_point now, std::vector<std::coroutine_handle<>>& ready);
+
+    static Detached start(Reactor& reactor, Task<void> task);
+
+    template <typename T>
+    struct Completion {
+        std::mutex lock;
+        std::condition_variable done;
+        std::optional<T> value;
+        int error = 0;
+    };
+
+    template <typename T>
+    static Task<void> complete(Task<T> task, Completion<T>& completion) {
+        T value = co_await task;
+        int error = errno;
+        std::lock_guard<std::mutex> lk(completion.lock);
+        completion.value = std::move(value);
+        completion.error = error;
+        completion.done.notify_one();
+    }
+
+public:
+    static Reactor& Instance();
+
+    bool InReactor() const;
+    // resumes the coroutine from the reactor thread, any thread may call it
+    void Post(std::coroutine_handle<> handle);
+    // starts a task on the reactor thread and lets it run to its end
+    void Spawn(Task<void> task);
+
+    // Runs a task on the reactor and blocks the calling thread for its
+    // result, errno as the task left it. For the threads outside the
+    // reactor, from the reactor thread itself it would never return.
+    template <typename T>
+    T Run(Task<T> task) {
+        Completion<T> completion;
+        Spawn(complete(std::move(task), completion));
+        std::unique_lock<std::mutex> lk(completion.lock);
+        completion.done.wait(lk, [&] { return completion.value.has_value(); });
+        errno = completion.error;
+        return std::move(*completion.value);
+    }
+
+    // co_await Schedule() continues on the reactor thread, at once if already there
+    auto Schedule() {
+        struct Awaiter {
+            Reactor& reactor;
+            bool await_ready() const { return reactor.InReactor(); }
+            void await_suspend(std::coroutine_handle<> handle) { reactor.Post(handle); }
+            void await_resume() {}
+        };
+        return Awaiter{ *this };
+    }
+
+    // true once fd is readable, false after timeoutMs (< 0 waits for ever).
+    // Reactor thread only, one waiter per fd at a time.
+    auto Readable(int fd, int timeoutMs) {
+        struct Awaiter {
+            Reactor& reactor;
+            int timeoutMs;
+            Waiter waiter;
+            bool await_ready() const { return false; }
+            bool await_suspend(std::coroutine_handle<> handle) {
+                waiter.handle = handle;
+                return reactor.watch(waiter, timeoutMs);
+            }
+            bool await_resume() const { return waiter.ready; }
+        };
+        Awaiter awaiter{ *this, timeoutMs, {} };
+        awaiter.waiter.fd = fd;
+        return awaiter;
+    }
+
+    // True once Wake(parking) is called, false after timeoutMs (< 0 waits
+    // for ever). For a coroutine waiting on something another coroutine
+    // hands it, without a syscall either way. Reactor thread only, one
+    // waiter per Parking at a time.
+    auto Park(Parking& parking, int timeoutMs) {
+        struct Awaiter {
+            Reactor& reactor;
+            Parking& parking;
+            int timeoutMs;
+            Waiter waiter;
+            bool await_ready() const { return false; }
+            bool await_suspend(std::coroutine_handle<> handle) {
+                waiter.handle = handle;
+                waiter.parked = &parking;
+                parking.waiter = &waiter;
+                return reactor.watch(waiter, timeoutMs);
+            }
+            bool await_resume() const { return waiter.ready; }
+        };
+        return Awaiter{ *this, parking, timeoutMs, {} };
+    }
+
+    // resumes the coroutine parked there, if any, once the caller is back
+    // in the reactor loop. Reactor thread only
+    void Wake(Parking& parking);
+
+    // reactor thread only
+    auto Sleep(int ms) {
+        struct Awaiter {
+            Reactor& reactor;
+            int ms;
+            Waiter waiter;
+            bool await_ready() const { return ms <= 0; }
+            bool await_suspend(std::coroutine_handle<> handle) {
+                waiter.handle = handle;
+                return reactor.watch(waiter, ms);
+            }
+            void await_resume() const {}
+        };
+        return Awaiter{ *this, ms, {} };
+    }
+};
@@ -0,0 +1,1334 @@
+#include "crow_all.h"
+#include "PktDef.h"
+#include "TelemetryJson.h"
+#include "MissionScheduler.h"
+#include "MySocket.h"
+#include "BufferPool.h"
+#include "Trace.h"
+#include "FlightRecorder.h"
+#include "TelemetryHub.h"
+#include "CommandQueue.h"
+#include "TelemetryQuery.h"
+#include "SimRobot.h"
+#include "Impairment.h"
+#include "SendRing.h"
+#include "RobotSession.h"
+#include "Reactor.h"
+#include "FleetTable.h"
+#include "TelemetryLongPoll.h"
+#include "UdpMux.h"
+#include "FleetRelease.h"
+#include <sys/resource.h>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <deque>
+#include <climits>
+#include <condition_variable>
+#include <future>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// global allocation counter so each case can report allocs/op
+static atomic<unsigned long long> allocCount{ 0 };
+
+static void* countedAlloc(size_t size) {
+    allocCount.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+// Every form is replaced so new and delete always pair up, all out of
+// line: inlined, GCC sees one form's malloc or free meet another form and
+// warns (-Wmismatched-new-delete).
+__attribute__((noinline)) void* operator new(size_t size) { return countedAlloc(size); }
+__attribute__((noinline)) void* operator new[](size_t size) { return countedAlloc(size); }
+
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+__attribute__((noinline)) void operator delete[](void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// keeps the optimizer from discarding benchmark results
+static volatile size_t sink;
+
+template <typename F>
+void runCase(const string& name, long iterations, F&& body) {
+    for (long i = 0; i < iterations / 10; i++)   // warm up
+        body(i);
+
+    unsigned long long allocsBefore = allocCount.load();
+    auto start = chrono::steady_clock::now();
+    for (long i = 0; i < iterations; i++)
+        body(i);
+    auto end = chrono::steady_clock::now();
+    unsigned long long allocs = allocCount.load() - allocsBefore;
+
+    double ns = chrono::duration<double, nano>(end - start).count() / iterations;
+    printf("%-32s %10.1f ns/op %8.2f allocs/op\n", name.c_str(), ns, (double)allocs / iterations);
+}
+
+static telemetry sample(long i) {
+    telemetry t;
+    t.LastPktCounter = (uint8_t)i;
+    t.CurrentGrade = (uint8_t)(i * 7);
+    t.HitCount = (uint8_t)(i >> 3);
+    t.LastCmd = 1;
+    t.LastCmdValue = (uint8_t)(i * 13);
+    t.LastCmdSpeed = 80;
+    return t;
+}
+
+void benchTelemetryJson(long iterations) {
+    runCase("telemetry/wvalue", iterations, [](long i) {
+        telemetry t = sample(i);
+        crow::json::wvalue json;
+        json["LastPktCounter"] = t.LastPktCounter;
+        json["CurrentGrade"] = t.CurrentGrade;
+        json["HitCount"] = t.HitCount;
+        json["LastCmd"] = t.LastCmd;
+        json["LastCmdValue"] = t.LastCmdValue;
+        json["LastCmdSpeed"] = t.LastCmdSpeed;
+        sink = json.dump().size();
+    });
+
+    runCase("telemetry/writeTelemetryJson", iterations, [](long i) {
+        char out[TELEMETRY_JSON_MAX];
+        sink = writeTelemetryJson(sample(i), out);
+    });
+
+    runCase("telemetry/serialize+body", iterations, [](long i) {
+        string body(serializeTelemetry(sample(i)));
+        sink = body.size();
+    });
+}
+
+// one received frame handed to 4 consumers: owned copies vs shared pooled handles
+void benchBufferPool(long iterations) {
+    const int frameSize = 12;
+    const int consumers = 4;
+
+    runCase("buffer/heap copy per consumer", iterations, [&](long i) {
+        char* frame = new char[DEFAULT_SIZE];
+        frame[0] = (char)i;
+        vector<string> held;
+        held.reserve(consumers);
+        for (int c = 0; c < consumers; c++)
+            held.emplace_back(frame, frameSize + 20);   // past the small string buffer, like a capture record
+        sink = held.back().size();
+        delete[] frame;
+    });
+
+    size_t createdBefore = BufferPool::Instance().Created();
+    runCase("buffer/pooled shared handle", iterations, [&](long i) {
+        PacketBuffer frame = BufferPool::Instance().Acquire(DEFAULT_SIZE);
+        frame.Data()[0] = (char)i;
+        frame.SetSize(frameSize);
+        PacketBuffer held[consumers];
+        for (int c = 0; c < consumers; c++)
+            held[c] = frame;
+        sink = held[consumers - 1].Size();
+    });
+    printf("%-32s %10zu slabs created\n", "buffer/pool", BufferPool::Instance().Created() - createdBefore);
+}
+
+// cost of one span with no capture running and while recording
+void benchTrace(long iterations) {
+    runCase("trace/span idle", iterations, [](long i) {
+        TraceSpan span("bench");
+        sink = i;
+    });
+
+    Trace::Start();
+    runCase("trace/span recording", iterations, [](long i) {
+        TraceSpan span("bench");
+        sink = i;
+    });
+    Trace::Stop();
+}
+
+// cost of one flight recorder event, and of reading every ring back out
+void benchFlightRecorder(long iterations) {
+    const char frame[] = { 5, 0, 0x02, 5, 3 };
+    runCase("flight/packet", iterations, [&](long i) {
+        FlightRecorder::Packet(FlightKind::PACKET_SENT, 0, frame, sizeof(frame));
+        sink = i;
+    });
+    runCase("flight/http", iterations, [](long i) {
+        FlightRecorder::RecordText(FlightKind::HTTP, -1, 200, (uint32_t)i, "GET /telemetry_request", 22);
+    });
+
+    auto start = chrono::steady_clock::now();
+    size_t bytes = FlightRecorder::Export().size();
+    printf("%-32s %10.1f ms %8zu bytes\n", "flight/export",
+        chrono::duration<double, milli>(chrono::steady_clock::now() - start).count(), bytes);
+}
+
+// subscriber that keeps the latest sample, like a queue one deep
+struct LatestSample : TelemetrySubscriber {
+    PacketBuffer latest;
+    void Deliver(int, const telemetry&, const PacketBuffer& sample) override { latest = sample; }
+};
+
+// per-sample cost of reaching every subscriber: a wvalue and string each vs one shared encoding
+void benchFanout(long iterations) {
+    for (int subscribers : { 1, 10, 100, 1000 }) {
+        long samples = max(1000L, iterations / subscribers);
+
+        vector<string> copies(subscribers);
+        runCase("fanout/wvalue per subscriber x" + to_string(subscribers), samples, [&](long i) {
+            telemetry t = sample(i);
+            for (auto& copy : copies) {
+                crow::json::wvalue json;
+                json["LastPktCounter"] = t.LastPktCounter;
+                json["CurrentGrade"] = t.CurrentGrade;
+                json["HitCount"] = t.HitCount;
+                json["LastCmd"] = t.LastCmd;
+                json["LastCmdValue"] = t.LastCmdValue;
+                json["LastCmdSpeed"] = t.LastCmdSpeed;
+                copy = json.dump();
+            }
+        });
+
+        TelemetryHub hub;
+        vector<shared_ptr<LatestSample>> held;
+        for (int s = 0; s < subscribers; s++) {
+            held.push_back(make_shared<LatestSample>());
+            hub.Subscribe(0, held.back());
+        }
+        runCase("fanout/hub x" + to_string(subscribers), samples, [&](long i) {
+            hub.Publish(0, sample(i));
+        });
+    }
+}
+
+// stand-in for a session holding its robot's latest sample among everything else it owns
+struct SessionLike {
+    char other[192];
+    bool reporting;
+    telemetry latest;
+};
+
+// Fleet aggregates over 10000 robots: a pass over each session's sample
+// through its pointer against one over the SoA table's columns.
+void benchFleet(long iterations, int robots) {
+    mt19937 rng(7);
+    FleetTable table;
+    vector<unique_ptr<SessionLike>> sessions;
+    vector<unique_ptr<char[]>> gaps;        // other allocations between sessions, as in a running server
+    for (int r = 0; r < robots; r++) {
+        telemetry t = { (uint8_t)rng(), (uint8_t)rng(), (uint8_t)(rng() % 16), (uint8_t)(rng() % 2),
+                        (uint8_t)rng(), (uint8_t)rng() };
+        table.Update(table.Attach(r), t);
+        sessions.push_back(make_unique<SessionLike>());
+        sessions.back()->reporting = true;
+        sessions.back()->latest = t;
+        gaps.push_back(make_unique<char[]>(rng() % 512 + 64));
+    }
+    shuffle(sessions.begin(), sessions.end(), rng);
+
+    long passes = max(100L, iterations / 100);
+    FleetSummary fromSessions{};
+    runCase("fleet/sessions x" + to_string(robots), passes, [&](long) {
+        uint64_t reporting = 0, grade = 0, hits = 0, driving = 0;
+        uint8_t low = 255, high = 0;
+        for (auto& session : sessions) {
+            if (!session->reporting)
+                continue;
+            const telemetry& t = session->latest;
+            reporting++;
+            grade += t.CurrentGrade;
+            hits += t.HitCount;
+            driving += (t.LastCmd == (uint8_t)CMDType::DRIVE && (t.LastCmdValue != 0 || t.LastCmdSpeed != 0));
+            low = min(low, t.CurrentGrade);
+            high = max(high, t.CurrentGrade);
+        }
+        fromSessions.reporting = (uint32_t)reporting;
+        fromSessions.meanGrade = (double)grade / reporting;
+        fromSessions.totalHits = hits;
+        fromSessions.driving = (uint32_t)driving;
+        fromSessions.minGrade = low;
+        fromSessions.maxGrade = high;
+    });
+
+    FleetSummary fromTable{};
+    runCase("fleet/table x" + to_string(robots), passes, [&](long) {
+        fromTable = table.Summarize();
+    });
+    bool same = fromTable.reporting == fromSessions.reporting && fromTable.totalHits == fromSessions.totalHits &&
+                fromTable.driving == fromSessions.driving && fromTable.minGrade == fromSessions.minGrade &&
+                fromTable.maxGrade == fromSessions.maxGrade && fromTable.meanGrade == fromSessions.meanGrade;
+    printf("%-32s %s\n", "fleet/results", same ? "match" : "DIFFER");
+}
+
+// concurrent missions on one scheduler, dispatch lateness against each step deadline
+void benchMissions(int missionCount, int stepsPerMission) {
+    vector<long> lateUs;
+    mutex lateLock;
+    atomic<int> sent{ 0 };
+
+    {
+        mt19937 rng(42);
+        vector<vector<MissionStep>> plans(missionCount);
+        for (auto& plan : plans) {
+            long at = 0;
+            for (int i = 0; i < stepsPerMission; i++) {
+                at += 20 + rng() % 200;
+                plan.push_back({ CMDType::DRIVE, { FORWARD, 1, 50 }, chrono::milliseconds(at) });
+            }
+        }
+
+        // robot id carries the mission index so the callback can find its start time
+        vector<chrono::steady_clock::time_point> starts(missionCount);
+        MissionScheduler scheduler([&](int robot, const MissionStep& step) {
+            long late = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() -
+                (starts[robot] + step.at)).count();
+            lock_guard<mutex> lk(lateLock);
+            lateUs.push_back(late);
+            sent++;
+            return true;
+        });
+
+        for (int i = 0; i < missionCount; i++) {
+            auto delay = chrono::milliseconds(i % 50);
+            starts[i] = chrono::steady_clock::now() + delay;
+            scheduler.Start(i, plans[i], delay);
+        }
+
+        while (sent < missionCount * stepsPerMission)
+            this_thread::sleep_for(chrono::milliseconds(10));
+    }
+
+    sort(lateUs.begin(), lateUs.end());
+    printf("missions/%d x %d steps          p50 %ld us  p99 %ld us  max %ld us\n", missionCount, stepsPerMission,
+        lateUs[lateUs.size() / 2], lateUs[lateUs.size() * 99 / 100], lateUs.back());
+}
+
+// loopback peer that bounces every datagram back to its sender
+class EchoPeer {
+    int sock;
+    atomic<bool> running{ true };
+    thread worker;
+
+public:
+    EchoPeer(int port) {
+        sock = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        bind(sock, (sockaddr*)&addr, sizeof(addr));
+
+        timeval timeout{ 0, 100000 };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        worker = thread([this] {
+            char buffer[DEFAULT_SIZE];
+            while (running) {
+                sockaddr_in from{};
+                socklen_t len = sizeof(from);
+                int bytes = recvfrom(sock, buffer, sizeof(buffer), 0, (sockaddr*)&from, &len);
+                if (bytes > 0)
+                    sendto(sock, buffer, bytes, 0, (sockaddr*)&from, len);
+            }
+        });
+    }
+
+    ~EchoPeer() {
+        running = false;
+        worker.join();
+        close(sock);
+    }
+};
+
+// Offers twice what the link takes for two seconds and reports how long
+// sent commands waited, with the delay controller and with it held off.
+void benchCommandQueue() {
+    for (int targetMs : { 20, 60000 }) {
+        CommandLimits limits;
+        limits.depth = 100000;
+        limits.ratePerSec = 500;
+        limits.targetMs = targetMs;
+
+        mutex waitLock;
+        vector<long> waitUs;
+        CommandQueue queue([&](Command& command) {
+            long waited = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - command.queued).count();
+            lock_guard<mutex> lk(waitLock);
+            waitUs.push_back(waited);
+        }, limits);
+
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < 2000; i++) {
+            this_thread::sleep_until(start + chrono::microseconds(i * 1000));
+            vector<Command> batch(1);
+            int retryAfter;
+            queue.Push(batch, retryAfter);
+        }
+
+        CommandQueueStats stats = queue.Stats();
+        lock_guard<mutex> lk(waitLock);
+        sort(waitUs.begin(), waitUs.end());
+        printf("commands/target %-5d ms        sent %llu  shed %llu  p50 %ld us  p99 %ld us\n", targetMs,
+            (unsigned long long)stats.sent, (unsigned long long)stats.shed,
+            waitUs[waitUs.size() / 2], waitUs[waitUs.size() * 99 / 100]);
+    }
+}
+
+// a day of 100 ms samples with poll jitter: append, bytes on disk, full scan, one minute seek
+void benchStore() {
+    char dir[] = "/tmp/robotbench-XXXXXX";
+    if (!mkdtemp(dir))
+        return;
+
+    const long samples = 864000;
+    const int64_t start = 1700000000000;
+    mt19937 rng(7);
+    vector<int64_t> times(samples);
+    for (long i = 0; i < samples; i++)
+        times[i] = start + i * 100 + (long)(rng() % 5);
+
+    atomic<int> flushMs{ 5000 };
+    {
+        TelemetryStore store(dir, flushMs);
+        runCase("store/append", samples, [&](long i) {
+            telemetry t = sample(i / 50);     // status changes every few seconds
+            t.LastPktCounter = (uint8_t)i;
+            store.Append(0, t, times[i % samples]);
+        });
+        store.Flush();
+        printf("store/on disk                    %10.2f bytes/sample (%zu raw)\n",
+            (double)store.BytesWritten() / store.SamplesWritten(), sizeof(int64_t) + sizeof(telemetry));
+    }
+
+    TelemetryReader reader(dir, 0);
+    runCase("store/scan max grade", 10, [&](long) {
+        uint8_t best = 0;
+        size_t seen = reader.Scan(INT64_MIN, INT64_MAX, [&](const TelemetryColumns& c) {
+            const uint8_t* grade = c.fields[1].data();
+            for (size_t i = 0; i < c.count; i++)
+                best = max(best, grade[i]);
+            return true;
+        });
+        sink = best + seen;
+    });
+
+    runCase("store/query grade per minute", 10, [&](long) {
+        TelemetryQuery query;
+        string error, out;
+        query.Parse("increased(HitCount)", "max(CurrentGrade)", "1m", error);
+        sink = query.Run(reader, TelemetryQuery::Format::CSV, out);
+    });
+
+    int64_t from = start + 12 * 3600000;
+    runCase("store/seek one minute", 1000, [&](long) {
+        sink = reader.Scan(from, from + 60000, [](const TelemetryColumns&) { return true; });
+    });
+
+    for (int seq : TelemetryStore::Segments(dir, 0))
+        unlink(TelemetryStore::SegmentPath(dir, 0, seq).c_str());
+    rmdir(dir);
+}
+
+// Status exchanges with the simulated robot through an impaired link, retried
+// up to 3 times on a 30 ms timeout. A reply whose count is not the request's
+// is a late or duplicated one that would be taken for the current answer.
+// The same seed gives the same link decisions on every run.
+void benchImpairedLink(int exchanges) {
+    ImpairmentProfile profile;
+    string error;
+    parseImpairment("loss=0.05,dup=0.02,reorder=0.02,corrupt=0.01,delay=2,jitter=10", profile, error);
+
+    SimRobot robot(9600);
+    ImpairmentProxy proxy(9601, "127.0.0.1", 9600, profile, profile, 42);
+    MySocket link(SocketType::CLIENT, "127.0.0.1", 9601, ConnectionType::UDP, DEFAULT_SIZE);
+
+    long matched = 0, stale = 0, corrupt = 0, retries = 0, failed = 0;
+    vector<long> latencyUs;
+    char reply[DEFAULT_SIZE];
+    for (int i = 1; i <= exchanges; i++) {
+        auto start = chrono::steady_clock::now();
+        bool done = false;
+        for (int attempt = 0; attempt < 3 && !done; attempt++) {
+            if (attempt)
+                retries++;
+            PktDef request;
+            request.setPktCount((unsigned short)i);
+            request.setCMD(CMDType::RESPONSE);
+            unsigned short sent = request.getPktCount();
+            link.SendData((char*)request.genPacket(), request.getLength());
+
+            // keep reading until this request's reply or the timeout
+            auto deadline = chrono::steady_clock::now() + chrono::milliseconds(30);
+            while (!done) {
+                int left = (int)chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+                if (left <= 0 || !link.WaitForData(left))
+                    break;
+                int size = link.GetData(reply);
+                PktDef pkt;
+                if (size < MINFRAMESIZE || !pkt.checkCRC((unsigned char*)reply, size)) {
+                    corrupt++;
+                    continue;
+                }
+                PktDef parsed((unsigned char*)reply);
+                if (parsed.getPktCount() != sent) {
+                    stale++;
+                    continue;
+                }
+                matched++;
+                done = true;
+            }
+        }
+        if (!done)
+            failed++;
+        else
+            latencyUs.push_back(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count());
+    }
+
+    sort(latencyUs.begin(), latencyUs.end());
+    ImpairmentStats up = proxy.UpStats(), down = proxy.DownStats();
+    printf("impaired/%d exchanges             ok %ld failed %ld retries %ld stale %ld corrupt %ld  p50 %ld us  p99 %ld us\n",
+        exchanges, matched, failed, retries, stale, corrupt,
+        latencyUs.empty() ? 0 : latencyUs[latencyUs.size() / 2], latencyUs.empty() ? 0 : latencyUs[latencyUs.size() * 99 / 100]);
+    printf("impaired/link                    up lost %llu dup %llu corrupt %llu, down lost %llu dup %llu corrupt %llu\n",
+        (unsigned long long)up.lost, (unsigned long long)up.duplicated, (unsigned long long)up.corrupted,
+        (unsigned long long)down.lost, (unsigned long long)down.duplicated, (unsigned long long)down.corrupted);
+}
+
+// Loopback sink that checks the order of PktCount values and how long each
+// frame took from the handler's send call to arrival (stamped in the body).
+class OrderSink {
+    int sock;
+    thread worker;
+
+public:
+    long received = 0;
+    long inversions = 0;                    // count lower than the one before it
+    vector<long> latencyNs;
+    chrono::steady_clock::time_point lastArrival;
+
+    OrderSink(int port, long expected) {
+        sock = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        bind(sock, (sockaddr*)&addr, sizeof(addr));
+
+        int bytes = 8 << 20;
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+        timeval timeout{ 0, 200000 };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        latencyNs.reserve(expected);
+        worker = thread([this, expected] {
+            unsigned char frame[DEFAULT_SIZE];
+            uint16_t last = 0;
+            while (received < expected) {
+                int size = recv(sock, frame, sizeof(frame), 0);
+                if (size <= 0)
+                    break;
+                lastArrival = chrono::steady_clock::now();
+                long long sentNs;
+                memcpy(&sentNs, frame + HEADERSIZE, sizeof(sentNs));
+                latencyNs.push_back((long)(lastArrival.time_since_epoch().count() - sentNs));
+                uint16_t count;
+                memcpy(&count, frame, sizeof(count));
+                if (received++ > 0 && (uint16_t)(count - last) > 0x8000)
+                    inversions++;
+                last = count;
+            }
+        });
+    }
+
+    void Wait() {
+        worker.join();
+    }
+
+    ~OrderSink() {
+        if (worker.joinable())
+            worker.join();
+        close(sock);
+    }
+};
+
+// Handler threads sending status frames to one robot socket, each frame
+// counted and encoded in the handler and sent straight to the socket, or
+// pushed into the session's SendRing. Reports throughput, frames that
+// reached the wire behind a lower count, and the p50/p99 from the send
+// call to arrival.
+void benchSendRing(int producers, int perProducer) {
+    const int port = 5902;
+    for (bool ring : { false, true }) {
+        long total = (long)producers * perProducer;
+        OrderSink sink(port, total);
+        MySocket sock(SocketType::CLIENT, "127.0.0.1", port, ConnectionType::UDP, DEFAULT_SIZE);
+        sock.SetBufferSize(8 << 20);
+        unique_ptr<SendRing> writer;
+        if (ring)
+            writer = make_unique<SendRing>(sock);
+        atomic<int> packetCount{ 0 };
+        atomic<long> refused{ 0 };
+
+        auto start = chrono::steady_clock::now();
+        vector<thread> handlers;
+        for (int p = 0; p < producers; p++) {
+            handlers.emplace_back([&] {
+                for (int i = 0; i < perProducer; i++) {
+                    // drive frame with the send time as its body, encoded by hand
+                    // because genPacket logs every CRC to stdout
+                    PacketBuffer frame = BufferPool::Instance().Acquire(MINFRAMESIZE + 8);
+                    unsigned char* bytes = (unsigned char*)frame.Data();
+                    uint16_t count = ring ? 0 : (uint16_t)++packetCount;
+                    long long now = chrono::steady_clock::now().time_since_epoch().count();
+                    memcpy(bytes, &count, sizeof(count));
+                    bytes[2] = 0x01;
+                    bytes[LENGTHOFFSET] = MINFRAMESIZE + 8;
+                    memcpy(bytes + HEADERSIZE, &now, sizeof(now));
+                    unsigned char crc = 0;
+                    for (int b = 0; b < HEADERSIZE + 8; b++)
+                        crc += (unsigned char)popcount(bytes[b]);
+                    bytes[HEADERSIZE + 8] = crc;
+                    frame.SetSize(MINFRAMESIZE + 8);
+                    if (!ring) {
+                        sock.SendData(frame.Data(), frame.Size());
+                        continue;
+                    }
+                    // a full ring is backpressure, try again like the command queue would
+                    while (!writer->Push(frame, true)) {
+                        refused++;
+                        this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (auto& handler : handlers)
+            handler.join();
+        double sending = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        sink.Wait();
+        double seconds = chrono::duration<double>(sink.lastArrival - start).count();
+
+        sort(sink.latencyNs.begin(), sink.latencyNs.end());
+        size_t n = sink.latencyNs.size();
+        printf("send/%-6s %d handlers          sent %7.0f/s  delivered %7.0f/s  lost %ld  out of order %ld  p50 %ld us  p99 %ld us  full %ld\n",
+            ring ? "ring" : "direct", producers, total / sending, sink.received / seconds, total - sink.received, sink.inversions,
+            n ? sink.latencyNs[n / 2] / 1000 : 0, n ? sink.latencyNs[n * 99 / 100] / 1000 : 0, refused.load());
+    }
+}
+
+// loopback peer that returns every datagram to its sender delayMs later, a robot on a slow link
+class DelayPeer {
+    int sock;
+    int delayMs;
+    atomic<bool> running{ true };
+    thread worker;
+
+    struct Held {
+        chrono::steady_clock::time_point due;
+        sockaddr_in from;
+        string bytes;
+    };
+
+public:
+    DelayPeer(int port, int delayMs) : delayMs(delayMs) {
+        sock = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        bind(sock, (sockaddr*)&addr, sizeof(addr));
+        int bytes = 8 << 20;
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+
+        worker = thread([this] {
+            deque<Held> held;
+            char buffer[DEFAULT_SIZE];
+            while (running) {
+                auto now = chrono::steady_clock::now();
+                while (!held.empty() && held.front().due <= now) {
+                    Held& next = held.front();
+                    sendto(sock, next.bytes.data(), next.bytes.size(), 0, (sockaddr*)&next.from, sizeof(next.from));
+                    held.pop_front();
+                }
+                int timeout = held.empty() ? 100 :
+                    (int)chrono::ceil<chrono::milliseconds>(held.front().due - now).count();
+                pollfd fd = { sock, POLLIN, 0 };
+                if (poll(&fd, 1, timeout) <= 0)
+                    continue;
+                while (true) {
+                    Held entry;
+                    socklen_t len = sizeof(entry.from);
+                    int size = recvfrom(sock, buffer, sizeof(buffer), MSG_DONTWAIT, (sockaddr*)&entry.from, &len);
+                    if (size <= 0)
+                        break;
+                    entry.due = chrono::steady_clock::now() + chrono::milliseconds(this->delayMs);
+                    entry.bytes.assign(buffer, size);
+                    held.push_back(move(entry));
+                }
+            }
+        });
+    }
+
+    ~DelayPeer() {
+        running = false;
+        worker.join();
+        close(sock);
+    }
+};
+
+static Task<void> timedExchange(RobotSession& session, vector<long>& latencyUs, int& ok) {
+    auto start = chrono::steady_clock::now();
+    PacketBuffer reply;
+    if (co_await session.Telemetry(reply, 1000) > 0)
+        ok++;
+    latencyUs.push_back(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count());
+}
+
+static Task<int> exchangeAll(vector<shared_ptr<RobotSession>>& sessions, vector<long>& latencyUs) {
+    int ok = 0;
+    TaskGroup group;
+    for (auto& session : sessions)
+        group.Spawn(timedExchange(*session, latencyUs, ok));
+    co_await group.Wait();
+    co_return ok;
+}
+
+// Status exchanges with robots that answer 5 ms late: one at a time
+// from a blocking caller, then every robot's exchange in flight together as
+// coroutines on the one reactor thread.
+void benchReactor(int robots) {
+    const int port = 5903;
+    DelayPeer peer(port, 5);
+    CommandLimits limits;
+    vector<shared_ptr<RobotSession>> sessions;
+    for (int i = 0; i < robots; i++)
+        sessions.push_back(make_shared<RobotSession>(i, "127.0.0.1", port, limits));
+
+    const int sequential = 50;
+    auto start = chrono::steady_clock::now();
+    int ok = 0;
+    for (int i = 0; i < sequential; i++) {
+        PacketBuffer reply;
+        if (sessions[i]->RequestTelemetry(reply, 1000) > 0)
+            ok++;
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    printf("reactor/blocking %d robots        ok %d  round %8.1f ms  (%.2f ms/robot)\n", sequential, ok, ms, ms / sequential);
+
+    for (int round = 0; round < 2; round++) {
+        vector<long> latencyUs;
+        latencyUs.reserve(robots);
+        start = chrono::steady_clock::now();
+        ok = Reactor::Instance().Run(exchangeAll(sessions, latencyUs));
+        ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        sort(latencyUs.begin(), latencyUs.end());
+        printf("reactor/coroutines %d robots    ok %d  round %8.1f ms  p50 %ld us  p99 %ld us\n", robots, ok, ms,
+            latencyUs[latencyUs.size() / 2], latencyUs[latencyUs.size() * 99 / 100]);
+    }
+}
+
+// Client threads asking one robot for telemetry as fast as replies come,
+// the robot answering 5 ms late. Every call made while an exchange is out
+// joins it, so the robot sees about one request per round trip.
+void benchCoalescing(int clients) {
+    const int port = 5904;
+    DelayPeer peer(port, 5);
+    CommandLimits limits;
+    RobotSession session(0, "127.0.0.1", port, limits);
+
+    mutex latencyLock;
+    vector<long> latencyUs;
+    atomic<long> ok{ 0 };
+    auto stop = chrono::steady_clock::now() + chrono::seconds(1);
+    vector<thread> threads;
+    for (int c = 0; c < clients; c++) {
+        threads.emplace_back([&] {
+            vector<long> mine;
+            while (chrono::steady_clock::now() < stop) {
+                auto start = chrono::steady_clock::now();
+                PacketBuffer reply;
+                if (session.RequestTelemetry(reply, 1000) > 0)
+                    ok++;
+                mine.push_back(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count());
+            }
+            lock_guard<mutex> lk(latencyLock);
+            latencyUs.insert(latencyUs.end(), mine.begin(), mine.end());
+        });
+    }
+    for (auto& t : threads)
+        t.join();
+
+    TelemetryStats stats = session.GetTelemetryStats();
+    sort(latencyUs.begin(), latencyUs.end());
+    printf("coalesce/%d clients              requests %llu  exchanges %llu  ratio %.1f  ok %ld  p50 %ld us  p99 %ld us\n",
+        clients, (unsigned long long)stats.requests, (unsigned long long)stats.exchanges,
+        stats.exchanges ? (double)stats.requests / stats.exchanges : 0.0, ok.load(),
+        latencyUs[latencyUs.size() / 2], latencyUs[latencyUs.size() * 99 / 100]);
+}
+
+// A robot sampled every 10 ms whose telemetry changes every 50 ms, watched
+// for 2 s by a client polling every 100 ms and by one long-polling with
+// ?after=. Requests made and how long after a change the client saw it.
+void benchLongPoll() {
+    TelemetryHub hub;
+    auto longPoll = make_shared<TelemetryLongPoll>(hub);
+    atomic<int> counter{ 0 };
+    atomic<long long> changedAt{ 0 };
+    atomic<bool> running{ true };
+    auto nowUs = [] {
+        return (long long)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    };
+
+    thread poller([&] {
+        for (int tick = 1; running; tick++) {
+            if (tick % 5 == 0) {
+                changedAt = nowUs();
+                counter++;
+            }
+            telemetry t = sample(0);
+            t.LastPktCounter = (unsigned char)counter.load();
+            hub.Publish(0, t);
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+    });
+
+    auto report = [](const char* name, long requests, vector<long>& staleUs) {
+        sort(staleUs.begin(), staleUs.end());
+        printf("longpoll/%-24s requests %ld  changes seen %zu  stale p50 %ld us  p99 %ld us\n", name, requests,
+            staleUs.size(), staleUs.empty() ? 0 : staleUs[staleUs.size() / 2],
+            staleUs.empty() ? 0 : staleUs[staleUs.size() * 99 / 100]);
+    };
+    auto stop = chrono::steady_clock::now() + chrono::seconds(2);
+
+    long requests = 0;
+    vector<long> staleUs;
+    for (int seen = counter; chrono::steady_clock::now() < stop; requests++) {
+        if (counter != seen) {
+            seen = counter;
+            staleUs.push_back((long)(nowUs() - changedAt));
+        }
+        this_thread::sleep_for(chrono::milliseconds(100));
+    }
+    report("poll every 100 ms", requests, staleUs);
+
+    stop = chrono::steady_clock::now() + chrono::seconds(2);
+    requests = 0;
+    staleUs.clear();
+    mutex doneLock;
+    condition_variable answered;
+    for (uint8_t seen = (uint8_t)counter.load(); chrono::steady_clock::now() < stop; requests++) {
+        bool done = false;
+        int got = -1;
+        longPoll->Park(0, seen, chrono::milliseconds(1000), [&](const PacketBuffer* s) {
+            lock_guard<mutex> lk(doneLock);
+            if (s)
+                got = counter.load();
+            done = true;
+            answered.notify_one();
+        });
+        unique_lock<mutex> lk(doneLock);
+        answered.wait(lk, [&] { return done; });
+        if (got >= 0 && (uint8_t)got != seen) {
+            seen = (uint8_t)got;
+            staleUs.push_back((long)(nowUs() - changedAt));
+        }
+    }
+    report("after= long-poll", requests, staleUs);
+
+    running = false;
+    poller.join();
+}
+
+static double threadCpuUs() {
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec * 1e6 + usage.ru_utime.tv_usec + usage.ru_stime.tv_sec * 1e6 + usage.ru_stime.tv_usec;
+}
+
+// round trips through MySocket, batch > 1 queues that many sends before one Flush
+void benchSocket(const string& name, SocketBackend backend, int batch, long roundTrips) {
+    const int port = 5901;
+    EchoPeer peer(port);
+    MySocket sock(SocketType::CLIENT, "127.0.0.1", port, ConnectionType::UDP, DEFAULT_SIZE);
+    if (!sock.SetBackend(backend)) {
+        printf("%-32s unavailable\n", name.c_str());
+        return;
+    }
+
+    char frame[16] = { 0 };
+    char reply[DEFAULT_SIZE];
+    SocketStats before = sock.GetStats();
+    double cpuBefore = threadCpuUs();
+    auto start = chrono::steady_clock::now();
+
+    for (long i = 0; i < roundTrips; i += batch) {
+        for (int b = 0; b < batch; b++)
+            sock.QueueData(frame, sizeof(frame));
+        sock.Flush();
+        for (int b = 0; b < batch; b++)
+            sock.GetData(reply);
+    }
+
+    auto end = chrono::steady_clock::now();
+    double cpu = threadCpuUs() - cpuBefore;
+    SocketStats after = sock.GetStats();
+    double packets = (double)(after.sent - before.sent + after.received - before.received);
+
+    printf("%-32s %10.1f ns/rtt %6.2f syscalls/pkt %6.2f cpu us/pkt\n", name.c_str(),
+        chrono::duration<double, nano>(end - start).count() / roundTrips,
+        (after.syscalls - before.syscalls) / packets, cpu / packets);
+}
+
+// Round trip latency to a loopback echo peer, reader blocking in recvfrom
+// against spinning up to spinUs first, from a thread pinned to one cpu.
+// With fewer cores than spinning threads the spin only steals the echo's
+// cpu, so the result depends on the machine more than most cases here.
+void benchBusyPoll(long roundTrips, int spinUs) {
+    const int port = 5906;
+    EchoPeer peer(port);
+
+    cpu_set_t previous, pinned;
+    pthread_getaffinity_np(pthread_self(), sizeof(previous), &previous);
+    CPU_ZERO(&pinned);
+    CPU_SET(sched_getcpu(), &pinned);
+    pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned);
+
+    for (int spin : { 0, spinUs }) {
+        MySocket sock(SocketType::CLIENT, "127.0.0.1", port, ConnectionType::UDP, DEFAULT_SIZE);
+        sock.SetBusyPoll(spin);
+        char frame[16] = { 0 };
+        char reply[DEFAULT_SIZE];
+        vector<long> rttNs;
+        rttNs.reserve(roundTrips);
+        double cpuBefore = threadCpuUs();
+        for (long i = 0; i < roundTrips; i++) {
+            auto start = chrono::steady_clock::now();
+            sock.SendData(frame, sizeof(frame));
+            sock.GetData(reply);
+            rttNs.push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+        }
+        double cpu = threadCpuUs() - cpuBefore;
+
+        sort(rttNs.begin(), rttNs.end());
+        string name = spin ? "busypoll/spin " + to_string(spin) + " us" : "busypoll/blocking";
+        printf("%-32s p50 %8ld ns  p99 %8ld ns  %6.2f cpu us/rtt\n", name.c_str(),
+            rttNs[rttNs.size() / 2], rttNs[rttNs.size() * 99 / 100], cpu / roundTrips);
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(previous), &previous);
+}
+
+// The robot's port sends one good frame for every four bad datagrams: a
+// good frame from a stranger, a short one, one whose length byte lies and
+// one with no command flag. Reports what reached user space and the reader's
+// CPU time per good frame, with and without the kernel packet filter.
+void benchPacketFilter(int rounds) {
+    auto udpSocket = [](int port) {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        bind(fd, (sockaddr*)&addr, sizeof(addr));
+        return fd;
+    };
+    const int port = 5905;
+    int robot = udpSocket(port);
+    int stranger = udpSocket(0);
+
+    const char good[] = { 1, 0, 0x02, 5, 4 };
+    const char shortFrame[] = { 1, 0, 0x02 };
+    const char badLength[] = { 1, 0, 0x02, 9, 4 };
+    const char noFlags[] = { 1, 0, 0x00, 5, 3 };
+
+    for (bool filter : { false, true }) {
+        MySocket sock(SocketType::CLIENT, "127.0.0.1", port, ConnectionType::UDP, DEFAULT_SIZE);
+        sock.SetPacketFilter(filter);
+        sock.SendData(good, sizeof(good));      // binds the client's port
+        sockaddr_in self{};
+        socklen_t len = sizeof(self);
+        getsockname(sock.GetHandle(), (sockaddr*)&self, &len);
+        char drain[64];
+        recv(robot, drain, sizeof(drain), 0);
+
+        auto to = [&](int fd, const char* data, size_t size) {
+            sendto(fd, data, size, 0, (sockaddr*)&self, sizeof(self));
+        };
+        long delivered = 0, frames = 0;
+        double cpu = 0;
+        SocketStats before = sock.GetStats();
+        for (int r = 0; r < rounds; r += 20) {
+            // in small bursts, so the receive buffer never overflows and counts as a drop
+            for (int i = 0; i < 20; i++) {
+                to(stranger, good, sizeof(good));
+                to(robot, shortFrame, sizeof(shortFrame));
+                to(robot, badLength, sizeof(badLength));
+                to(robot, noFlags, sizeof(noFlags));
+                to(robot, good, sizeof(good));
+            }
+            double start = threadCpuUs();
+            PacketBuffer frame;
+            int size;
+            while ((size = sock.TryGetData(frame)) > 0) {
+                // the checks a reader does without the filter, a stranger's frame still passes them
+                unsigned char* bytes = (unsigned char*)frame.Data();
+                PktDef pkt;
+                delivered++;
+                if (size >= MINFRAMESIZE && bytes[LENGTHOFFSET] == size && (bytes[2] & 0x0F) &&
+                    pkt.checkCRC(bytes, size))
+                    frames++;
+            }
+            cpu += threadCpuUs() - start;
+        }
+        SocketStats after = sock.GetStats();
+        printf("filter/%-25s delivered %ld  passed checks %ld  kernel drops %llu  %.2f cpu us/good frame\n",
+            filter ? "bpf" : "none", delivered, frames, after.dropped - before.dropped, cpu / rounds);
+    }
+    close(robot);
+    close(stranger);
+}
+
+// one robot's share of the datagrams, through the mux or off a socket of its own
+static Task<void> drainEndpoint(UdpMux& mux, UdpMux::Endpoint& endpoint, int expected, atomic<long>& got) {
+    PacketBuffer datagram;
+    for (int i = 0; i < expected; i++) {
+        if (co_await mux.Receive(endpoint, datagram, 2000) <= 0)
+            break;
+        got.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+static Task<void> drainSocket(MySocket& socket, int expected, atomic<long>& got) {
+    Reactor& reactor = Reactor::Instance();
+    PacketBuffer datagram;
+    int count = 0;
+    while (count < expected && co_await reactor.Readable(socket.GetHandle(), 2000)) {
+        while (count < expected && socket.TryGetData(datagram) > 0) {
+            count++;
+            got.fetch_add(1, memory_order_relaxed);
+        }
+    }
+}
+
+static Task<int> drainAll(vector<Task<void>>& drains) {
+    TaskGroup group;
+    for (auto& drain : drains)
+        group.Spawn(std::move(drain));
+    co_await group.Wait();
+    co_return 0;
+}
+
+// Receive side of a fleet: the source lookup alone, DemuxTable against
+// unordered_map over every robot's key in random order, then every robot
+// sent one frame per round, received once on a socket per robot (a reactor
+// wake and a recv each) and once through one shared UdpMux socket (recvmmsg
+// batches, a table lookup each).
+void benchDemux(long iterations, int robots) {
+    mt19937 rng(11);
+    vector<uint64_t> keys;
+    DemuxTable<uint32_t> table;
+    unordered_map<uint64_t, uint32_t> map;
+    for (int r = 0; r < robots; r++) {
+        sockaddr_in addr{};
+        addr.sin_addr.s_addr = htonl(0x7F000000 | (rng() & 0xFFFFFF));
+        addr.sin_port = htons(1024 + rng() % 60000);
+        keys.push_back(UdpMux::Source(addr));
+        table.Insert(keys.back(), r + 1);
+        map[keys.back()] = r + 1;
+    }
+    vector<uint32_t> order(iterations);
+    for (auto& index : order)
+        index = rng() % robots;
+
+    runCase("demux/unordered_map x" + to_string(robots), iterations, [&](long i) {
+        sink = map.find(keys[order[i]])->second;
+    });
+    runCase("demux/table x" + to_string(robots), iterations, [&](long i) {
+        sink = table.Find(keys[order[i]]);
+    });
+
+    auto udpSocket = [](const string& ip) {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
+        bind(fd, (sockaddr*)&addr, sizeof(addr));
+        return fd;
+    };
+    auto address = [](int fd) {
+        sockaddr_in addr{};
+        socklen_t len = sizeof(addr);
+        getsockname(fd, (sockaddr*)&addr, &len);
+        return addr;
+    };
+    const char good[] = { 1, 0, 0x02, 5, 4 };
+    const int rounds = 10;
+    const long window = 128;        // in flight at most, so no receive buffer overflows
+
+    // the senders go round the fleet, waiting whenever the receive side falls behind
+    auto send = [&](const vector<int>& from, const vector<sockaddr_in>& to, atomic<long>& got) {
+        this_thread::sleep_for(chrono::milliseconds(50));
+        long sent = 0;
+        for (int round = 0; round < rounds; round++) {
+            for (int r = 0; r < robots; r++) {
+                while (sent - got.load(memory_order_relaxed) >= window)
+                    this_thread::yield();
+                sendto(from[r], good, sizeof(good), 0, (const sockaddr*)&to[r], sizeof(to[r]));
+                sent++;
+            }
+        }
+    };
+    auto report = [&](const string& name, long got, chrono::steady_clock::duration took, const string& extra) {
+        double ns = chrono::duration<double, nano>(took).count() / max(got, 1L);
+        printf("%-32s %10.1f ns/packet  received %ld of %ld%s\n", name.c_str(), ns, got, (long)rounds * robots,
+            extra.c_str());
+    };
+
+    // a socket per robot, all sent to from a hundred peers
+    {
+        const int peers = 100;
+        vector<int> senders;
+        for (int p = 0; p < peers; p++)
+            senders.push_back(udpSocket("127.0.2." + to_string(p + 1)));
+        vector<unique_ptr<MySocket>> sockets;
+        vector<int> from;
+        vector<sockaddr_in> to;
+        for (int r = 0; r < robots; r++) {
+            int peer = r % peers;
+            sockaddr_in peerAddr = address(senders[peer]);
+            sockets.push_back(make_unique<MySocket>(SocketType::CLIENT, "127.0.2." + to_string(peer + 1),
+                ntohs(peerAddr.sin_port), ConnectionType::UDP, DEFAULT_SIZE));
+            sockets.back()->SetPacketFilter(true);
+            sockets.back()->SendData(good, sizeof(good));   // binds its port
+            from.push_back(senders[peer]);
+            to.push_back(address(sockets.back()->GetHandle()));
+            to.back().sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        }
+        char drain[64];
+        for (int fd : senders)
+            while (recv(fd, drain, sizeof(drain), MSG_DONTWAIT) > 0)
+                ;
+
+        atomic<long> got{ 0 };
+        vector<Task<void>> drains;
+        for (auto& socket : sockets)
+            drains.push_back(drainSocket(*socket, rounds, got));
+        auto start = chrono::steady_clock::now();
+        thread sender(send, cref(from), cref(to), ref(got));
+        Reactor::Instance().Run(drainAll(drains));
+        auto took = chrono::steady_clock::now() - start - chrono::milliseconds(50);
+        sender.join();
+        report("demux/socket per robot x" + to_string(robots), got, took, "");
+        for (int fd : senders)
+            close(fd);
+    }
+
+    // one shared socket, every robot sending from an address and port of its own
+    {
+        auto mux = make_shared<UdpMux>(1);
+        mux->Start();
+        sockaddr_in muxAddr{};
+        muxAddr.sin_family = AF_INET;
+        muxAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        muxAddr.sin_port = htons(mux->GetPort());
+
+        vector<int> from;
+        vector<UdpMux::Endpoint*> endpoints;
+        for (int r = 0; r < robots; r++) {
+            string ip = "127.1." + to_string(r / 250) + "." + to_string(r % 250 + 1);
+            from.push_back(udpSocket(ip));
+            endpoints.push_back(mux->Attach(ip, ntohs(address(from.back()).sin_port)));
+        }
+        vector<sockaddr_in> to(robots, muxAddr);
+
+        atomic<long> got{ 0 };
+        vector<Task<void>> drains;
+        for (auto* endpoint : endpoints)
+            drains.push_back(drainEndpoint(*mux, *endpoint, rounds, got));
+        auto start = chrono::steady_clock::now();
+        thread sender(send, cref(from), cref(to), ref(got));
+        Reactor::Instance().Run(drainAll(drains));
+        auto took = chrono::steady_clock::now() - start - chrono::milliseconds(50);
+        sender.join();
+
+        UdpMuxStats stats = mux->Stats();
+        report("demux/shared socket x" + to_string(robots), got, took,
+            "  " + to_string((double)stats.received / max<uint64_t>(stats.batches, 1)).substr(0, 4) + " per recvmmsg" +
+            "  unknown " + to_string(stats.unknown) + "  dropped " + to_string(stats.dropped));
+
+        for (int r = 0; r < robots; r++) {
+            sockaddr_in addr = address(from[r]);
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+            mux->Detach(ip, ntohs(addr.sin_port), endpoints[r]);
+            close(from[r]);
+        }
+        mux->Stop();
+    }
+}
+
+// kernel receive times at the sink, realtime ns, sorted
+static vector<int64_t> arrivals(int fd, int expected) {
+    vector<int64_t> times;
+    char data[64];
+    char control[128];
+    while ((int)times.size() < expected) {
+        pollfd p = { fd, POLLIN, 0 };
+        if (poll(&p, 1, 1000) <= 0)
+            break;
+        iovec vector = { data, sizeof(data) };
+        msghdr msg{};
+        msg.msg_iov = &vector;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_DONTWAIT) < 0)
+            continue;
+        for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+                timespec ts;
+                memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                times.push_back((int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+            }
+        }
+    }
+    sort(times.begin(), times.end());
+    return times;
+}
+
+// One drive command to every robot of a fleet, arrival times taken by the
+// kernel at a sink all the robots share: issued robot by robot through
+// each session's writer as /telecommand does, then released together by
+// FleetRelease, on a socket per robot and on one shared UdpMux socket.
+void benchRelease(int robots) {
+    const int rounds = 5;
+    int sink = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(sink, (sockaddr*)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(sink, (sockaddr*)&addr, &len);
+    int on = 1, bytes = 8 << 20;
+    setsockopt(sink, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+    if (setsockopt(sink, SOL_SOCKET, SO_RCVBUFFORCE, &bytes, sizeof(bytes)) != 0)
+        setsockopt(sink, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes));
+    int port = ntohs(addr.sin_port);
+
+    CommandLimits limits;
+    driveBody body = { FORWARD, 1, 90 };
+    FleetRelease release;
+
+    // median over the rounds of the arrival spread, and of the first arrival's lateness
+    auto report = [&](const string& name, vector<double>& spreads, vector<double>& lates, int arrived) {
+        sort(spreads.begin(), spreads.end());
+        sort(lates.begin(), lates.end());
+        printf("%-32s spread %8.1f us  first after target %7.1f us  arrived %d of %d\n", name.c_str(),
+            spreads[spreads.size() / 2], lates[lates.size() / 2], arrived, robots * rounds);
+    };
+    auto wallNs = [] {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    };
+
+    auto burst = [&](vector<shared_ptr<RobotSession>>& sessions, const string& name) {
+        vector<double> spreads, lates;
+        int arrived = 0;
+        for (int round = 0; round < rounds; round++) {
+            vector<ReleaseFrame> frames;
+            for (auto& session : sessions)
+                frames.push_back({ session->GetId(), session->GetSocket().GetHandle(), session->GetSocket().GetPeer(),
+                    session->Prepare(CMDType::DRIVE, (unsigned char*)&body, sizeof(body)) });
+            auto at = FleetRelease::Clock::now() + chrono::milliseconds(20);
+            int64_t target = wallNs() + 20000000;
+            promise<void> done;
+            release.Schedule(at, move(frames), [&](const ReleaseReport&) { done.set_value(); });
+            done.get_future().wait();
+            vector<int64_t> times = arrivals(sink, robots);
+            arrived += (int)times.size();
+            if (times.empty())
+                continue;
+            spreads.push_back((times.back() - times.front()) / 1000.0);
+            lates.push_back((times.front() - target) / 1000.0);
+        }
+        report(name, spreads, lates, arrived);
+    };
+
+    {
+        vector<shared_ptr<RobotSession>> sessions;
+        for (int i = 0; i < robots; i++)
+            sessions.push_back(make_shared<RobotSession>(i, "127.0.0.1", port, limits));
+
+        vector<double> spreads, lates;
+        int arrived = 0;
+        for (int round = 0; round < rounds; round++) {
+            int64_t start = wallNs();
+            for (auto& session : sessions)
+                session->SendPacket(CMDType::DRIVE, (unsigned char*)&body, sizeof(body));
+            vector<int64_t> times = arrivals(sink, robots);
+            arrived += (int)times.size();
+            if (times.empty())
+                continue;
+            spreads.push_back((times.back() - times.front()) / 1000.0);
+            lates.push_back((times.front() - start) / 1000.0);
+        }
+        report("release/per robot x" + to_string(robots), spreads, lates, arrived);
+        burst(sessions, "release/burst sockets x" + to_string(robots));
+    }
+    {
+        auto mux = make_shared<UdpMux>(1);
+        mux->Start();
+        vector<shared_ptr<RobotSession>> sessions;
+        for (int i = 0; i < robots; i++)
+            sessions.push_back(make_shared<RobotSession>(i, "127.0.0.1", port, limits, DEFAULT_SIZE, -1, mux));
+        burst(sessions, "release/burst shared x" + to_string(robots));
+        sessions.clear();
+        mux->Stop();
+    }
+    close(sink);
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = (argc > 1) ? atol(argv[1]) : 1000000;
+
+    benchTelemetryJson(iterations);
+    benchBufferPool(iterations);
+    benchTrace(iterations);
+    benchFlightRecorder(iterations);
+    benchFanout(iterations);
+    benchFleet(iterations, 10000);
+    benchMissions(2000, 10);
+    benchCommandQueue();
+    benchStore();
+    benchImpairedLink(1000);
+    benchSendRing(8, 20000);
+    benchReactor(1000);
+    benchCoalescing(32);
+    benchLongPoll();
+    benchPacketFilter(20000);
+    benchDemux(iterations, 10000);
+    benchRelease(500);
+
+    long roundTrips = iterations / 20;
+    benchSocket("socket/blocking", SocketBackend::BLOCKING, 1, roundTrips);
+    benchSocket("socket/io_uring", SocketBackend::IO_URING, 1, roundTrips);
+    benchSocket("socket/blocking batch 16", SocketBackend::BLOCKING, 16, roundTrips);
+    benchSocket("socket/io_uring batch 16", SocketBackend::IO_URING, 16, roundTrips);
+    benchBusyPoll(roundTrips, 50);
+    return 0;
+}
@@ -1,17 +1,34 @@
 #include "crow_all.h"
 #include "PktDef.h"
 #include "MySocket.h"
+#include "RobotSession.h"
+#include "MissionScheduler.h"
+#include "TelemetryJson.h"
+#include "Config.h"
+#include "TelemetryPoller.h"
+#include "LivenessMonitor.h"
+#include "TelemetryStream.h"
+#include "TelemetryLongPoll.h"
+#include "TelemetryQuery.h"
+#include "Trace.h"
+#include "FlightRecorder.h"
+#include "FleetTable.h"
+#include "FleetRelease.h"
+#include <sched.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 using namespace std;
 using namespace crow;
 
-unique_ptr<MySocket> socketPtr;
-int packetCount = 0;
-
 // Utility to load static files
 string loadFile(const string& path) {
     ifstream file(path);
@@ -23,68 +40,336 @@ string loadFile(const string& path) {
     return "404 - File Not Found";
 }
 
-void sendPacket(CMDType cmd, unsigned char* data = nullptr, int size = 0) {
+// robot a request is addressed to, ?robot=N, robot 0 when omitted
+int robotId(const request& req) {
+    const char* id = req.url_params.get("robot");
+    return id ? atoi(id) : 0;
+}
+
+// Convert telemetry packet to a JSON response
+response parseTelemetry(unsigned char* buffer, int length) {
+    TraceSpan span("parseTelemetry");
     PktDef pkt;
-    pkt.setPktCount(++packetCount);
-    pkt.setCMD(cmd);
 
-    if (data && size > 0)
-        pkt.setBodyData(data, size);
+    if (length > 255 || !pkt.checkCRC(buffer, (unsigned char)length)) {
+        json::wvalue json;
+        json["error"] = "CRC validation failed";
+        return response(json);
+    }
+
+    telemetry data;
+    if (!frameTelemetry(buffer, length, data)) {
+        json::wvalue json;
+        json["error"] = "Invalid response packet";
+        return response(json);
+    }
+
+    // fixed shape, written straight from the per-thread buffer instead of a wvalue map
+    TraceSpan json("telemetry json");
+    response res(string(serializeTelemetry(data)));
+    res.set_header("Content-Type", "application/json");
+    return res;
+}
 
-    unsigned char* buffer = pkt.genPacket();
+// WebSocket subscriber. Crow frees the connection after onclose, so the
+// pointer is cleared there under the same lock Deliver sends under.
+class SocketSubscriber : public TelemetrySubscriber {
+private:
+    mutex lock;
+    websocket::connection* conn = nullptr;
 
+public:
+    const int robot;
 
-    int totalSize = pkt.getLength();
-    /* ignore debugging purposes
-    cout << "[SENDING] Command: " << (int)cmd
-         << ", Total Size: " << totalSize
-         << ", CRC: " << (int)buffer[totalSize - 1] << endl;
+    explicit SocketSubscriber(int robot) : robot(robot) {}
+
+    void Open(websocket::connection* c) {
+        lock_guard<mutex> lk(lock);
+        conn = c;
+    }
+
+    void Close() {
+        lock_guard<mutex> lk(lock);
+        conn = nullptr;
+    }
+
+    // Crow frames a copy, the JSON itself was only encoded once
+    void Deliver(int, const telemetry&, const PacketBuffer& sample) override {
+        lock_guard<mutex> lk(lock);
+        if (conn)
+            conn->send_text(string(sample.Data(), sample.Size()));
+    }
+};
+
+// every request into the flight recorder: method and path, status, time taken.
+// after_handle runs when the response ends, parked requests included
+struct FlightMiddleware {
+    struct context {
+        chrono::steady_clock::time_point start;
+    };
+
+    void before_handle(request&, response&, context& ctx) {
+        ctx.start = chrono::steady_clock::now();
+    }
 
-    cout << "Packet Bytes: ";
-    for (int i = 0; i < totalSize; i++) {
-        printf("%02X ", buffer[i]);
+    void after_handle(request& req, response& res, context& ctx) {
+        char route[FlightRecorder::TEXTSIZE];
+        int length = snprintf(route, sizeof(route), "%s %s", method_strings[(int)req.method], req.url.c_str());
+        auto us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - ctx.start).count();
+        FlightRecorder::RecordText(FlightKind::HTTP, -1, res.code, (uint32_t)us, route,
+            min(max(length, 0), (int)sizeof(route)));
     }
-    cout << endl;
-    */
-    socketPtr->SendData((char*)buffer, totalSize);
+};
+
+// Binary API: clients that speak PktDef directly send and receive raw wire frames
+bool isBinary(const string& contentType) {
+    return contentType.rfind("application/octet-stream", 0) == 0;
 }
 
+// fast fail for a robot that stopped answering, the heartbeat finds it again
+response robotDown() {
+    response res(503, "robot is not responding");
+    res.set_header("Retry-After", "1");
+    return res;
+}
 
+// one status exchange, pooled receive buffer shared with every request that joined it
+response exchangeTelemetry(const request& req, RobotSession& robot, int waitMs, bool countsForLiveness) {
+    PacketBuffer reply;
+    int received = robot.RequestTelemetry(reply, waitMs, countsForLiveness);
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return response(504, "robot did not reply in time");
+    if (received <= 0)
+        return response(500, "no telemetry response received");
+    unsigned char* raw = (unsigned char*)reply.Data();
 
-// Convert telemetry packet to JSON
-json::wvalue parseTelemetry(unsigned char* buffer, int length) {
-    json::wvalue json;
-    PktDef pkt(buffer);
+    // raw reply frame for binary clients, checked but not decoded
+    if (isBinary(req.get_header_value("Accept"))) {
+        if (!validFrame(raw, received) || frameCommand(raw) != CMDType::RESPONSE)
+            return response(502, "robot sent a malformed reply frame");
 
-    if (!pkt.checkCRC(buffer, length)) {
-        json["error"] = "CRC validation failed";
-        return json;
+        response res(string(reply.Data(), received));
+        res.set_header("Content-Type", "application/octet-stream");
+        return res;
     }
 
-    if (pkt.getCMD() != CMDType::RESPONSE || !pkt.getBodyData()) {
-        json["error"] = "Invalid response packet";
-        return json;
+    return parseTelemetry(raw, received);
+}
+
+// 202 once the robot's sender has the commands, 429 with Retry-After while
+// its queue is full, so one flooding client waits instead of the link
+response queueCommands(RobotSession& robot, vector<Command>& batch) {
+    int retryAfter;
+    if (robot.QueueCommands(batch, retryAfter))
+        return response(202, to_string(batch.size()) + (batch.size() == 1 ? " command queued" : " commands queued"));
+    if (retryAfter == 0)
+        return response(413, "batch is deeper than command_queue_depth");
+
+    response res(429, "command queue full");
+    res.set_header("Retry-After", to_string(retryAfter));
+    return res;
+}
+
+// body is one frame, or with ?batch=1 a sequence of [1 byte length][frame]
+response sendRawFrames(const request& req) {
+    auto robot = getSession(robotId(req));
+    if (!robot)
+        return response(503, "not connected");
+    if (robot->GetLiveness() == Liveness::DOWN)
+        return robotDown();
+
+    unsigned char* body = (unsigned char*)req.body.data();
+    int bodySize = (int)req.body.size();
+
+    vector<pair<unsigned char*, int>> frames;
+    if (req.url_params.get("batch")) {
+        int offset = 0;
+        while (offset < bodySize) {
+            int size = body[offset++];
+            if (offset + size > bodySize)
+                return response(400, "truncated batch at frame " + to_string(frames.size()));
+            frames.emplace_back(body + offset, size);
+            offset += size;
+        }
+    }
+    else {
+        frames.emplace_back(body, bodySize);
     }
 
-    telemetry* data = (telemetry*)pkt.getBodyData();
-    json["LastPktCounter"] = data->LastPktCounter;
-    json["CurrentGrade"] = data->CurrentGrade;
-    json["HitCount"] = data->HitCount;
-    json["LastCmd"] = data->LastCmd;
-    json["LastCmdValue"] = data->LastCmdValue;
-    json["LastCmdSpeed"] = data->LastCmdSpeed;
+    // validate everything first so a bad batch sends nothing
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (!validFrame(frames[i].first, frames[i].second))
+            return response(400, "invalid frame " + to_string(i));
+
+        if (frameCommand(frames[i].first) == CMDType::RESPONSE)
+            return response(400, "frame " + to_string(i) + " is a status request, use /telemetry_request");
+    }
+
+    vector<Command> batch(frames.size());
+    for (size_t i = 0; i < frames.size(); i++) {
+        batch[i].raw = true;
+        batch[i].data = BufferPool::Instance().Acquire(frames[i].second);
+        memcpy(batch[i].data.Data(), frames[i].first, frames[i].second);
+        batch[i].data.SetSize(frames[i].second);
+    }
+    return queueCommands(*robot, batch);
+}
+
+// "command":"drive"|"sleep" and the drive params, as missions and fleet commands give them
+bool parseCommand(const json::rvalue& json, CMDType& cmd, driveBody& body, string& error) {
+    string command = json["command"].s();
+    if (command == "drive") {
+        if (!json.has("direction") || !json.has("duration") || !json.has("speed")) {
+            error = "missing drive params";
+            return false;
+        }
+        cmd = CMDType::DRIVE;
+        body.direction = (uint8_t)json["direction"].i();
+        body.duration = (uint8_t)json["duration"].i();
+        body.speed = (uint8_t)json["speed"].i();
+    }
+    else if (command == "sleep") {
+        cmd = CMDType::SLEEP;
+    }
+    else {
+        error = "command not supported";
+        return false;
+    }
+    return true;
+}
+
+// one mission step: {"command":"drive"|"sleep", "at_ms":N, drive params}
+bool parseMissionStep(const json::rvalue& json, MissionStep& step, string& error) {
+    if (!json.has("command") || !json.has("at_ms")) {
+        error = "step needs command and at_ms";
+        return false;
+    }
+
+    step.at = chrono::milliseconds(json["at_ms"].i());
+    if (step.at.count() < 0) {
+        error = "at_ms must not be negative";
+        return false;
+    }
+    return parseCommand(json, step.cmd, step.body, error);
+}
+
+json::wvalue releaseJson(const ReleaseReport& report) {
+    json::wvalue json;
+    json["robots"] = report.robots;
+    json["sent"] = report.sent;
+    json["syscalls"] = report.syscalls;
+    json["late_us"] = report.lateUs;
+    json["skew_us"] = report.skewUs;
+    json::wvalue::list results;
+    for (auto& result : report.results) {
+        json::wvalue entry;
+        entry["robot"] = result.robot;
+        entry["sent"] = result.sent;
+        entry["offset_us"] = result.offsetUs;
+        results.push_back(move(entry));
+    }
+    json["results"] = move(results);
+    return json;
+}
+
+json::wvalue missionJson(const MissionStatus& status) {
+    json::wvalue json;
+    json["id"] = status.id;
+    json["robot"] = status.robot;
+    json["state"] = missionStateName(status.state);
+    json["stepsSent"] = status.stepsSent;
+    json["stepsTotal"] = status.stepsTotal;
+    json["maxLateUs"] = status.maxLateUs;
     return json;
 }
 
-int main() {
-    crow::SimpleApp app;
+// pinning the main thread before anything is started covers every thread after it
+bool pinToCpus(const vector<int>& cpus) {
+    if (cpus.empty())
+        return true;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+int main(int argc, char* argv[]) {
+    static Config config;
+    string error;
+    if (!config.Load(argc, argv, error)) {
+        cerr << error << endl;
+        return 1;
+    }
+    if (!pinToCpus(config.cpus)) {
+        cerr << "cannot pin to the cpus in config" << endl;
+        return 1;
+    }
+    // the last few thousand events of every thread go to stderr if we crash
+    FlightRecorder::InstallCrashHandler();
+
+    // one encoding per sample shared by every SSE stream and WebSocket,
+    // declared before the app so WebSockets closing on shutdown can still leave it
+    TelemetryHub hub;
+    crow::App<FlightMiddleware> app;
+
+    // SSE streams live on their own port, the poller samples only robots being watched
+    unique_ptr<TelemetryStream> stream;
+    if (config.streamPort > 0) {
+        stream = make_unique<TelemetryStream>(hub, config.streamPort, config.streamBacklog);
+        if (!stream->Ok()) {
+            cerr << "cannot listen for telemetry streams on port " << config.streamPort << endl;
+            return 1;
+        }
+    }
+    // recorded history, written behind the poller by the store's own thread
+    unique_ptr<TelemetryStore> store;
+    if (!config.storeDir.empty()) {
+        store = make_unique<TelemetryStore>(config.storeDir, config.storeFlushMs);
+        if (!store->Ok()) {
+            cerr << "cannot write telemetry to " << config.storeDir << endl;
+            return 1;
+        }
+    }
+    TelemetryPoller poller(hub, config.telemetryPollMs, store.get());
+    LivenessMonitor liveness(config.heartbeatMs, config.livenessTimeoutMs);
+    // parked ?after= telemetry requests, answered from the poller's samples
+    auto longPoll = make_shared<TelemetryLongPoll>(hub);
+    // synchronized fleet commands go out from here
+    FleetRelease release(config.releaseCpu);
+    // every robot on a few shared sockets instead of one socket each
+    shared_ptr<UdpMux> mux;
+    if (config.sharedSockets > 0) {
+        mux = make_shared<UdpMux>(config.sharedSockets, config.sharedPort, config.receiveSize, config.writerCpu);
+        if (!mux->Ok()) {
+            cerr << "cannot bind the shared robot sockets to port " << config.sharedPort << endl;
+            return 1;
+        }
+        mux->Start();
+    }
+
+    // timed steps are sent from the scheduler thread, not a request handler
+    MissionScheduler missions([](int id, const MissionStep& step) {
+        TraceRequest traced;
+        TraceSpan span("mission step");
+        auto robot = getSession(id);
+        if (!robot)
+            return false;
+
+        if (step.cmd == CMDType::DRIVE)
+            robot->SendPacket(CMDType::DRIVE, (unsigned char*)&step.body, sizeof(driveBody));
+        else
+            robot->SendPacket(step.cmd);
+        return true;
+    });
+    missions.SetHistory(config.missionHistory);
 
     // Serve HTML
     CROW_ROUTE(app, "/")([] {
-        return loadFile("../public/index.html");
+        return loadFile(config.publicDir + "/index.html");
     });
     // Connect route
-    CROW_ROUTE(app, "/connect").methods(HTTPMethod::Post)([](const request& req) {
+    CROW_ROUTE(app, "/connect").methods(HTTPMethod::Post)([mux](const request& req) {
         auto json = crow::json::load(req.body);
         if (!json || !json.has("ip") || !json.has("port"))
             return response(400, "invalid");
@@ -92,51 +377,467 @@ int main() {
         string ip = json["ip"].s();
         int port = json["port"].i();
 
-        socketPtr = make_unique<MySocket>(SocketType::CLIENT, ip, port, ConnectionType::UDP, DEFAULT_SIZE);
+        int id = json.has("robot") ? (int)json["robot"].i() : robotId(req);
+
+        auto session = make_shared<RobotSession>(id, ip, port, config.commands, config.receiveSize, config.writerCpu, mux);
+        if (config.uringSockets && !mux)
+            session->GetSocket().SetBackend(SocketBackend::IO_URING);
+        session->SetSocketOptions(config.receiveTimeoutMs, config.socketBufferBytes);
+        setSession(id, session);
         return response(200, "connected successfully to robot");
     });
 
     // Telecommand (drive / sleep)
     CROW_ROUTE(app, "/telecommand").methods(HTTPMethod::Put)([](const request& req) {
+        TraceRequest traced;
+        TraceSpan span("http /telecommand");
+        if (isBinary(req.get_header_value("Content-Type")))
+            return sendRawFrames(req);
+
         auto json = crow::json::load(req.body);
         if (!json || !json.has("command"))
             return response(400, "missing command ");
 
+        auto robot = getSession(robotId(req));
+        if (!robot)
+            return response(503, "not connected");
+        if (robot->GetLiveness() == Liveness::DOWN)
+            return robotDown();
+
         string command = json["command"].s();
+        vector<Command> batch(1);
 
         if (command == "drive") {
             if (!json.has("direction") || !json.has("duration") || !json.has("speed"))
                 return response(400, "missing drive params");
 
-            unsigned char payload[3];
+            batch[0].cmd = CMDType::DRIVE;
+            batch[0].data = BufferPool::Instance().Acquire(3);
+            unsigned char* payload = (unsigned char*)batch[0].data.Data();
             payload[0] = (unsigned char)json["direction"].i();
             payload[1] = (unsigned char)json["duration"].i();
             payload[2] = (unsigned char)json["speed"].i();
-
-            sendPacket(CMDType::DRIVE, payload, 3);
+            batch[0].data.SetSize(3);
         }
         else if (command == "sleep") {
-            sendPacket(CMDType::SLEEP);
+            batch[0].cmd = CMDType::SLEEP;
         }
         else {
             return response(400, "command not supported");
         }
 
-        return response(200, "command sent");
+        return queueCommands(*robot, batch);
+    });
+
+    // a robot's command queue: waiting, sent, refused with 429, shed for delay
+    CROW_ROUTE(app, "/telecommand/queue").methods(HTTPMethod::Get)([](const request& req) {
+        auto robot = getSession(robotId(req));
+        if (!robot)
+            return response(503, "not connected");
+
+        CommandQueueStats stats = robot->CommandStats();
+        json::wvalue json;
+        json["waiting"] = stats.waiting;
+        json["sent"] = stats.sent;
+        json["rejected"] = stats.rejected;
+        json["shed"] = stats.shed;
+        json["shedding"] = stats.shedding;
+        SendRingStats writer = robot->WriterStats();
+        json["writer"]["sent"] = writer.sent;
+        json["writer"]["batches"] = writer.batches;
+        json["writer"]["full"] = writer.full;
+        return response(json);
+    });
+
+    // breaker state of a robot, see Liveness
+    CROW_ROUTE(app, "/liveness").methods(HTTPMethod::Get)([](const request& req) {
+        auto robot = getSession(robotId(req));
+        if (!robot)
+            return response(503, "not connected");
+
+        static const char* names[] = { "healthy", "suspect", "down" };
+        json::wvalue json;
+        json["state"] = names[(int)robot->GetLiveness()];
+        json["idle_ms"] = chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now() - robot->LastExchange()).count();
+        return response(json);
+    });
+
+    // how many status requests were answered from one exchange with the robot
+    CROW_ROUTE(app, "/telemetry/coalescing").methods(HTTPMethod::Get)([](const request& req) {
+        auto robot = getSession(robotId(req));
+        if (!robot)
+            return response(503, "not connected");
+
+        TelemetryStats stats = robot->GetTelemetryStats();
+        json::wvalue json;
+        json["requests"] = stats.requests;
+        json["exchanges"] = stats.exchanges;
+        json["coalesced"] = stats.coalesced;
+        json["ratio"] = stats.exchanges ? (double)stats.requests / stats.exchanges : 0.0;
+        return response(json);
+    });
+
+    // aggregates over the latest telemetry of every robot ever connected, one
+    // vectorized pass over the fleet table's columns
+    CROW_ROUTE(app, "/fleet/summary").methods(HTTPMethod::Get)([] {
+        auto start = chrono::steady_clock::now();
+        FleetSummary summary = FleetTable::Instance().Summarize();
+        auto us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+        json::wvalue json;
+        json["robots"] = summary.robots;
+        json["reporting"] = summary.reporting;
+        json["grade"]["mean"] = summary.meanGrade;
+        json["grade"]["min"] = summary.minGrade;
+        json["grade"]["max"] = summary.maxGrade;
+        json["hits"]["total"] = summary.totalHits;
+        json["hits"]["max"] = summary.maxHits;
+        json["last_cmd"]["drive"] = summary.driving;
+        json["last_cmd"]["sleep"] = summary.sleeping;
+        json["compute_us"] = us;
+        return response(json);
+    });
+
+    // One command to many robots at once: {"command":..., drive params,
+    // "robots":[ids] (default every connected robot), "at":unix ms or
+    // "delay_ms":N (default 50)}. The frames are encoded here and released
+    // together at the target by the release thread, the response comes once
+    // they are out, with the measured send skew.
+    CROW_ROUTE(app, "/fleet/telecommand").methods(HTTPMethod::Put)([&release](const request& req, response& res) {
+        auto json = crow::json::load(req.body);
+        if (!json || !json.has("command")) {
+            res = response(400, "missing command");
+            res.end();
+            return;
+        }
+        CMDType cmd;
+        driveBody body{};
+        string error;
+        if (!parseCommand(json, cmd, body, error)) {
+            res = response(400, error);
+            res.end();
+            return;
+        }
+
+        if ((json.has("delay_ms") && json["delay_ms"].t() != json::type::Number) ||
+            (json.has("at") && json["at"].t() != json::type::Number)) {
+            res = response(400, "delay_ms and at must be numbers");
+            res.end();
+            return;
+        }
+        long delayMs = json.has("delay_ms") ? (long)json["delay_ms"].d() : 50;
+        if (json.has("at")) {
+            auto now = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch());
+            delayMs = (long)(json["at"].d() - (double)now.count());
+        }
+        if (delayMs < 0 || delayMs > 60000) {
+            res = response(400, "release time must be within the next 60 s");
+            res.end();
+            return;
+        }
+
+        vector<shared_ptr<RobotSession>> robots;
+        if (json.has("robots")) {
+            if (json["robots"].t() != json::type::List) {
+                res = response(400, "robots must be a list of robot ids");
+                res.end();
+                return;
+            }
+            for (const auto& id : json["robots"]) {
+                if (id.t() != json::type::Number || id.nt() == json::num_type::Floating_point) {
+                    res = response(400, "robots must be a list of robot ids");
+                    res.end();
+                    return;
+                }
+                auto robot = getSession((int)id.i());
+                if (!robot) {
+                    res = response(503, "robot " + to_string(id.i()) + " not connected");
+                    res.end();
+                    return;
+                }
+                robots.push_back(robot);
+            }
+        }
+        else {
+            forEachSession([&](const shared_ptr<RobotSession>& robot) { robots.push_back(robot); });
+        }
+        for (auto& robot : robots) {
+            if (robot && robot->GetLiveness() == Liveness::DOWN) {
+                res = robotDown();
+                res.end();
+                return;
+            }
+        }
+
+        vector<ReleaseFrame> frames;
+        for (auto& robot : robots) {
+            if (!robot)
+                continue;
+            PacketBuffer frame = (cmd == CMDType::DRIVE) ?
+                robot->Prepare(cmd, (unsigned char*)&body, sizeof(body)) : robot->Prepare(cmd);
+            frames.push_back({ robot->GetId(), robot->GetSocket().GetHandle(), robot->GetSocket().GetPeer(), move(frame) });
+        }
+        if (frames.empty()) {
+            res = response(503, "not connected");
+            res.end();
+            return;
+        }
+
+        // the sessions ride along so their sockets outlive the burst
+        auto io = req.io_service;
+        auto at = FleetRelease::Clock::now() + chrono::milliseconds(delayMs);
+        release.Schedule(at, move(frames), [io, &res, robots](const ReleaseReport& report) {
+            string body = releaseJson(report).dump();
+            io->post([&res, body = move(body)] {
+                res.set_header("Content-Type", "application/json");
+                res.end(body);
+            });
+        });
+    });
+
+    // telemetry req. With ?after=<LastPktCounter>[&timeout=ms] it long-polls:
+    // parked without a worker until a sample with another counter is
+    // published (JSON), or 204 once the timeout (default 30 s) runs out
+    CROW_ROUTE(app, "/telemetry_request").methods(HTTPMethod::Get)([longPoll](const request& req, response& res) {
+        TraceRequest traced;
+        TraceSpan span("http /telemetry_request");
+        int id = robotId(req);
+        auto robot = getSession(id);
+        const char* after = req.url_params.get("after");
+        if (!robot) {
+            res = response(503, "not connected");
+        }
+        else if (robot->GetLiveness() == Liveness::DOWN) {
+            res = robotDown();
+        }
+        else if (!after) {
+            // never an unbounded wait, a worker stuck on a dead robot also blocks its heartbeat
+            int wait = (config.receiveTimeoutMs > 0) ? config.receiveTimeoutMs.load() : config.livenessTimeoutMs.load();
+            // a receive_timeout_ms below the liveness timeout is no verdict on the robot
+            res = exchangeTelemetry(req, *robot, wait, wait >= config.livenessTimeoutMs);
+        }
+        else {
+            char* end;
+            long counter = strtol(after, &end, 10);
+            if (!*after || *end || counter < 0 || counter > 255) {
+                res = response(400, "after must be a LastPktCounter, 0 to 255");
+                res.end();
+                return;
+            }
+            const char* timeout = req.url_params.get("timeout");
+            int timeoutMs = timeout ? max(1, min(atoi(timeout), 60000)) : 30000;
+
+            auto io = req.io_service;
+            longPoll->Park(id, (uint8_t)counter, chrono::milliseconds(timeoutMs), [io, &res](const PacketBuffer* sample) {
+                bool found = (sample != nullptr);
+                string body = found ? string(sample->Data(), sample->Size()) : string();
+                io->post([&res, found, body = move(body)] {
+                    if (found)
+                        res.set_header("Content-Type", "application/json");
+                    else
+                        res.code = 204;
+                    res.end(body);
+                });
+            });
+            return;
+        }
+        res.end();
+    });
+
+    // upload a mission: {"robot":N, "start_ms":N, "steps":[...]}, at_ms offsets are from start
+    CROW_ROUTE(app, "/missions").methods(HTTPMethod::Post)([&missions](const request& req) {
+        auto json = crow::json::load(req.body);
+        if (!json || !json.has("steps") || json["steps"].t() != json::type::List)
+            return response(400, "missing steps");
+
+        int id = json.has("robot") ? (int)json["robot"].i() : robotId(req);
+        if (!getSession(id))
+            return response(503, "not connected");
+
+        vector<MissionStep> steps;
+        for (const auto& entry : json["steps"]) {
+            MissionStep step{};
+            string error;
+            if (!parseMissionStep(entry, step, error))
+                return response(400, "step " + to_string(steps.size()) + ": " + error);
+            if (!steps.empty() && step.at < steps.back().at)
+                return response(400, "step " + to_string(steps.size()) + ": at_ms must not decrease");
+            steps.push_back(step);
+        }
+
+        auto delay = chrono::milliseconds(json.has("start_ms") ? json["start_ms"].i() : 0);
+        int mission = missions.Start(id, move(steps), delay);
+
+        json::wvalue result;
+        result["id"] = mission;
+        return response(201, result);
+    });
+
+    CROW_ROUTE(app, "/missions/<int>").methods(HTTPMethod::Get)([&missions](int id) {
+        MissionStatus status;
+        if (!missions.GetStatus(id, status))
+            return response(404, "no such mission");
+        return response(missionJson(status));
+    });
+
+    CROW_ROUTE(app, "/missions/<int>").methods(HTTPMethod::Delete)([&missions](int id) {
+        if (!missions.Cancel(id))
+            return response(404, "no running mission with that id");
+        return response(200, "mission cancelled");
+    });
+
+    // record spans for N seconds (default 5, at most 60) and return them as Chrome trace JSON,
+    // load the result in chrome://tracing or ui.perfetto.dev. The capture waits on its own
+    // thread and the reply is posted back, so no request worker is held for the duration.
+    CROW_ROUTE(app, "/debug/trace").methods(HTTPMethod::Get)([](const request& req, response& res) {
+        const char* param = req.url_params.get("seconds");
+        int seconds = param ? atoi(param) : 5;
+        if (seconds < 1 || seconds > 60) {
+            res.code = 400;
+            res.end("seconds must be 1 to 60");
+            return;
+        }
+
+        int64_t since = Trace::Now();
+        Trace::Start();
+        auto io = req.io_service;
+        thread([io, &res, since, seconds] {
+            this_thread::sleep_for(chrono::seconds(seconds));
+            Trace::Stop();
+            auto body = make_shared<string>(Trace::ExportChrome(since));
+            io->post([&res, body] {
+                res.set_header("Content-Type", "application/json");
+                res.end(*body);
+            });
+        }).detach();
+    });
+
+    // the flight recorder's events, every thread merged oldest first. Always recording,
+    // this only reads what is there
+    CROW_ROUTE(app, "/debug/flight-recorder").methods(HTTPMethod::Get)([] {
+        response res(FlightRecorder::Export());
+        res.set_header("Content-Type", "application/json");
+        return res;
+    });
+
+    // filter/group/aggregate over recorded telemetry, see TelemetryQuery.
+    // Crow 1.1 cannot send a body in pieces, so the result is built off the
+    // worker threads and sent whole; limit bounds it, at most
+    // TelemetryQuery::MAXLIMIT rows (some 15 MB of JSON).
+    CROW_ROUTE(app, "/telemetry/query").methods(HTTPMethod::Get)([](const request& req, response& res) {
+        if (config.storeDir.empty()) {
+            res.code = 404;
+            res.end("telemetry recording is off, set store_dir");
+            return;
+        }
+
+        auto param = [&req](const char* name) {
+            const char* value = req.url_params.get(name);
+            return string(value ? value : "");
+        };
+
+        auto query = make_shared<TelemetryQuery>();
+        string error;
+        if (!query->Parse(param("where"), param("select"), param("every"), error)) {
+            res.code = 400;
+            res.end(error);
+            return;
+        }
+        if (!param("from").empty())
+            query->FromMs = atoll(param("from").c_str());
+        if (!param("to").empty())
+            query->ToMs = atoll(param("to").c_str());
+        if (!param("limit").empty())
+            query->Limit = (size_t)max(1LL, min((long long)TelemetryQuery::MAXLIMIT, atoll(param("limit").c_str())));
+
+        bool csv = (param("format") == "csv") ||
+                   (param("format").empty() && req.get_header_value("Accept").rfind("text/csv", 0) == 0);
+        int robot = robotId(req);
+        auto io = req.io_service;
+        thread([io, &res, query, csv, robot] {
+            TraceRequest traced;
+            TraceSpan span("telemetry query");
+            auto body = make_shared<string>();
+            TelemetryReader reader(config.storeDir, robot);
+            query->Run(reader, csv ? TelemetryQuery::Format::CSV : TelemetryQuery::Format::JSON, *body);
+
+            io->post([&res, body, csv, truncated = query->Truncated] {
+                res.set_header("Content-Type", csv ? "text/csv" : "application/json");
+                if (truncated)
+                    res.set_header("X-Query-Truncated", "true");
+                res.end(*body);
+            });
+        }).detach();
+    });
+
+    // Crow cannot hold a response open, so the stream itself is served by
+    // TelemetryStream on stream_port. curl -N -L and EventSource follow this.
+    CROW_ROUTE(app, "/telemetry/stream").methods(HTTPMethod::Get)([](const request& req) {
+        if (config.streamPort == 0)
+            return response(404, "telemetry streaming is off");
+
+        string host = req.get_header_value("Host");
+        size_t colon = host.rfind(':');
+        if (colon != string::npos && host.find(']', colon) == string::npos)
+            host.erase(colon);
+        if (host.empty())
+            host = "localhost";
+
+        response res(307);
+        res.set_header("Location", "http://" + host + ":" + to_string(config.streamPort) +
+                       "/telemetry/stream?robot=" + to_string(robotId(req)));
+        return res;
+    });
+
+    // telemetry over a WebSocket, ?robot=N, one text message per sample
+    CROW_WEBSOCKET_ROUTE(app, "/telemetry/ws")
+        .onaccept([](const request& req, void** userdata) {
+            *userdata = new shared_ptr<SocketSubscriber>(make_shared<SocketSubscriber>(robotId(req)));
+            return true;
+        })
+        .onopen([&hub](websocket::connection& conn) {
+            auto& subscriber = *(shared_ptr<SocketSubscriber>*)conn.userdata();
+            subscriber->Open(&conn);
+            hub.Subscribe(subscriber->robot, subscriber);
+        })
+        .onclose([&hub](websocket::connection& conn, const string&) {
+            auto holder = (shared_ptr<SocketSubscriber>*)conn.userdata();
+            (*holder)->Close();
+            hub.Unsubscribe((*holder)->robot, *holder);
+            delete holder;
+        });
+
+    // effective settings, one key = value per line
+    CROW_ROUTE(app, "/config").methods(HTTPMethod::Get)([] {
+        return response(config.Dump());
     });
 
-    // telemetry req
-    CROW_ROUTE(app, "/telemetry_request").methods(HTTPMethod::Get)([](const request&) {
-        sendPacket(CMDType::RESPONSE);
+    // reread the config file, live settings apply at once and reach connected robots
+    CROW_ROUTE(app, "/config/reload").methods(HTTPMethod::Post)([&missions] {
+        vector<string> needsRestart;
+        string error;
+        if (!config.Reload(needsRestart, error))
+            return response(400, error);
 
-        char raw[DEFAULT_SIZE];
-        int received = socketPtr->GetData(raw);
-        if (received <= 0)
-            return response(500, "no telemetry response received");
+        missions.SetHistory(config.missionHistory);
+        int timeout = config.receiveTimeoutMs;
+        int buffer = config.socketBufferBytes;
+        forEachSession([timeout, buffer](RobotSession& session) {
+            session.SetSocketOptions(timeout, buffer);
+        });
 
-        return response(parseTelemetry((unsigned char*)raw, received));
+        string body = "reloaded\n";
+        for (auto& key : needsRestart)
+            body += key + " changed, takes effect after a restart\n";
+        return response(200, body);
     });
 
-    app.port(8080).multithreaded().run();
+    app.port(config.httpPort);
+    if (config.httpThreads > 0)
+        app.concurrency(config.httpThreads);
+    else
+        app.multithreaded();
+    app.run();
     return 0;
 }
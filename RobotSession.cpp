@@ -0,0 +1,278 @@
+#include "RobotSession.h"
+#include "Reactor.h"
+#include "FlightRecorder.h"
+#include "FleetTable.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+RobotSession::RobotSession(int id, std::string ip, int port, const CommandLimits& limits, int receiveSize,
+                           int writerCpu, std::shared_ptr<UdpMux> mux)
+    : id(id), fleetSlot(FleetTable::Instance().Attach(id)), mux(std::move(mux)), endpoint(nullptr),
+      liveness(Liveness::HEALTHY), misses(0), lastExchange(std::chrono::steady_clock::now().time_since_epoch().count()),
+      requests(0), exchanges(0), coalesced(0)
+{
+    if (this->mux) {
+        endpoint = this->mux->Attach(ip, port);
+        socket = std::make_unique<MySocket>(this->mux->Socket(id), ip, port, receiveSize);
+    }
+    else {
+        socket = std::make_unique<MySocket>(SocketType::CLIENT, ip, port, ConnectionType::UDP, receiveSize);
+        // stray and malformed datagrams die in the kernel instead of waking the reactor
+        socket->SetPacketFilter(true);
+    }
+    if (this->mux)
+        writer = std::make_unique<SendRing>(*socket, this->mux->Writer(id), id);
+    else
+        writer = std::make_unique<SendRing>(*socket, writerCpu, id);
+    commands = std::make_unique<CommandQueue>([this](Command& command) {
+        // a client-built frame keeps the count the client gave it
+        if (command.raw)
+            writer->Push(command.data, false);
+        else if (command.data)
+            SendPacket(command.cmd, (unsigned char*)command.data.Data(), command.data.Size());
+        else
+            SendPacket(command.cmd);
+    }, limits);
+}
+
+// the queue and the writer stop first, the endpoint goes after them
+RobotSession::~RobotSession() {
+    commands.reset();
+    writer.reset();
+    if (mux)
+        mux->Detach(socket->GetIPAddr(), socket->GetPort(), endpoint);
+}
+
+int RobotSession::GetId() const {
+    return id;
+}
+
+MySocket& RobotSession::GetSocket() {
+    return *socket;
+}
+
+PacketBuffer RobotSession::encode(CMDType cmd, unsigned char* data, int size) {
+    TraceSpan span("pktdef encode");
+    PktDef pkt;
+    pkt.setCMD(cmd);
+
+    if (data && size > 0)
+        pkt.setBodyData(data, size);
+
+    unsigned char* buffer = pkt.genPacket();
+    PacketBuffer frame = BufferPool::Instance().Acquire(pkt.getLength());
+    memcpy(frame.Data(), buffer, pkt.getLength());
+    frame.SetSize(pkt.getLength());
+    return frame;
+}
+
+bool RobotSession::SendPacket(CMDType cmd, unsigned char* data, int size) {
+    PacketBuffer frame = encode(cmd, data, size);
+    TraceSpan span("send enqueue");
+    return writer->Push(std::move(frame), true);
+}
+
+PacketBuffer RobotSession::Prepare(CMDType cmd, unsigned char* data, int size) {
+    PacketBuffer frame = encode(cmd, data, size);
+    // a stuck writer costs the release its place in the sequence, not the request
+    writer->Fence(FENCEMS);
+    writer->Stamp(frame);
+    return frame;
+}
+
+// resumed by the exchange's leader once its reply is in
+auto RobotSession::join(Flight& flight) {
+    struct Awaiter {
+        Flight& flight;
+        bool await_ready() const { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { flight.joined.push_back(handle); }
+        void await_resume() const {}
+    };
+    return Awaiter{ flight };
+}
+
+Task<int> RobotSession::Telemetry(PacketBuffer& reply, int timeoutMs, bool countsForLiveness) {
+    Reactor& reactor = Reactor::Instance();
+    co_await reactor.Schedule();
+    requests.fetch_add(1, std::memory_order_relaxed);
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    auto left = [&deadline] {
+        return (int)std::max<long long>(0, std::chrono::ceil<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count());
+    };
+    while (flight) {
+        coalesced.fetch_add(1, std::memory_order_relaxed);
+        std::shared_ptr<Flight> joined = flight;
+        co_await join(*joined);
+        // a shorter exchange (a poll) gave up before we would have, ask again
+        bool retry = joined->received <= 0 && joined->error == EAGAIN && (timeoutMs < 0 || left() > 0);
+        if (!retry) {
+            reply = joined->reply;
+            errno = joined->error;
+            co_return joined->received;
+        }
+    }
+    if (timeoutMs >= 0)
+        timeoutMs = left();
+
+    std::shared_ptr<Flight> current = std::make_shared<Flight>();
+    flight = current;
+    exchanges.fetch_add(1, std::memory_order_relaxed);
+
+    // a reply that turned up after its exchange gave up would pass for this one
+    if (endpoint) {
+        endpoint->inbox.clear();
+    }
+    else {
+        PacketBuffer late;
+        while (socket->TryGetData(late) > 0)
+            ;
+    }
+
+    if (SendPacket(CMDType::RESPONSE)) {
+        auto start = std::chrono::steady_clock::now();
+        current->received = co_await receive(reply, timeoutMs);
+        current->error = errno;
+        if (current->received > 0 || countsForLiveness)
+            recordExchange(current->received > 0);
+
+        // every good reply lands in the fleet table, whoever asked for it
+        if (current->received > 0) {
+            unsigned char* raw = (unsigned char*)reply.Data();
+            FlightRecorder::Packet(FlightKind::PACKET_RECEIVED, id, reply.Data(), current->received);
+            PktDef pkt;
+            telemetry sample;
+            if (current->received > 255 || !pkt.checkCRC(raw, (unsigned char)current->received))
+                FlightRecorder::Record(FlightKind::CRC_FAILED, id, current->received);
+            else if (frameTelemetry(raw, current->received, sample))
+                FleetTable::Instance().Update(fleetSlot, sample);
+        }
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        FlightRecorder::Record(FlightKind::EXCHANGE, id, (uint32_t)us, (uint32_t)current->received,
+            current->received >= 0 ? 0 : current->error);
+    }
+
+    // the joiners run here, one after the other, and leave the flight to us
+    flight = nullptr;
+    current->reply = reply;
+    for (auto handle : current->joined)
+        handle.resume();
+
+    errno = current->error;
+    co_return current->received;
+}
+
+// the next datagram from the robot, through the mux or off its own socket
+Task<int> RobotSession::receive(PacketBuffer& reply, int timeoutMs) {
+    if (endpoint)
+        co_return co_await mux->Receive(*endpoint, reply, timeoutMs);
+
+    Reactor& reactor = Reactor::Instance();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true) {
+        int left = -1;
+        if (timeoutMs >= 0)
+            left = (int)std::max<long long>(0, std::chrono::ceil<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count());
+        if (!co_await reactor.Readable(socket->GetHandle(), left)) {
+            errno = EAGAIN;
+            co_return -1;
+        }
+        int received = socket->TryGetData(reply);
+        if (received >= 0 || errno != EAGAIN)
+            co_return received;
+    }
+}
+
+Task<bool> RobotSession::Drive(driveBody body) {
+    co_return SendPacket(CMDType::DRIVE, (unsigned char*)&body, sizeof(body));
+}
+
+int RobotSession::RequestTelemetry(PacketBuffer& reply, int waitMs, bool countsForLiveness) {
+    TraceSpan span("robot exchange");
+    return Reactor::Instance().Run(Telemetry(reply, waitMs, countsForLiveness));
+}
+
+// anything back counts as alive, a bad frame is the parser's problem;
+// callers only report a miss after a full liveness timeout
+void RobotSession::recordExchange(bool replied) {
+    lastExchange = std::chrono::steady_clock::now().time_since_epoch().count();
+    if (replied) {
+        misses = 0;
+        liveness = Liveness::HEALTHY;
+    }
+    else {
+        misses++;
+        liveness = (misses >= DOWNAFTER) ? Liveness::DOWN : Liveness::SUSPECT;
+    }
+}
+
+Liveness RobotSession::GetLiveness() const {
+    return liveness;
+}
+
+TelemetryStats RobotSession::GetTelemetryStats() const {
+    return { requests.load(), exchanges.load(), coalesced.load() };
+}
+
+std::chrono::steady_clock::time_point RobotSession::LastExchange() const {
+    return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(lastExchange.load()));
+}
+
+void RobotSession::SetSocketOptions(int receiveTimeoutMs, int bufferBytes) {
+    if (mux)
+        return;
+    socket->SetReceiveTimeout(receiveTimeoutMs);
+    socket->SetBufferSize(bufferBytes);
+}
+
+bool RobotSession::QueueCommands(std::vector<Command>& batch, int& retryAfter) {
+    return commands->Push(batch, retryAfter);
+}
+
+CommandQueueStats RobotSession::CommandStats() {
+    return commands->Stats();
+}
+
+SendRingStats RobotSession::WriterStats() const {
+    return writer->Stats();
+}
+
+static std::mutex sessionLock;
+static std::unordered_map<int, std::shared_ptr<RobotSession>> sessions;
+
+std::shared_ptr<RobotSession> getSession(int id) {
+    std::lock_guard<std::mutex> lk(sessionLock);
+    auto it = sessions.find(id);
+    return (it != sessions.end()) ? it->second : nullptr;
+}
+
+void setSession(int id, std::shared_ptr<RobotSession> session) {
+    std::lock_guard<std::mutex> lk(sessionLock);
+    sessions[id] = std::move(session);
+}
+
+// fn runs outside the lock on a snapshot, so it may take as long as it likes
+static std::vector<std::shared_ptr<RobotSession>> snapshotSessions() {
+    std::vector<std::shared_ptr<RobotSession>> snapshot;
+    std::lock_guard<std::mutex> lk(sessionLock);
+    for (auto& entry : sessions)
+        snapshot.push_back(entry.second);
+    return snapshot;
+}
+
+void forEachSession(const std::function<void(RobotSession&)>& fn) {
+    for (auto& session : snapshotSessions())
+        fn(*session);
+}
+
+void forEachSession(const std::function<void(const std::shared_ptr<RobotSession>&)>& fn) {
+    for (auto& session : snapshotSessions())
+        fn(session);
+}
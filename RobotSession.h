@@ -0,0 +1,121 @@
+#pragma once
+#include "CommandQueue.h"
+#include "MySocket.h"
+#include "PktDef.h"
+#include "SendRing.h"
+#include "Task.h"
+#include "UdpMux.h"
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <coroutine>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Circuit breaker fed by status exchanges: one missed reply makes a robot
+// suspect, DOWNAFTER in a row make it down, any reply makes it healthy
+// again. A miss only counts when the exchange waited the full liveness
+// timeout, the liveness monitor's probes and requests that wait that long;
+// telemetry polls give up after the poll interval and are exempt, so a
+// robot slower than the poll rate is not taken down by being watched.
+// Requests to a down robot fail fast, the liveness monitor keeps probing
+// it and notices when it comes back.
+enum class Liveness { HEALTHY, SUSPECT, DOWN };
+
+struct TelemetryStats {
+    uint64_t requests;          // Telemetry calls
+    uint64_t exchanges;         // status requests that went to the robot
+    uint64_t coalesced;         // calls that joined an exchange already in flight
+};
+
+// one connected robot: its UDP socket, the ring every outgoing frame goes
+// through in order (but a FleetRelease frame, see Prepare) and the queue
+// telecommands wait in for the link
+class RobotSession {
+private:
+    int id;
+    uint32_t fleetSlot;                 // this robot's row in FleetTable
+    std::shared_ptr<UdpMux> mux;                // null when the robot has a socket of its own
+    UdpMux::Endpoint* endpoint;                 // its replies, with a mux
+    std::unique_ptr<MySocket> socket;
+    std::unique_ptr<SendRing> writer;           // after the socket, its thread sends on it
+    std::atomic<Liveness> liveness;
+    int misses;                                 // in a row, reactor thread only
+    std::atomic<std::chrono::steady_clock::rep> lastExchange;
+    std::unique_ptr<CommandQueue> commands;    // last, its sender stops before the socket goes
+
+    // the status exchange out now, calls arriving meanwhile join it
+    struct Flight {
+        std::vector<std::coroutine_handle<>> joined;
+        PacketBuffer reply;
+        int received = -1;
+        int error = EAGAIN;
+    };
+    std::shared_ptr<Flight> flight;             // reactor thread only, null when none is out
+    std::atomic<uint64_t> requests;
+    std::atomic<uint64_t> exchanges;
+    std::atomic<uint64_t> coalesced;
+
+    static auto join(Flight& flight);
+    static PacketBuffer encode(CMDType cmd, unsigned char* data, int size);
+    Task<int> receive(PacketBuffer& reply, int timeoutMs);
+    void recordExchange(bool replied);
+
+public:
+    static const int DOWNAFTER = 3;
+    static const int FENCEMS = 100;     // Prepare waits this long for the ring to empty
+
+    // writerCpu >= 0 pins the session's writer thread. With a mux the robot
+    // is reached through its shared sockets instead of a socket of its own,
+    // and its frames go out from the mux's writer for that socket.
+    RobotSession(int id, std::string ip, int port, const CommandLimits& limits, int receiveSize = DEFAULT_SIZE,
+                 int writerCpu = -1, std::shared_ptr<UdpMux> mux = nullptr);
+    ~RobotSession();
+
+    int GetId() const;
+    MySocket& GetSocket();
+    // encodes here, the writer thread stamps the count and sends.
+    // false when the ring is full and the packet was dropped
+    bool SendPacket(CMDType cmd, unsigned char* data = nullptr, int size = 0);
+    // an encoded frame carrying the next PktCount, for sending around the
+    // writer (see FleetRelease) on GetSocket's handle. Frames already in the
+    // ring go out first, waited for up to FENCEMS, so the prepared frame does
+    // not overtake them. Frames pushed after it, while the release waits for
+    // its target time, do go out ahead of it with higher counts: robots must
+    // accept a released frame whose count is below one already seen.
+    PacketBuffer Prepare(CMDType cmd, unsigned char* data = nullptr, int size = 0);
+    // Status request and its reply as one exchange, so concurrent callers
+    // never take each other's replies. Runs on Reactor::Instance(): the reply
+    // wait is an epoll registration, not a blocked thread. timeoutMs bounds
+    // the wait (-1, errno EAGAIN), < 0 waits for ever.
+    // Singleflight: a call made while an exchange is out sends nothing, it
+    // joins that exchange and shares its reply buffer, so the robot sees
+    // one request per round trip however many ask. A joiner whose exchange
+    // timed out before its own timeoutMs asks again for what is left.
+    // countsForLiveness: a missed reply feeds the breaker, pass false for
+    // waits shorter than the liveness timeout. A reply always counts.
+    Task<int> Telemetry(PacketBuffer& reply, int timeoutMs, bool countsForLiveness = true);
+    Task<bool> Drive(driveBody body);
+    // Telemetry for threads outside the reactor, blocks until it is done
+    int RequestTelemetry(PacketBuffer& reply, int waitMs = -1, bool countsForLiveness = true);
+    Liveness GetLiveness() const;
+    std::chrono::steady_clock::time_point LastExchange() const;
+    TelemetryStats GetTelemetryStats() const;
+    // receive timeout for plain GetData callers and kernel buffer sizes,
+    // safe while requests are in flight. Nothing to set on a shared socket
+    void SetSocketOptions(int receiveTimeoutMs, int bufferBytes);
+
+    // telecommands go out from the session's sender thread, see CommandQueue
+    bool QueueCommands(std::vector<Command>& batch, int& retryAfter);
+    CommandQueueStats CommandStats();
+    SendRingStats WriterStats() const;
+};
+
+// robots by id, shared so a request in flight keeps its session across a reconnect
+std::shared_ptr<RobotSession> getSession(int id);
+void setSession(int id, std::shared_ptr<RobotSession> session);
+void forEachSession(const std::function<void(RobotSession&)>& fn);
+// the same snapshot, for callers keeping sessions past the call
+void forEachSession(const std::function<void(const std::shared_ptr<RobotSession>&)>& fn);
@@ -0,0 +1,85 @@
+#include "SimRobot.h"
+#include "Impairment.h"
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+// Simulated robot for tests and benchmarks, optionally behind an impaired link:
+//   RobotSim --port=5000 --proxy-port=5001 --impair=loss=0.1,jitter=20 --seed=7
+// Point the server at the proxy port. --up and --down impair one direction only.
+// --busy-poll=us spins that long on the socket before each blocking receive.
+int main(int argc, char* argv[]) {
+    int port = 5000;
+    int proxyPort = 0;
+    uint64_t seed = 1;
+    int busyPollUs = 0;
+    ImpairmentProfile upProfile, downProfile;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        string key = arg.substr(0, eq);
+        string value = (eq == string::npos) ? "" : arg.substr(eq + 1);
+        string error;
+
+        bool ok = true;
+        if (key == "--port")
+            port = atoi(value.c_str());
+        else if (key == "--proxy-port")
+            proxyPort = atoi(value.c_str());
+        else if (key == "--busy-poll")
+            busyPollUs = atoi(value.c_str());
+        else if (key == "--seed")
+            seed = strtoull(value.c_str(), nullptr, 10);
+        else if (key == "--impair")
+            ok = parseImpairment(value, upProfile, error) && parseImpairment(value, downProfile, error);
+        else if (key == "--up")
+            ok = parseImpairment(value, upProfile, error);
+        else if (key == "--down")
+            ok = parseImpairment(value, downProfile, error);
+        else {
+            ok = false;
+            error = "unknown option " + key;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    // threads started from here on leave the signals to sigwait
+    sigset_t stop;
+    sigemptyset(&stop);
+    sigaddset(&stop, SIGINT);
+    sigaddset(&stop, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop, nullptr);
+
+    SimRobot robot(port, busyPollUs);
+    unique_ptr<ImpairmentProxy> proxy;
+    if (proxyPort > 0) {
+        proxy = make_unique<ImpairmentProxy>(proxyPort, "127.0.0.1", port, upProfile, downProfile, seed);
+        if (!proxy->Ok()) {
+            fprintf(stderr, "cannot listen on proxy port %d\n", proxyPort);
+            return 1;
+        }
+    }
+
+    int signal;
+    sigwait(&stop, &signal);
+
+    SimRobotStats stats = robot.Stats();
+    printf("robot: %llu commands, %llu status requests, %llu bad frames\n",
+        (unsigned long long)stats.commands, (unsigned long long)stats.requests, (unsigned long long)stats.badFrames);
+    if (proxy) {
+        for (auto [name, link] : { make_pair("up", proxy->UpStats()), make_pair("down", proxy->DownStats()) })
+            printf("%-4s %llu packets: %llu lost, %llu duplicated, %llu reordered, %llu corrupted, %llu over rate\n",
+                name, (unsigned long long)link.packets, (unsigned long long)link.lost,
+                (unsigned long long)link.duplicated, (unsigned long long)link.reordered,
+                (unsigned long long)link.corrupted, (unsigned long long)link.overflowed);
+    }
+    return 0;
+}
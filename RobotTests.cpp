@@ -0,0 +1,465 @@
+#include "PktDef.h"
+#include "MySocket.h"
+#include "SendRing.h"
+#include "SimRobot.h"
+#include "TimerWheel.h"
+#include "Config.h"
+#include "UdpMux.h"
+#include "FleetTable.h"
+#include "Impairment.h"
+#include "LivenessMonitor.h"
+#include "RobotSession.h"
+#include "TelemetryHub.h"
+#include "TelemetryPoller.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Behavioural tests run by ctest: wire decoding, the send path and the
+// pieces with timing or reload rules. Plain checks, no framework; a failed
+// check prints its line and the run exits non-zero. Loopback ports are
+// fixed, as in UnitTest1.
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n"; \
+            failures++; \
+        } \
+    } while (0)
+
+static PacketBuffer frameOf(PktDef& pkt) {
+    unsigned char* raw = pkt.genPacket();
+    PacketBuffer frame = BufferPool::Instance().Acquire(pkt.getLength());
+    memcpy(frame.Data(), raw, pkt.getLength());
+    frame.SetSize(pkt.getLength());
+    return frame;
+}
+
+// a status reply as the robot sends it, count echoed from the request
+static PacketBuffer replyOf(const telemetry& state) {
+    PktDef reply;
+    reply.setPktCount(state.LastPktCounter - 1);
+    reply.setCMD(CMDType::RESPONSE);
+    reply.setBodyData((unsigned char*)&state, sizeof(state));
+    return frameOf(reply);
+}
+
+static unsigned short countOf(const char* frame) {
+    unsigned short count;
+    memcpy(&count, frame, sizeof(count));
+    return count;
+}
+
+static void frameParsingTest() {
+    // a LastPktCounter below the body size used to be taken as the body length
+    for (uint8_t counter : { 1, 5, 6, 200 }) {
+        telemetry state{ counter, 42, 3, 1, 200, 80 };
+        PacketBuffer reply = replyOf(state);
+        unsigned char* raw = (unsigned char*)reply.Data();
+        CHECK(reply.Size() == (int)(HEADERSIZE + sizeof(telemetry) + 1));
+        CHECK(frameCommand(raw) == CMDType::RESPONSE);
+
+        telemetry sample{};
+        CHECK(frameTelemetry(raw, reply.Size(), sample));
+        CHECK(memcmp(&sample, &state, sizeof(state)) == 0);
+
+        // short read, bad CRC
+        CHECK(!frameTelemetry(raw, reply.Size() - 1, sample));
+        raw[reply.Size() - 1] ^= 0x01;
+        CHECK(!frameTelemetry(raw, reply.Size(), sample));
+    }
+
+    PktDef drive;
+    drive.setCMD(CMDType::DRIVE);
+    driveBody body{ FORWARD, 5, 90 };
+    drive.setBodyData((unsigned char*)&body, sizeof(body));
+    PacketBuffer driveFrame = frameOf(drive);
+    telemetry sample{};
+    CHECK(frameCommand((unsigned char*)driveFrame.Data()) == CMDType::DRIVE);
+    CHECK(!frameTelemetry((unsigned char*)driveFrame.Data(), driveFrame.Size(), sample));
+
+    PktDef sleep;
+    sleep.setCMD(CMDType::SLEEP);
+    PacketBuffer sleepFrame = frameOf(sleep);
+    CHECK(sleepFrame.Size() == MINFRAMESIZE);
+    CHECK(frameCommand((unsigned char*)sleepFrame.Data()) == CMDType::SLEEP);
+
+    // a bare status request carries no telemetry
+    PktDef request;
+    request.setCMD(CMDType::RESPONSE);
+    PacketBuffer requestFrame = frameOf(request);
+    CHECK(!frameTelemetry((unsigned char*)requestFrame.Data(), requestFrame.Size(), sample));
+}
+
+static void resealCRC(unsigned char* frame, int size) {
+    unsigned char crc = 0;
+    for (int i = 0; i < size - 1; i++)
+        crc += (unsigned char)__builtin_popcount(frame[i]);
+    frame[size - 1] = crc;
+}
+
+// what the binary /telemetry_request path forwards: validFrame and a RESPONSE
+static void replyFrameCheckTest() {
+    telemetry state{ 3, 42, 3, 1, 200, 80 };
+    PacketBuffer reply = replyOf(state);
+    int size = reply.Size();
+    CHECK(validFrame((unsigned char*)reply.Data(), size));
+
+    // 300 bytes whose CRC is only right for the first 300 % 256, where a
+    // size truncated to a byte used to stop checking
+    vector<unsigned char> oversize(300, 0x5a);
+    memcpy(oversize.data(), reply.Data(), size);
+    resealCRC(oversize.data(), 300 % 256);
+    CHECK(!validFrame(oversize.data(), (int)oversize.size()));
+
+    // length byte disagrees with what arrived, CRC still good
+    vector<unsigned char> wrongLength((unsigned char*)reply.Data(), (unsigned char*)reply.Data() + size);
+    wrongLength[LENGTHOFFSET] = (unsigned char)(size + 1);
+    resealCRC(wrongLength.data(), size);
+    CHECK(!validFrame(wrongLength.data(), size));
+
+    // well-formed but not a reply
+    PktDef drive;
+    drive.setCMD(CMDType::DRIVE);
+    driveBody body{ FORWARD, 5, 90 };
+    drive.setBodyData((unsigned char*)&body, sizeof(body));
+    PacketBuffer driveFrame = frameOf(drive);
+    CHECK(validFrame((unsigned char*)driveFrame.Data(), driveFrame.Size()));
+    CHECK(frameCommand((unsigned char*)driveFrame.Data()) != CMDType::RESPONSE);
+}
+
+// the sim applies a drive and reports it in its next status reply
+static void simRobotDriveTest() {
+    SimRobot robot(9500);
+    MySocket client(SocketType::CLIENT, "127.0.0.1", 9500, ConnectionType::UDP, 512);
+
+    PktDef drive;
+    drive.setCMD(CMDType::DRIVE);
+    driveBody body{ LEFT, 7, 90 };
+    drive.setBodyData((unsigned char*)&body, sizeof(body));
+    client.SendData((char*)drive.genPacket(), drive.getLength());
+
+    PktDef request;
+    request.setCMD(CMDType::RESPONSE);
+    client.SendData((char*)request.genPacket(), request.getLength());
+
+    CHECK(client.WaitForData(1000));
+    char reply[512];
+    int size = client.GetData(reply);
+    telemetry state{};
+    CHECK(frameTelemetry((unsigned char*)reply, size, state));
+    CHECK(state.LastCmd == (uint8_t)CMDType::DRIVE);
+    CHECK(state.LastCmdValue == LEFT);
+    CHECK(state.LastCmdSpeed == 90);
+    CHECK(robot.Stats().commands == 1);
+    CHECK(robot.Stats().badFrames == 0);
+}
+
+static void demuxEraseTest() {
+    DemuxTable<int> table;
+    const int KEYS = 5000;
+    for (int i = 1; i <= KEYS; i++)
+        CHECK(table.Insert((uint64_t)i * 7919, i));
+    CHECK(table.Size() == KEYS);
+
+    // erasing from the middle of probe runs must leave the rest reachable
+    for (int i = 1; i <= KEYS; i += 3)
+        CHECK(table.Erase((uint64_t)i * 7919) == i);
+    CHECK(table.Erase(1) == 0);
+    for (int i = 1; i <= KEYS; i++)
+        CHECK(table.Find((uint64_t)i * 7919) == ((i - 1) % 3 == 0 ? 0 : i));
+
+    for (int i = 1; i <= KEYS; i += 3)
+        CHECK(table.Insert((uint64_t)i * 7919, -i));
+    CHECK(!table.Insert(7919, 1));
+    CHECK(table.Size() == KEYS);
+    for (int i = 2; i <= KEYS; i++)
+        CHECK(table.Find((uint64_t)i * 7919) == ((i - 1) % 3 == 0 ? -i : i));
+
+    for (int i = 1; i <= KEYS; i++)
+        table.Erase((uint64_t)i * 7919);
+    CHECK(table.Size() == 0);
+    CHECK(table.Find(7919 * 2) == 0);
+}
+
+// frames pushed with stamp get consecutive counts, Stamp takes its place in
+// the sequence, unstamped frames keep theirs; every CRC still checks out
+static void sendRingStamp(SendRing& ring, MySocket& client, MySocket& receiver) {
+    auto waitSent = [&ring](uint64_t n) {
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(2);
+        while (ring.Stats().sent < n && chrono::steady_clock::now() < deadline)
+            this_thread::sleep_for(chrono::milliseconds(1));
+    };
+
+    PktDef drive;
+    drive.setCMD(CMDType::DRIVE);
+    driveBody body{ FORWARD, 5, 50 };
+    drive.setBodyData((unsigned char*)&body, sizeof(body));
+    PacketBuffer frame = frameOf(drive);
+
+    auto copy = [&frame] {
+        PacketBuffer out = BufferPool::Instance().Acquire(frame.Size());
+        memcpy(out.Data(), frame.Data(), frame.Size());
+        out.SetSize(frame.Size());
+        return out;
+    };
+
+    for (int i = 0; i < 5; i++)
+        CHECK(ring.Push(copy(), true));
+    CHECK(ring.Fence(2000));
+    CHECK(ring.Stats().sent == 5);
+    PacketBuffer around = copy();
+    ring.Stamp(around);
+    client.SendData(around.Data(), around.Size());
+    CHECK(ring.Push(copy(), true));
+    CHECK(ring.Push(copy(), false));
+    waitSent(7);
+
+    vector<unsigned short> counts;
+    PktDef pkt;
+    for (int i = 0; i < 8; i++) {
+        if (!receiver.WaitForData(1000))
+            break;
+        char bytes[512];
+        int size = receiver.GetData(bytes);
+        CHECK(size == frame.Size());
+        CHECK(pkt.checkCRC((unsigned char*)bytes, size));
+        counts.push_back(countOf(bytes));
+    }
+    vector<unsigned short> expected{ 2, 3, 4, 5, 6, 7, 8, countOf(frame.Data()) };
+    CHECK(counts == expected);
+}
+
+static void sendRingStampTest() {
+    MySocket receiver(SocketType::SERVER, "127.0.0.1", 9510, ConnectionType::UDP, 512);
+    MySocket client(SocketType::CLIENT, "127.0.0.1", 9510, ConnectionType::UDP, 512);
+    {
+        SendRing ring(client);
+        sendRingStamp(ring, client, receiver);
+    }
+    SharedWriter writer;
+    {
+        SendRing ring(client, writer);
+        sendRingStamp(ring, client, receiver);
+    }
+}
+
+static void timerWheelExpiryTest() {
+    TimerWheel wheel;
+    mutex lock;
+    vector<int> fired;
+    vector<bool> early;
+
+    auto now = TimerWheel::Clock::now();
+    auto add = [&](int ms) {
+        auto deadline = now + chrono::milliseconds(ms);
+        return wheel.Schedule(deadline, [&, ms, deadline] {
+            lock_guard<mutex> lk(lock);
+            fired.push_back(ms);
+            early.push_back(TimerWheel::Clock::now() < deadline);
+        });
+    };
+    add(30);
+    add(10);
+    uint64_t cancelled = add(15);
+    add(20);
+    add(70);    // past the first level
+    wheel.Cancel(cancelled);
+
+    this_thread::sleep_for(chrono::milliseconds(150));
+    lock_guard<mutex> lk(lock);
+    CHECK((fired == vector<int>{ 10, 20, 30, 70 }));
+    for (bool e : early)
+        CHECK(!e);
+    CHECK(wheel.Pending() == 0);
+}
+
+static void writeFile(const string& path, const string& text) {
+    ofstream out(path, ios::trunc);
+    out << text;
+}
+
+static void configReloadTest() {
+    string path = "/tmp/robottests-" + to_string(getpid()) + ".conf";
+    writeFile(path, "heartbeat_ms = 200\nhttp_port = 9000\n");
+
+    string configArg = "--config=" + path;
+    string overrideArg = "--liveness-timeout-ms=300";
+    char* argv[] = { (char*)"RobotTests", configArg.data(), overrideArg.data() };
+    Config config;
+    string error;
+    CHECK(config.Load(3, argv, error));
+    CHECK(config.heartbeatMs == 200);
+    CHECK(config.httpPort == 9000);
+    CHECK(config.livenessTimeoutMs == 300);
+
+    // live keys change in place, structural ones are reported and kept,
+    // the command line still wins
+    writeFile(path, "heartbeat_ms = 700\nhttp_port = 9100\nliveness_timeout_ms = 900\n");
+    vector<string> needsRestart;
+    CHECK(config.Reload(needsRestart, error));
+    CHECK(config.heartbeatMs == 700);
+    CHECK(config.httpPort == 9000);
+    CHECK(needsRestart == vector<string>{ "http_port" });
+    CHECK(config.livenessTimeoutMs == 300);
+
+    // a bad file changes nothing
+    writeFile(path, "heartbeat_ms = 800\nstream_backlog = lots\n");
+    needsRestart.clear();
+    CHECK(!config.Reload(needsRestart, error));
+    CHECK(!error.empty());
+    CHECK(config.heartbeatMs == 700);
+
+    remove(path.c_str());
+}
+
+// a peer that stops reading leaves the tail queued, none of it is lost
+static void framedFlushTest() {
+    MySocket server(SocketType::SERVER, "127.0.0.1", 9520, ConnectionType::TCP, 512);
+    MySocket client(SocketType::CLIENT, "127.0.0.1", 9520, ConnectionType::TCP, 512);
+    CHECK(server.SetFramed(true));
+    CHECK(client.SetFramed(true));
+    thread acceptor([&server] { server.ConnectTCP(); });
+    client.ConnectTCP();
+    acceptor.join();
+    // the receiver keeps its default window, a tiny one stalls on zero window probes
+    client.SetBufferSize(4096);
+    fcntl(client.GetHandle(), F_SETFL, fcntl(client.GetHandle(), F_GETFL) | O_NONBLOCK);
+
+    // far more than the socket buffers hold, in one send
+    const int FRAMES = 40000;
+    string frames;
+    for (int i = 0; i < FRAMES; i++) {
+        PktDef drive;
+        drive.setPktCount(i);
+        drive.setCMD(CMDType::DRIVE);
+        driveBody body{ FORWARD, 1, 10 };
+        drive.setBodyData((unsigned char*)&body, sizeof(body));
+        frames.append((char*)drive.genPacket(), drive.getLength());
+    }
+    client.SendData(frames.data(), (int)frames.size());
+    CHECK(!client.Flush());
+
+    int received = 0;
+    bool ordered = true;
+    thread reader([&] {
+        PktDef pkt;
+        char frame[512];
+        while (received < FRAMES && server.WaitForData(2000)) {
+            int size = server.GetData(frame);
+            if (size <= 0 || !pkt.checkCRC((unsigned char*)frame, size))
+                break;
+            ordered &= (countOf(frame) == received + 1);
+            received++;
+        }
+    });
+    bool flushed = false;
+    for (int i = 0; i < 50 && !flushed; i++)
+        flushed = client.Flush();
+    reader.join();
+    CHECK(flushed);
+    CHECK(received == FRAMES);
+    CHECK(ordered);
+    client.DisconnectTCP();
+}
+
+// LastCmd starts out as DRIVE's value, a robot nobody drove is not driving
+static void fleetDrivingTest() {
+    FleetTable table;
+    table.Update(table.Attach(1), telemetry{ 1, 50, 0, 0, 0, 0 });
+    table.Update(table.Attach(2), telemetry{ 4, 50, 0, (uint8_t)CMDType::DRIVE, FORWARD, 80 });
+    table.Update(table.Attach(3), telemetry{ 6, 50, 0, (uint8_t)CMDType::SLEEP, 0, 0 });
+    FleetSummary summary = table.Summarize();
+    CHECK(summary.reporting == 3);
+    CHECK(summary.driving == 1);
+    CHECK(summary.sleeping == 1);
+
+    // robot 2 restarts into its initial state
+    table.Update(table.Attach(2), telemetry{ 1, 50, 0, 0, 0, 0 });
+    CHECK(table.Summarize().driving == 0);
+}
+
+struct CountingSubscriber : TelemetrySubscriber {
+    atomic<int> samples{ 0 };
+    void Deliver(int, const telemetry&, const PacketBuffer&) override { samples++; }
+};
+
+// a robot slower than the poll rate but well inside the liveness timeout
+// stays healthy while watched: poll timeouts are not misses
+static void slowRobotLivenessTest() {
+    SimRobot robot(9530);
+    ImpairmentProfile link;
+    link.delayMs = 100;
+    ImpairmentProxy proxy(9531, "127.0.0.1", 9530, link, link, 1);
+    CHECK(proxy.Ok());
+
+    const int ID = 7;
+    CommandLimits limits;
+    auto session = make_shared<RobotSession>(ID, "127.0.0.1", 9531, limits);
+    setSession(ID, session);
+    {
+        TelemetryHub hub;
+        auto subscriber = make_shared<CountingSubscriber>();
+        hub.Subscribe(ID, subscriber);
+        atomic<int> pollMs{ 100 };
+        atomic<int> heartbeatMs{ 300 };
+        atomic<int> livenessTimeoutMs{ 500 };
+        TelemetryPoller poller(hub, pollMs);
+        LivenessMonitor monitor(heartbeatMs, livenessTimeoutMs);
+
+        bool healthy = true;
+        for (int i = 0; i < 75; i++) {
+            healthy &= (session->GetLiveness() == Liveness::HEALTHY);
+            this_thread::sleep_for(chrono::milliseconds(20));
+        }
+        CHECK(healthy);
+
+        // a request that joins a poll's exchange outlives it and gets its reply
+        PacketBuffer reply;
+        int received = session->RequestTelemetry(reply, 500);
+        telemetry sample{};
+        CHECK(received > 0 && frameTelemetry((unsigned char*)reply.Data(), received, sample));
+        hub.Unsubscribe(ID, subscriber);
+    }
+    CHECK(session->GetLiveness() == Liveness::HEALTHY);
+    setSession(ID, nullptr);
+}
+
+int main() {
+    struct Test {
+        const char* name;
+        void (*run)();
+    };
+    const Test tests[] = {
+        { "frameParsing", frameParsingTest },
+        { "replyFrameCheck", replyFrameCheckTest },
+        { "simRobotDrive", simRobotDriveTest },
+        { "demuxErase", demuxEraseTest },
+        { "sendRingStamp", sendRingStampTest },
+        { "timerWheelExpiry", timerWheelExpiryTest },
+        { "configReload", configReloadTest },
+        { "framedFlush", framedFlushTest },
+        { "fleetDriving", fleetDrivingTest },
+        { "slowRobotLiveness", slowRobotLivenessTest },
+    };
+
+    for (const Test& test : tests) {
+        int before = failures;
+        test.run();
+        cout << (failures == before ? "ok     " : "FAILED ") << test.name << endl;
+    }
+    return failures ? 1 : 0;
+}
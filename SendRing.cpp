@@ -0,0 +1,231 @@
+#include "SendRing.h"
+#include "PktDef.h"
+#include "FlightRecorder.h"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+
+// the first frame has always gone out as 2, setPktCount(1) stores one past its argument
+SendRing::SendRing(MySocket& socket, int cpu, int robot)
+    : socket(socket), robot(robot), tail(0), head(0), count(1), sleeping(false), wake(0), running(true),
+      sent(0), batches(0), full(0), shared(nullptr), queued(false)
+{
+    for (uint64_t i = 0; i < CAPACITY; i++) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+        slots[i].stamp = false;
+    }
+    worker = std::thread(&SendRing::run, this, cpu);
+}
+
+SendRing::SendRing(MySocket& socket, SharedWriter& writer, int robot)
+    : socket(socket), robot(robot), tail(0), head(0), count(1), sleeping(false), wake(0), running(true),
+      sent(0), batches(0), full(0), shared(&writer), queued(false)
+{
+    for (uint64_t i = 0; i < CAPACITY; i++) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+        slots[i].stamp = false;
+    }
+}
+
+// frames already pushed still go out
+SendRing::~SendRing() {
+    if (shared) {
+        shared->Detach(this);
+        drain();
+        return;
+    }
+    running = false;
+    wake.fetch_add(1);
+    wake.notify_one();
+    worker.join();
+}
+
+bool SendRing::Push(PacketBuffer frame, bool stamp) {
+    uint64_t pos = tail.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+        slot = &slots[pos & (CAPACITY - 1)];
+        int64_t lag = (int64_t)(slot->sequence.load(std::memory_order_acquire) - pos);
+        if (lag == 0) {
+            if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (lag < 0) {
+            // the writer has not freed this slot from the last lap
+            full++;
+            return false;
+        }
+        else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->frame = std::move(frame);
+    slot->stamp = stamp;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    // the writer clears queued with an exchange before it drains, so it sees this frame
+    if (shared) {
+        if (!queued.exchange(true, std::memory_order_acq_rel))
+            shared->Ready(this);
+        return true;
+    }
+
+    // pairs with the fence in run, either the writer sees the frame or we see it asleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed)) {
+        wake.fetch_add(1);
+        wake.notify_one();
+    }
+    return true;
+}
+
+SendRingStats SendRing::Stats() const {
+    return { sent.load(), batches.load(), full.load() };
+}
+
+bool SendRing::ready() const {
+    return slots[head & (CAPACITY - 1)].sequence.load(std::memory_order_acquire) == head + 1;
+}
+
+// new count into an encoded frame, the popcount CRC follows the bits that changed
+static void stampCount(PacketBuffer& frame, uint16_t count) {
+    if (frame.Size() < MINFRAMESIZE)
+        return;
+    unsigned char* bytes = (unsigned char*)frame.Data();
+    uint16_t old;
+    memcpy(&old, bytes, sizeof(old));
+    memcpy(bytes, &count, sizeof(count));
+    bytes[frame.Size() - 1] += (unsigned char)(std::popcount(count) - std::popcount(old));
+}
+
+// every claimed slot is sent in claim order, so sent catches up with tail
+bool SendRing::Fence(int waitMs) {
+    uint64_t pushed = tail.load(std::memory_order_acquire);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(waitMs);
+    while (sent.load(std::memory_order_acquire) < pushed) {
+        if (std::chrono::steady_clock::now() >= deadline)
+            return false;
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+void SendRing::Stamp(PacketBuffer& frame) {
+    stampCount(frame, count.fetch_add(1, std::memory_order_relaxed) + 1);
+}
+
+size_t SendRing::drain() {
+    size_t n = 0;
+    while (n < CAPACITY && ready()) {
+        Slot& slot = slots[head & (CAPACITY - 1)];
+        PacketBuffer frame = std::move(slot.frame);
+        bool stamp = slot.stamp;
+        slot.sequence.store(head + CAPACITY, std::memory_order_release);
+        head++;
+
+        if (stamp)
+            stampCount(frame, count.fetch_add(1, std::memory_order_relaxed) + 1);
+        FlightRecorder::Packet(FlightKind::PACKET_SENT, robot, frame.Data(), frame.Size());
+        socket.QueueData(frame.Data(), frame.Size());
+        n++;
+    }
+    if (n > 0) {
+        socket.Flush();
+        sent += n;
+        batches++;
+    }
+    return n;
+}
+
+void SendRing::run(int cpu) {
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    int idle = 0;
+    while (true) {
+        if (drain() > 0) {
+            idle = 0;
+            continue;
+        }
+        if (!running)
+            return;
+        if (++idle < SPINS) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // sleep until a push sees us sleeping, rechecking after saying so
+        uint32_t seen = wake.load();
+        sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!ready() && running)
+            wake.wait(seen);
+        sleeping.store(false, std::memory_order_relaxed);
+        idle = 0;
+    }
+}
+
+SharedWriter::SharedWriter(int cpu) : current(nullptr), running(true) {
+    worker = std::thread(&SharedWriter::run, this, cpu);
+}
+
+SharedWriter::~SharedWriter() {
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        running = false;
+    }
+    work.notify_one();
+    worker.join();
+}
+
+void SharedWriter::Ready(SendRing* ring) {
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        ready.push_back(ring);
+    }
+    work.notify_one();
+}
+
+void SharedWriter::Detach(SendRing* ring) {
+    std::unique_lock<std::mutex> lk(lock);
+    ready.erase(std::remove(ready.begin(), ready.end(), ring), ready.end());
+    idle.wait(lk, [&] { return current != ring; });
+}
+
+void SharedWriter::run(int cpu) {
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    std::unique_lock<std::mutex> lk(lock);
+    while (true) {
+        if (ready.empty()) {
+            if (!running)
+                return;
+            work.wait(lk);
+            continue;
+        }
+        current = ready.front();
+        ready.pop_front();
+        lk.unlock();
+
+        // a push from here on queues the ring again
+        current->queued.exchange(false, std::memory_order_acq_rel);
+        current->drain();
+
+        lk.lock();
+        current = nullptr;
+        idle.notify_all();
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "BufferPool.h"
+#include "MySocket.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+struct SendRingStats {
+    uint64_t sent;
+    uint64_t batches;           // writer wakeups that sent something
+    uint64_t full;              // pushes refused with the ring full
+};
+
+// Bounded lock-free multi-producer single-consumer ring in front of one
+// robot socket. A producer claims a slot with a CAS on the tail and
+// publishes it through the slot's sequence number (Vyukov's bounded
+// queue), the writer thread takes slots in claim order, so frames leave in
+// the order they were pushed and handlers never meet in the kernel.
+// Frames pushed with stamp set get the next PktCount written in by the
+// writer, so the counts on the wire always increase whatever order the
+// handlers ran in. Everything ready when the writer looks goes out as one
+// batch, QueueData per frame and one Flush.
+// A ring made on a SharedWriter has no thread of its own: a push that
+// finds it idle queues it on the writer, whose one thread drains every
+// ring sending on the same socket.
+class SharedWriter;
+
+class SendRing {
+public:
+    static const uint64_t CAPACITY = 256;   // power of two
+    static const int SPINS = 64;            // empty looks before the writer sleeps
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence;
+        PacketBuffer frame;
+        bool stamp;
+    };
+
+    MySocket& socket;
+    int robot;                                  // for the flight recorder
+    Slot slots[CAPACITY];
+    alignas(64) std::atomic<uint64_t> tail;     // next slot to claim
+    alignas(64) uint64_t head;                  // next slot to send, writer only
+    std::atomic<uint16_t> count;                // last PktCount stamped
+    std::atomic<bool> sleeping;
+    std::atomic<uint32_t> wake;                 // the sleeping writer waits on this
+    std::atomic<bool> running;
+    std::atomic<uint64_t> sent;
+    std::atomic<uint64_t> batches;
+    std::atomic<uint64_t> full;
+    SharedWriter* shared;                       // null when the ring has its own thread
+    std::atomic<bool> queued;                   // waiting on the shared writer
+    std::thread worker;
+
+    friend class SharedWriter;
+    void run(int cpu);
+    bool ready() const;
+    size_t drain();
+
+public:
+    // cpu >= 0 pins the writer thread to that cpu
+    explicit SendRing(MySocket& socket, int cpu = -1, int robot = -1);
+    // drained by writer's thread, which must outlive the ring
+    SendRing(MySocket& socket, SharedWriter& writer, int robot = -1);
+    ~SendRing();
+
+    // false when the ring is full, the frame is then dropped
+    bool Push(PacketBuffer frame, bool stamp);
+    // true once every frame pushed before the call has gone out, false
+    // after waitMs with some still queued
+    bool Fence(int waitMs);
+    // the next PktCount into a frame that goes out around the ring
+    // (FleetRelease), in sequence with the frames stamped after it
+    void Stamp(PacketBuffer& frame);
+    SendRingStats Stats() const;
+};
+
+// One writer thread for many rings, each drained in turn once a push has
+// queued it, so the robots behind one shared socket (UdpMux) cost one
+// thread instead of one each.
+class SharedWriter {
+private:
+    std::mutex lock;
+    std::condition_variable work;
+    std::condition_variable idle;               // a ring finished draining, for Detach
+    std::deque<SendRing*> ready;
+    SendRing* current;                          // being drained outside the lock
+    bool running;
+    std::thread worker;
+
+    void run(int cpu);
+
+public:
+    // cpu >= 0 pins the writer thread
+    explicit SharedWriter(int cpu = -1);
+    // every ring is gone by now
+    ~SharedWriter();
+
+    void Ready(SendRing* ring);
+    // the ring is neither queued nor being drained once this returns
+    void Detach(SendRing* ring);
+};
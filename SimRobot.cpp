@@ -0,0 +1,73 @@
+#include "SimRobot.h"
+#include <cerrno>
+#include <cstring>
+
+SimRobot::SimRobot(int port, int busyPollUs)
+    : state{}, running(true), commands(0), requests(0), badFrames(0)
+{
+    socket = std::make_unique<MySocket>(SocketType::SERVER, "127.0.0.1", port, ConnectionType::UDP, DEFAULT_SIZE);
+    // wakes now and then to notice shutdown
+    socket->SetReceiveTimeout(100);
+    socket->SetBusyPoll(busyPollUs);
+    worker = std::thread(&SimRobot::run, this);
+}
+
+SimRobot::~SimRobot() {
+    running = false;
+    worker.join();
+}
+
+SimRobotStats SimRobot::Stats() const {
+    return { commands.load(), requests.load(), badFrames.load() };
+}
+
+void SimRobot::handle(unsigned char* frame, int size) {
+    PktDef pkt;
+    if (size < MINFRAMESIZE || frame[LENGTHOFFSET] != size || !pkt.checkCRC(frame, size)) {
+        badFrames++;
+        return;
+    }
+
+    // straight off the frame, the raw PktDef constructor reads the body a byte late
+    unsigned short count;
+    memcpy(&count, frame, sizeof(count));
+    state.LastPktCounter = (uint8_t)count;
+
+    switch (frameCommand(frame)) {
+    case CMDType::DRIVE:
+        commands++;
+        if (frame[LENGTHOFFSET] >= MINFRAMESIZE + sizeof(driveBody)) {
+            driveBody body;
+            memcpy(&body, frame + HEADERSIZE, sizeof(body));
+            state.LastCmd = (uint8_t)CMDType::DRIVE;
+            state.LastCmdValue = body.direction;
+            state.LastCmdSpeed = body.speed;
+            state.CurrentGrade = (uint8_t)(state.CurrentGrade + body.duration % 3);
+        }
+        break;
+    case CMDType::SLEEP:
+        commands++;
+        state.LastCmd = (uint8_t)CMDType::SLEEP;
+        break;
+    case CMDType::RESPONSE: {
+        requests++;
+        PktDef reply;
+        // setPktCount stores one past its argument, this echoes the request's count
+        reply.setPktCount(count - 1);
+        reply.setCMD(CMDType::RESPONSE);
+        reply.setBodyData((unsigned char*)&state, sizeof(state));
+        unsigned char* bytes = reply.genPacket();
+        socket->SendData((char*)bytes, reply.getLength());
+        break;
+    }
+    }
+}
+
+void SimRobot::run() {
+    char frame[DEFAULT_SIZE];
+    while (running) {
+        int size = socket->GetData(frame);
+        if (size > 0)
+            handle((unsigned char*)frame, size);
+    }
+}
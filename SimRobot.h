@@ -0,0 +1,36 @@
+#pragma once
+#include "MySocket.h"
+#include "PktDef.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+
+struct SimRobotStats {
+    uint64_t commands;          // drive and sleep
+    uint64_t requests;          // status requests answered
+    uint64_t badFrames;         // failed the CRC or too short, dropped like the robot does
+};
+
+// Stand-in robot on a loopback UDP port. Drive and sleep update its state,
+// a status request is answered with telemetry whose LastPktCounter is the
+// request's own count, so callers can match replies to requests.
+class SimRobot {
+private:
+    std::unique_ptr<MySocket> socket;
+    telemetry state;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> commands;
+    std::atomic<uint64_t> requests;
+    std::atomic<uint64_t> badFrames;
+    std::thread worker;
+
+    void run();
+    void handle(unsigned char* frame, int size);
+
+public:
+    // busyPollUs > 0 spins on the socket before blocking, see MySocket::SetBusyPoll
+    explicit SimRobot(int port, int busyPollUs = 0);
+    ~SimRobot();
+
+    SimRobotStats Stats() const;
+};
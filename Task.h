@@ -0,0 +1,142 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+// Lazy coroutine: nothing runs until it is awaited, the awaiting coroutine
+// is resumed straight from the task's end (symmetric transfer, no stack
+// growth however long the chain). Move-only, the frame dies with the Task.
+// No exceptions cross it, the server does not use them.
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation;
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> done) noexcept {
+            auto next = done.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { std::terminate(); }
+};
+
+template <typename Promise>
+class TaskBase {
+protected:
+    std::coroutine_handle<Promise> handle;
+
+public:
+    explicit TaskBase(std::coroutine_handle<Promise> handle) : handle(handle) {}
+    TaskBase(TaskBase&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    TaskBase& operator=(TaskBase&& other) noexcept {
+        if (this != &other) {
+            if (handle)
+                handle.destroy();
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    TaskBase(const TaskBase&) = delete;
+    TaskBase& operator=(const TaskBase&) = delete;
+    ~TaskBase() {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return !handle || handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+    Task<T> get_return_object() { return Task<T>(std::coroutine_handle<TaskPromise>::from_promise(*this)); }
+    void return_value(T result) { value = std::move(result); }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+};
+
+}
+
+template <typename T>
+class Task : public detail::TaskBase<detail::TaskPromise<T>> {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : detail::TaskBase<promise_type>(handle) {}
+    T await_resume() { return std::move(*this->handle.promise().value); }
+};
+
+template <>
+class Task<void> : public detail::TaskBase<detail::TaskPromise<void>> {
+public:
+    using promise_type = detail::TaskPromise<void>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : detail::TaskBase<promise_type>(handle) {}
+    void await_resume() {}
+};
+
+inline Task<void> detail::TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+}
+
+// Eager coroutine that frees itself when it ends, for starting a Task
+// nobody awaits.
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// Children start right away on the calling thread and Wait resumes once
+// the last has finished. Not thread safe: children and the waiter belong
+// to one thread, normally the reactor's.
+class TaskGroup {
+private:
+    int running = 0;
+    std::coroutine_handle<> waiter;
+
+    static Detached child(TaskGroup& group, Task<void> task) {
+        co_await task;
+        if (--group.running == 0 && group.waiter)
+            std::exchange(group.waiter, {}).resume();
+    }
+
+public:
+    void Spawn(Task<void> task) {
+        running++;
+        child(*this, std::move(task));
+    }
+
+    auto Wait() {
+        struct Awaiter {
+            TaskGroup& group;
+            bool await_ready() const noexcept { return group.running == 0; }
+            void await_suspend(std::coroutine_handle<> awaiting) noexcept { group.waiter = awaiting; }
+            void await_resume() noexcept {}
+        };
+        return Awaiter{ *this };
+    }
+};
@@ -0,0 +1,60 @@
+#include "TelemetryHub.h"
+#include "TelemetryJson.h"
+#include <algorithm>
+
+void TelemetryHub::Subscribe(int robot, std::shared_ptr<TelemetrySubscriber> subscriber) {
+    std::lock_guard<std::mutex> lk(lock);
+    auto& current = robots[robot];
+    auto next = current ? std::make_shared<List>(*current) : std::make_shared<List>();
+    next->push_back(std::move(subscriber));
+    current = std::move(next);
+}
+
+void TelemetryHub::Unsubscribe(int robot, const std::shared_ptr<TelemetrySubscriber>& subscriber) {
+    std::lock_guard<std::mutex> lk(lock);
+    auto it = robots.find(robot);
+    if (it == robots.end())
+        return;
+
+    auto next = std::make_shared<List>(*it->second);
+    next->erase(std::remove(next->begin(), next->end(), subscriber), next->end());
+    if (next->empty())
+        robots.erase(it);
+    else
+        it->second = std::move(next);
+}
+
+PacketBuffer TelemetryHub::Encode(const telemetry& sample) {
+    PacketBuffer buffer = BufferPool::Instance().Acquire(TELEMETRY_JSON_MAX);
+    buffer.SetSize((int)writeTelemetryJson(sample, buffer.Data()));
+    return buffer;
+}
+
+void TelemetryHub::Publish(int robot, const telemetry& sample) {
+    std::shared_ptr<const List> subscribers;
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        auto it = robots.find(robot);
+        if (it == robots.end())
+            return;
+        subscribers = it->second;
+    }
+
+    PacketBuffer encoded = Encode(sample);
+    for (auto& subscriber : *subscribers)
+        subscriber->Deliver(robot, sample, encoded);
+}
+
+std::vector<int> TelemetryHub::Subscribed() {
+    std::vector<int> ids;
+    std::lock_guard<std::mutex> lk(lock);
+    for (auto& entry : robots)
+        ids.push_back(entry.first);
+    return ids;
+}
+
+size_t TelemetryHub::Subscribers(int robot) {
+    std::lock_guard<std::mutex> lk(lock);
+    auto it = robots.find(robot);
+    return (it != robots.end()) ? it->second->size() : 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "BufferPool.h"
+#include "PktDef.h"
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// One consumer of published samples (a set of SSE streams, a WebSocket, ...).
+// Deliver runs on the publishing thread and must not block; the JSON sample
+// is shared with every other subscriber and must not be modified, raw is the
+// same sample decoded for subscribers that look at its fields.
+class TelemetrySubscriber {
+public:
+    virtual ~TelemetrySubscriber() = default;
+    virtual void Deliver(int robot, const telemetry& raw, const PacketBuffer& sample) = 0;
+};
+
+// Serialize-once fan-out. Publish encodes a sample to JSON a single time into
+// a pooled, ref-counted buffer and hands that same buffer to every subscriber
+// of the robot, so the cost per sample does not grow with the subscriber
+// count beyond one handle copy each. Subscriber lists are copy-on-write:
+// Publish takes a snapshot under the lock and delivers without it.
+class TelemetryHub {
+private:
+    using List = std::vector<std::shared_ptr<TelemetrySubscriber>>;
+
+    std::mutex lock;
+    std::unordered_map<int, std::shared_ptr<const List>> robots;
+
+public:
+    void Subscribe(int robot, std::shared_ptr<TelemetrySubscriber> subscriber);
+    void Unsubscribe(int robot, const std::shared_ptr<TelemetrySubscriber>& subscriber);
+
+    void Publish(int robot, const telemetry& sample);
+    std::vector<int> Subscribed();          // robots with at least one subscriber
+    size_t Subscribers(int robot);
+
+    // the JSON every subscriber shares, in a pooled buffer
+    static PacketBuffer Encode(const telemetry& sample);
+};
@@ -0,0 +1,83 @@
+#include "TelemetryJson.h"
+#include <array>
+#include <cstring>
+
+namespace {
+
+// one entry per uint8_t value, digits left aligned so a fixed 3 byte copy
+// followed by an advance of len bytes formats any value without branching
+struct DigitEntry {
+    char digits[3];
+    uint8_t len;
+};
+
+constexpr std::array<DigitEntry, 256> makeDigitTable() {
+    std::array<DigitEntry, 256> table{};
+    for (int v = 0; v < 256; v++) {
+        DigitEntry& e = table[v];
+        if (v >= 100) {
+            e.digits[0] = char('0' + v / 100);
+            e.digits[1] = char('0' + (v / 10) % 10);
+            e.digits[2] = char('0' + v % 10);
+            e.len = 3;
+        }
+        else if (v >= 10) {
+            e.digits[0] = char('0' + v / 10);
+            e.digits[1] = char('0' + v % 10);
+            e.len = 2;
+        }
+        else {
+            e.digits[0] = char('0' + v);
+            e.len = 1;
+        }
+    }
+    return table;
+}
+
+constexpr std::array<DigitEntry, 256> digitTable = makeDigitTable();
+
+// fixed text that precedes each field, in telemetry struct order
+constexpr std::string_view keyTemplate[6] = {
+    "{\"LastPktCounter\":",
+    ",\"CurrentGrade\":",
+    ",\"HitCount\":",
+    ",\"LastCmd\":",
+    ",\"LastCmdValue\":",
+    ",\"LastCmdSpeed\":"
+};
+
+constexpr size_t maxJsonSize() {
+    size_t size = 1; // closing brace
+    for (const auto& key : keyTemplate)
+        size += key.size() + 3;
+    return size;
+}
+static_assert(maxJsonSize() <= TELEMETRY_JSON_MAX, "TELEMETRY_JSON_MAX too small");
+
+inline char* appendField(char* out, std::string_view key, uint8_t value) {
+    memcpy(out, key.data(), key.size());
+    out += key.size();
+    const DigitEntry& e = digitTable[value];
+    memcpy(out, e.digits, 3);
+    return out + e.len;
+}
+
+}
+
+size_t writeTelemetryJson(const telemetry& data, char* out) {
+    char* p = out;
+    p = appendField(p, keyTemplate[0], data.LastPktCounter);
+    p = appendField(p, keyTemplate[1], data.CurrentGrade);
+    p = appendField(p, keyTemplate[2], data.HitCount);
+    p = appendField(p, keyTemplate[3], data.LastCmd);
+    p = appendField(p, keyTemplate[4], data.LastCmdValue);
+    p = appendField(p, keyTemplate[5], data.LastCmdSpeed);
+    *p++ = '}';
+    return p - out;
+}
+
+std::string_view serializeTelemetry(const telemetry& data) {
+    thread_local char buffer[TELEMETRY_JSON_MAX];
+    size_t len = writeTelemetryJson(data, buffer);
+    return std::string_view(buffer, len);
+}
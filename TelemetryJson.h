@@ -0,0 +1,15 @@
+#pragma once
+#include "PktDef.h"
+#include <cstddef>
+#include <string_view>
+
+// longest telemetry object: the fixed keys plus six 3 digit values
+const int TELEMETRY_JSON_MAX = 128;
+
+// writes the telemetry object as JSON into out (at least TELEMETRY_JSON_MAX bytes)
+// and returns the number of bytes written, no allocation
+size_t writeTelemetryJson(const telemetry& data, char* out);
+
+// serializes into a reusable per-thread buffer, the view stays valid until the
+// next call on the same thread
+std::string_view serializeTelemetry(const telemetry& data);
@@ -0,0 +1,79 @@
+#include "TelemetryLongPoll.h"
+#include <algorithm>
+
+TelemetryLongPoll::TelemetryLongPoll(TelemetryHub& hub) : hub(hub), nextId(1) {}
+
+void TelemetryLongPoll::Park(int robot, uint8_t after, std::chrono::milliseconds timeout, Done done) {
+    std::lock_guard<std::mutex> lk(lock);
+    uint64_t id = nextId++;
+    uint64_t timer = timers.Schedule(TimerWheel::Clock::now() + timeout, [this, id] { expire(id); });
+    waiters.emplace(id, Waiter{ robot, after, timer, std::move(done) });
+
+    // the first waiter on a robot starts its polling, the last one out stops it
+    auto& ids = byRobot[robot];
+    if (ids.empty())
+        hub.Subscribe(robot, shared_from_this());
+    ids.push_back(id);
+}
+
+size_t TelemetryLongPoll::Parked() {
+    std::lock_guard<std::mutex> lk(lock);
+    return waiters.size();
+}
+
+void TelemetryLongPoll::forget(int robot, uint64_t id) {
+    auto it = byRobot.find(robot);
+    if (it == byRobot.end())
+        return;
+    auto& ids = it->second;
+    ids.erase(std::find(ids.begin(), ids.end(), id));
+    if (ids.empty()) {
+        byRobot.erase(it);
+        hub.Unsubscribe(robot, shared_from_this());
+    }
+}
+
+// a sample may have answered it between the timer firing and getting here
+void TelemetryLongPoll::expire(uint64_t id) {
+    Done done;
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        auto it = waiters.find(id);
+        if (it == waiters.end())
+            return;
+        done = std::move(it->second.done);
+        forget(it->second.robot, id);
+        waiters.erase(it);
+    }
+    done(nullptr);
+}
+
+void TelemetryLongPoll::Deliver(int robot, const telemetry& raw, const PacketBuffer& sample) {
+    std::vector<Done> answered;
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        auto it = byRobot.find(robot);
+        if (it == byRobot.end())
+            return;
+
+        auto& ids = it->second;
+        for (size_t i = 0; i < ids.size();) {
+            auto waiter = waiters.find(ids[i]);
+            if (waiter->second.after == raw.LastPktCounter) {
+                i++;
+                continue;
+            }
+            timers.Cancel(waiter->second.timer);
+            answered.push_back(std::move(waiter->second.done));
+            waiters.erase(waiter);
+            ids[i] = ids.back();
+            ids.pop_back();
+        }
+        if (ids.empty()) {
+            byRobot.erase(it);
+            hub.Unsubscribe(robot, shared_from_this());
+        }
+    }
+    for (auto& done : answered)
+        done(&sample);
+}
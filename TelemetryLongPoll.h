@@ -0,0 +1,48 @@
+#pragma once
+#include "TelemetryHub.h"
+#include "TimerWheel.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Parked requests for telemetry newer than what a client already has. Each
+// waits for the first published sample whose LastPktCounter is not the one
+// it passed, or for its timeout. While anyone waits on a robot this is one
+// hub subscriber for it, so the poller samples the robot every
+// telemetry_poll_ms and one sample answers every waiter at once. A waiter
+// holds a callback and a timer, no thread.
+class TelemetryLongPoll : public TelemetrySubscriber, public std::enable_shared_from_this<TelemetryLongPoll> {
+public:
+    // the JSON sample, null when the timeout came first. Runs on the
+    // publishing or the timer thread and must not block
+    using Done = std::function<void(const PacketBuffer* sample)>;
+
+private:
+    struct Waiter {
+        int robot;
+        uint8_t after;
+        uint64_t timer;
+        Done done;
+    };
+
+    TelemetryHub& hub;
+    std::mutex lock;
+    uint64_t nextId;
+    std::unordered_map<uint64_t, Waiter> waiters;
+    std::unordered_map<int, std::vector<uint64_t>> byRobot;
+    TimerWheel timers;                      // last, so its thread stops first
+
+    void expire(uint64_t id);
+    void forget(int robot, uint64_t id);    // caller holds lock
+
+public:
+    explicit TelemetryLongPoll(TelemetryHub& hub);
+
+    void Park(int robot, uint8_t after, std::chrono::milliseconds timeout, Done done);
+    size_t Parked();
+    void Deliver(int robot, const telemetry& raw, const PacketBuffer& sample) override;
+};
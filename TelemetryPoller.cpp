@@ -0,0 +1,74 @@
+#include "TelemetryPoller.h"
+#include "RobotSession.h"
+#include "Reactor.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+TelemetryPoller::TelemetryPoller(TelemetryHub& hub, std::atomic<int>& intervalMs, TelemetryStore* store)
+    : hub(hub), intervalMs(intervalMs), store(store), running(true)
+{
+    worker = std::thread(&TelemetryPoller::run, this);
+}
+
+TelemetryPoller::~TelemetryPoller() {
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        running = false;
+    }
+    wakeup.notify_all();
+    worker.join();
+}
+
+Task<void> TelemetryPoller::pollRobot(int robot) {
+    // down robots are left to the liveness monitor, they would only cost a timeout a round
+    auto session = getSession(robot);
+    if (!session || session->GetLiveness() == Liveness::DOWN)
+        co_return;
+
+    // a reply later than the next round is no use; a miss at this rate says
+    // nothing about liveness, that is the liveness monitor's call
+    PacketBuffer reply;
+    int received = co_await session->Telemetry(reply, std::max(intervalMs.load(), 10), false);
+    if (received <= 0)
+        co_return;
+
+    telemetry sample;
+    if (!frameTelemetry((unsigned char*)reply.Data(), received, sample))
+        co_return;
+    if (store)
+        store->Append(robot, sample);
+    hub.Publish(robot, sample);
+}
+
+Task<size_t> TelemetryPoller::pollRound(std::vector<int> robots) {
+    TaskGroup group;
+    for (int robot : robots)
+        group.Spawn(pollRobot(robot));
+    co_await group.Wait();
+    co_return robots.size();
+}
+
+void TelemetryPoller::run() {
+    std::unique_lock<std::mutex> lk(lock);
+    while (running) {
+        auto next = std::chrono::steady_clock::now() + std::chrono::milliseconds(intervalMs.load());
+
+        lk.unlock();
+        std::vector<int> robots;
+        if (store)
+            forEachSession([&robots](RobotSession& session) { robots.push_back(session.GetId()); });
+        else
+            robots = hub.Subscribed();
+        if (!robots.empty()) {
+            TraceRequest traced;
+            TraceSpan span("telemetry poll");
+            Reactor::Instance().Run(pollRound(std::move(robots)));
+        }
+        lk.lock();
+
+        wakeup.wait_until(lk, next, [this] { return !running; });
+    }
+}
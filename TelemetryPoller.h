@@ -0,0 +1,35 @@
+#pragma once
+#include "TelemetryHub.h"
+#include "TelemetryStore.h"
+#include "Task.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Asks each robot that has a hub subscriber for a status sample every
+// intervalMs and publishes the reply. Robots nobody watches are never
+// polled, and however many clients watch a robot it is asked once per round.
+// With a store every connected robot is polled and each sample recorded.
+// A round's exchanges are all in flight at once on the reactor, so a robot
+// that misses its reply holds up nobody else. Polls never count as misses
+// for the liveness breaker, their timeout is only the interval.
+class TelemetryPoller {
+private:
+    TelemetryHub& hub;
+    std::atomic<int>& intervalMs;
+    TelemetryStore* store;
+    bool running;
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::thread worker;
+
+    void run();
+    Task<void> pollRobot(int robot);
+    Task<size_t> pollRound(std::vector<int> robots);
+
+public:
+    TelemetryPoller(TelemetryHub& hub, std::atomic<int>& intervalMs, TelemetryStore* store = nullptr);
+    ~TelemetryPoller();
+};
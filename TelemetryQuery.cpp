@@ -0,0 +1,407 @@
+#include "TelemetryQuery.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+static std::string trim(const std::string& s) {
+    size_t first = s.find_first_not_of(" \t");
+    if (first == std::string::npos)
+        return "";
+    size_t last = s.find_last_not_of(" \t");
+    return s.substr(first, last - first + 1);
+}
+
+static std::vector<std::string> splitList(const std::string& text) {
+    std::vector<std::string> items;
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ','))
+        if (!trim(item).empty())
+            items.push_back(trim(item));
+    return items;
+}
+
+static int fieldIndex(const std::string& name) {
+    for (int f = 0; f < TELEMETRY_FIELDS; f++)
+        if (name == TELEMETRY_FIELD_NAMES[f])
+            return f;
+    return -1;
+}
+
+// "name(arg)" into name and arg
+static bool splitCall(const std::string& item, std::string& name, std::string& arg) {
+    size_t open = item.find('(');
+    if (open == std::string::npos || item.back() != ')')
+        return false;
+    name = trim(item.substr(0, open));
+    arg = trim(item.substr(open + 1, item.size() - open - 2));
+    return true;
+}
+
+static void appendInt(std::string& out, int64_t value) {
+    char digits[24];
+    auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    out.append(digits, end - digits);
+}
+
+bool TelemetryQuery::parseWhere(const std::string& where, std::string& error) {
+    for (auto& item : splitList(where)) {
+        std::string name, arg;
+        if (splitCall(item, name, arg)) {
+            Filter filter = { fieldIndex(arg), Op::CHANGED, 0 };
+            if (name == "increased")
+                filter.op = Op::INCREASED;
+            else if (name == "decreased")
+                filter.op = Op::DECREASED;
+            else if (name != "changed") {
+                error = "unknown condition " + name;
+                return false;
+            }
+            if (filter.field < 0) {
+                error = "unknown field " + arg;
+                return false;
+            }
+            filters.push_back(filter);
+            continue;
+        }
+
+        size_t at = item.find_first_of("<>=!");
+        size_t end = item.find_first_not_of("<>=!", at);
+        if (at == std::string::npos || end == std::string::npos) {
+            error = "expected field op value, got " + item;
+            return false;
+        }
+
+        std::string field = trim(item.substr(0, at));
+        std::string op = item.substr(at, end - at);
+        std::string value = trim(item.substr(end));
+
+        Filter filter;
+        filter.field = fieldIndex(field);
+        if (filter.field < 0) {
+            error = "unknown field " + field;
+            return false;
+        }
+
+        if (op == "<") filter.op = Op::LT;
+        else if (op == "<=") filter.op = Op::LE;
+        else if (op == "=" || op == "==") filter.op = Op::EQ;
+        else if (op == "!=") filter.op = Op::NE;
+        else if (op == ">=") filter.op = Op::GE;
+        else if (op == ">") filter.op = Op::GT;
+        else {
+            error = "unknown operator " + op;
+            return false;
+        }
+
+        char* stop;
+        long number = strtol(value.c_str(), &stop, 10);
+        if (value.empty() || *stop || number < 0 || number > 255) {
+            error = field + " is compared with a number from 0 to 255";
+            return false;
+        }
+        filter.value = (uint8_t)number;
+        filters.push_back(filter);
+    }
+    return true;
+}
+
+bool TelemetryQuery::parseSelect(const std::string& select, std::string& error) {
+    static const struct { const char* name; Fn fn; } fns[] = {
+        { "count", Fn::COUNT }, { "min", Fn::MIN }, { "max", Fn::MAX }, { "sum", Fn::SUM },
+        { "avg", Fn::AVG }, { "first", Fn::FIRST }, { "last", Fn::LAST },
+    };
+
+    for (auto& item : splitList(select)) {
+        std::string name, arg;
+        if (!splitCall(item, name, arg)) {
+            error = "expected fn(field), got " + item;
+            return false;
+        }
+
+        Aggregate aggregate = { Fn::COUNT, 0, name + "(" + arg + ")" };
+        bool known = false;
+        for (auto& candidate : fns)
+            if (name == candidate.name) {
+                aggregate.fn = candidate.fn;
+                known = true;
+            }
+        if (!known) {
+            error = "unknown aggregate " + name;
+            return false;
+        }
+
+        if (aggregate.fn != Fn::COUNT) {
+            aggregate.field = fieldIndex(arg);
+            if (aggregate.field < 0) {
+                error = "unknown field " + arg;
+                return false;
+            }
+        }
+        aggregates.push_back(aggregate);
+    }
+    return true;
+}
+
+bool TelemetryQuery::Parse(const std::string& where, const std::string& select, const std::string& every, std::string& error) {
+    if (!parseWhere(where, error) || !parseSelect(select, error))
+        return false;
+
+    if (!every.empty()) {
+        char* unit;
+        long long number = strtoll(every.c_str(), &unit, 10);
+        std::string suffix = unit;
+        long long scale = (suffix == "ms") ? 1 : (suffix == "s") ? 1000 : (suffix == "m") ? 60000 :
+                          (suffix == "h") ? 3600000 : (suffix == "d") ? 86400000 : 0;
+        if (unit == every.c_str() || number <= 0 || scale == 0 || number > LLONG_MAX / scale) {
+            error = "every is a count with ms, s, m, h or d, like 1m";
+            return false;
+        }
+        bucketMs = number * scale;
+
+        if (aggregates.empty())
+            aggregates.push_back({ Fn::COUNT, 0, "count()" });
+    }
+    return true;
+}
+
+// matching samples in [from, to) of one chunk into the group
+void TelemetryQuery::fold(Group& group, const TelemetryColumns& c, const uint8_t* mask, size_t from, size_t to) {
+    const uint8_t* m = mask + from;
+    size_t n = to - from;
+
+    uint32_t matched = 0;
+    for (size_t k = 0; k < n; k++)
+        matched += m[k];
+    if (matched == 0)
+        return;
+
+    for (size_t a = 0; a < aggregates.size(); a++) {
+        const Aggregate& aggregate = aggregates[a];
+        const uint8_t* col = c.fields[aggregate.field].data() + from;
+        int64_t& value = group.values[a];
+
+        switch (aggregate.fn) {
+        case Fn::COUNT:
+            break;
+        case Fn::MAX: {
+            // unmatched samples count as 0 and 255, no branch in the loop
+            uint8_t best = 0;
+            for (size_t k = 0; k < n; k++)
+                best = std::max(best, (uint8_t)(col[k] & (uint8_t)-m[k]));
+            value = std::max<int64_t>(value, best);
+            break;
+        }
+        case Fn::MIN: {
+            uint8_t best = 255;
+            for (size_t k = 0; k < n; k++)
+                best = std::min(best, (uint8_t)(col[k] | (uint8_t)(m[k] - 1)));
+            value = std::min<int64_t>(value, best);
+            break;
+        }
+        case Fn::SUM:
+        case Fn::AVG: {
+            uint32_t sum = 0;       // a chunk is at most 4096 x 255
+            for (size_t k = 0; k < n; k++)
+                sum += col[k] * m[k];
+            value += sum;
+            break;
+        }
+        case Fn::FIRST:
+            if (group.count == 0)
+                value = col[std::find(m, m + n, 1) - m];
+            break;
+        case Fn::LAST: {
+            size_t k = n;
+            while (!m[k - 1])
+                k--;
+            value = col[k - 1];
+            break;
+        }
+        }
+    }
+    group.count += matched;
+}
+
+bool TelemetryQuery::emit(const Group& group, Format format, std::string& out, size_t& rows) {
+    if (group.count == 0)
+        return true;
+    if (rows >= Limit) {
+        Truncated = true;
+        return false;
+    }
+
+    if (format == Format::JSON) {
+        out += rows ? ",\n{\"time\":" : "{\"time\":";
+    }
+    appendInt(out, group.timeMs);
+
+    for (size_t a = 0; a < aggregates.size(); a++) {
+        if (format == Format::JSON) {
+            out += ",\"";
+            out += aggregates[a].name;
+            out += "\":";
+        }
+        else {
+            out += ',';
+        }
+
+        if (aggregates[a].fn == Fn::COUNT) {
+            appendInt(out, group.count);
+        }
+        else if (aggregates[a].fn == Fn::AVG) {
+            char text[32];
+            int length = snprintf(text, sizeof(text), "%.3f", (double)group.values[a] / group.count);
+            out.append(text, length);
+        }
+        else {
+            appendInt(out, group.values[a]);
+        }
+    }
+    out += (format == Format::JSON) ? "}" : "\n";
+    rows++;
+    return true;
+}
+
+size_t TelemetryQuery::Run(const TelemetryReader& reader, Format format, std::string& out) {
+    bool samples = aggregates.empty();
+    size_t rows = 0;
+    Truncated = false;
+
+    if (format == Format::CSV) {
+        out += "time";
+        if (samples) {
+            for (auto name : TELEMETRY_FIELD_NAMES)
+                out += std::string(",") + name;
+        }
+        else {
+            for (auto& aggregate : aggregates)
+                out += "," + aggregate.name;
+        }
+        out += "\n";
+    }
+    else {
+        out += "[";
+    }
+
+    std::vector<uint8_t> mask;
+    uint8_t previous[TELEMETRY_FIELDS] = {};
+    bool havePrevious = false;
+
+    Group group;
+    bool open = false;
+    auto reset = [&](int64_t timeMs) {
+        group.timeMs = timeMs;
+        group.count = 0;
+        group.values.assign(aggregates.size(), 0);
+        for (size_t a = 0; a < aggregates.size(); a++)
+            if (aggregates[a].fn == Fn::MIN)
+                group.values[a] = 255;
+        open = true;
+    };
+
+    reader.Scan(FromMs, ToMs, [&](const TelemetryColumns& c) {
+        size_t n = c.count;
+        mask.assign(n, 1);
+        uint8_t* m = mask.data();
+
+        for (auto& filter : filters) {
+            const uint8_t* col = c.fields[filter.field].data();
+            uint8_t v = filter.value;
+            uint8_t before = previous[filter.field];
+
+            switch (filter.op) {
+            case Op::LT: for (size_t i = 0; i < n; i++) m[i] &= col[i] < v; break;
+            case Op::LE: for (size_t i = 0; i < n; i++) m[i] &= col[i] <= v; break;
+            case Op::EQ: for (size_t i = 0; i < n; i++) m[i] &= col[i] == v; break;
+            case Op::NE: for (size_t i = 0; i < n; i++) m[i] &= col[i] != v; break;
+            case Op::GE: for (size_t i = 0; i < n; i++) m[i] &= col[i] >= v; break;
+            case Op::GT: for (size_t i = 0; i < n; i++) m[i] &= col[i] > v; break;
+            // against the sample before, the first of the range has none
+            case Op::INCREASED:
+                m[0] &= havePrevious && col[0] > before;
+                for (size_t i = 1; i < n; i++) m[i] &= col[i] > col[i - 1];
+                break;
+            case Op::DECREASED:
+                m[0] &= havePrevious && col[0] < before;
+                for (size_t i = 1; i < n; i++) m[i] &= col[i] < col[i - 1];
+                break;
+            case Op::CHANGED:
+                m[0] &= havePrevious && col[0] != before;
+                for (size_t i = 1; i < n; i++) m[i] &= col[i] != col[i - 1];
+                break;
+            }
+        }
+        for (int f = 0; f < TELEMETRY_FIELDS; f++)
+            previous[f] = c.fields[f][n - 1];
+        havePrevious = true;
+
+        if (samples) {
+            for (size_t i = 0; i < n; i++) {
+                if (!m[i])
+                    continue;
+                if (rows >= Limit) {
+                    Truncated = true;
+                    return false;
+                }
+                if (format == Format::JSON) {
+                    out += rows ? ",\n{\"time\":" : "{\"time\":";
+                    appendInt(out, c.timeMs[i]);
+                    for (int f = 0; f < TELEMETRY_FIELDS; f++) {
+                        out += ",\"";
+                        out += TELEMETRY_FIELD_NAMES[f];
+                        out += "\":";
+                        appendInt(out, c.fields[f][i]);
+                    }
+                    out += "}";
+                }
+                else {
+                    appendInt(out, c.timeMs[i]);
+                    for (int f = 0; f < TELEMETRY_FIELDS; f++) {
+                        out += ',';
+                        appendInt(out, c.fields[f][i]);
+                    }
+                    out += "\n";
+                }
+                rows++;
+            }
+            return true;
+        }
+
+        // samples come in time order, so a bucket is a contiguous run
+        size_t i = 0;
+        while (i < n) {
+            int64_t start;
+            size_t j = n;
+            if (bucketMs > 0) {
+                int64_t t = c.timeMs[i];
+                start = (t / bucketMs - (t % bucketMs < 0)) * bucketMs;
+                j = i + 1;
+                while (j < n && c.timeMs[j] >= start && c.timeMs[j] - start < bucketMs)
+                    j++;
+            }
+            else {
+                start = open ? group.timeMs : c.timeMs[i];
+            }
+
+            if (open && start != group.timeMs) {
+                if (!emit(group, format, out, rows))
+                    return false;
+                open = false;
+            }
+            if (!open)
+                reset(start);
+            fold(group, c, m, i, j);
+            i = j;
+        }
+        return true;
+    });
+
+    if (open && !Truncated)
+        emit(group, format, out, rows);
+    if (format == Format::JSON)
+        out += "]\n";
+    return rows;
+}
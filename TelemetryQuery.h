@@ -0,0 +1,66 @@
+#pragma once
+#include "TelemetryStore.h"
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Filter, group and aggregate over one robot's stored telemetry.
+//   where  = HitCount>0,CurrentGrade<=40,increased(HitCount)   all must hold
+//            comparisons < <= = != >= >, and increased/decreased/changed
+//            against the sample before it
+//   every  = 500ms | 10s | 1m | 1h   wall-clock aligned buckets, none for one group
+//   select = max(CurrentGrade),count(),avg(LastCmdSpeed)   min max sum avg
+//            first last count, no select and no every returns the samples
+// Each chunk from the reader is evaluated a column at a time: a filter is
+// one branch-free pass that narrows a byte mask, an aggregate one masked
+// fold per bucket, plain loops over contiguous bytes the compiler
+// vectorizes. Only one decoded chunk is held at a time.
+class TelemetryQuery {
+public:
+    enum class Format { JSON, CSV };
+
+private:
+    enum class Op { LT, LE, EQ, NE, GE, GT, INCREASED, DECREASED, CHANGED };
+    enum class Fn { COUNT, MIN, MAX, SUM, AVG, FIRST, LAST };
+
+    struct Filter {
+        int field;
+        Op op;
+        uint8_t value;
+    };
+
+    struct Aggregate {
+        Fn fn;
+        int field;                          // unused by count
+        std::string name;
+    };
+
+    // one bucket being folded
+    struct Group {
+        int64_t timeMs = 0;
+        uint64_t count = 0;
+        std::vector<int64_t> values;        // per aggregate
+    };
+
+    std::vector<Filter> filters;
+    std::vector<Aggregate> aggregates;
+    int64_t bucketMs = 0;
+
+    bool parseWhere(const std::string& where, std::string& error);
+    bool parseSelect(const std::string& select, std::string& error);
+    void fold(Group& group, const TelemetryColumns& c, const uint8_t* mask, size_t from, size_t to);
+    bool emit(const Group& group, Format format, std::string& out, size_t& rows);
+
+public:
+    static constexpr size_t MAXLIMIT = 100000;  // rows a query may ask for, its result is built whole
+
+    int64_t FromMs = INT64_MIN;
+    int64_t ToMs = INT64_MAX;
+    size_t Limit = MAXLIMIT;                // rows, the rest is cut off
+    bool Truncated = false;
+
+    bool Parse(const std::string& where, const std::string& select, const std::string& every, std::string& error);
+    // appends the result to out, returns the row count
+    size_t Run(const TelemetryReader& reader, Format format, std::string& out);
+};
@@ -0,0 +1,468 @@
+#include "TelemetryStore.h"
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char* const TELEMETRY_FIELD_NAMES[TELEMETRY_FIELDS] = {
+    "LastPktCounter", "CurrentGrade", "HitCount", "LastCmd", "LastCmdValue", "LastCmdSpeed"
+};
+
+static const uint32_t CHUNKMAGIC = 0x314b4354;     // "TCK1"
+static const uint32_t INDEXMAGIC = 0x31584954;     // "TIX1"
+
+static_assert(sizeof(telemetry) == TELEMETRY_FIELDS, "telemetry fields are stored as bytes");
+
+void TelemetryColumns::Resize(size_t n) {
+    count = n;
+    timeMs.resize(n);
+    for (auto& field : fields)
+        field.resize(n);
+}
+
+static void putVarint(std::vector<uint8_t>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)v | 0x80);
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static void putRun(std::vector<uint8_t>& out, int64_t delta, uint64_t run) {
+    putVarint(out, zigzag(delta) << 1 | (run > 1));
+    if (run > 1)
+        putVarint(out, run);
+}
+
+// deltas from the previous value (the first from 0), equal deltas as one run
+template <typename Value>
+static void encodeColumn(std::vector<uint8_t>& out, size_t count, Value value) {
+    int64_t prev = 0;
+    int64_t delta = 0;
+    uint64_t run = 0;
+    for (size_t i = 0; i < count; i++) {
+        int64_t v = value(i);
+        int64_t d = v - prev;
+        prev = v;
+        if (run && d == delta) {
+            run++;
+            continue;
+        }
+        if (run)
+            putRun(out, delta, run);
+        delta = d;
+        run = 1;
+    }
+    if (run)
+        putRun(out, delta, run);
+}
+
+template <typename T>
+static bool decodeColumn(const uint8_t* p, const uint8_t* end, size_t count, T* out) {
+    int64_t value = 0;
+    T* stop = out + count;
+    while (out < stop) {
+        // one or two bytes covers nearly every delta
+        uint64_t head;
+        if (p < end && *p < 0x80) {
+            head = *p++;
+        }
+        else if (p + 1 < end && p[1] < 0x80) {
+            head = (p[0] & 0x7f) | (uint64_t)p[1] << 7;
+            p += 2;
+        }
+        else if (!getVarint(p, end, head)) {
+            return false;
+        }
+
+        int64_t delta = unzigzag(head >> 1);
+        if (!(head & 1)) {
+            value += delta;
+            *out++ = (T)value;
+            continue;
+        }
+
+        uint64_t run;
+        if (!getVarint(p, end, run) || run > (uint64_t)(stop - out))
+            return false;
+        if (delta == 0) {
+            std::fill(out, out + run, (T)value);
+            out += run;
+            continue;
+        }
+        for (uint64_t r = 0; r < run; r++) {
+            value += delta;
+            *out++ = (T)value;
+        }
+    }
+    return p == end;
+}
+
+static bool writeAll(int fd, const void* data, size_t size) {
+    const char* p = (const char*)data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+std::string TelemetryStore::SegmentPath(const std::string& dir, int robot, int seq) {
+    char name[64];
+    snprintf(name, sizeof(name), "/robot%d-%06d.tcol", robot, seq);
+    return dir + name;
+}
+
+std::vector<int> TelemetryStore::Segments(const std::string& dir, int robot) {
+    std::vector<int> seqs;
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+        return seqs;
+
+    std::string prefix = "robot" + std::to_string(robot) + "-";
+    while (dirent* entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (name.rfind(prefix, 0) != 0 || name.size() <= prefix.size() + 5 ||
+            name.compare(name.size() - 5, 5, ".tcol") != 0)
+            continue;
+        std::string digits = name.substr(prefix.size(), name.size() - prefix.size() - 5);
+        if (digits.find_first_not_of("0123456789") == std::string::npos)
+            seqs.push_back(atoi(digits.c_str()));
+    }
+    closedir(d);
+    std::sort(seqs.begin(), seqs.end());
+    return seqs;
+}
+
+TelemetryStore::TelemetryStore(std::string dir, std::atomic<int>& flushMs)
+    : dir(std::move(dir)), flushMs(flushMs), running(true), flushRequested(0), flushDone(0),
+      bytesWritten(0), samplesWritten(0)
+{
+    mkdir(this->dir.c_str(), 0755);
+    struct stat st;
+    ok = (stat(this->dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && access(this->dir.c_str(), W_OK) == 0);
+    worker = std::thread(&TelemetryStore::run, this);
+}
+
+TelemetryStore::~TelemetryStore() {
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        running = false;
+    }
+    wakeup.notify_all();
+    worker.join();
+}
+
+bool TelemetryStore::Ok() const {
+    return ok;
+}
+
+const std::string& TelemetryStore::Dir() const {
+    return dir;
+}
+
+uint64_t TelemetryStore::BytesWritten() const {
+    return bytesWritten;
+}
+
+uint64_t TelemetryStore::SamplesWritten() const {
+    return samplesWritten;
+}
+
+void TelemetryStore::Append(int robot, const telemetry& sample) {
+    Append(robot, sample, std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+void TelemetryStore::Append(int robot, const telemetry& sample, int64_t timeMs) {
+    bool first;
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        first = incoming.empty();
+        incoming.push_back({ robot, timeMs, sample });
+    }
+    // the writer only needs waking when there was nothing for it before
+    if (first)
+        wakeup.notify_one();
+}
+
+void TelemetryStore::Flush() {
+    std::unique_lock<std::mutex> lk(lock);
+    uint64_t ticket = ++flushRequested;
+    wakeup.notify_one();
+    flushed.wait(lk, [&] { return flushDone >= ticket || !running; });
+}
+
+bool TelemetryStore::openSegment(int robot, Series& s) {
+    if (s.seq < 0) {
+        auto existing = Segments(dir, robot);
+        s.seq = existing.empty() ? 0 : existing.back() + 1;
+    }
+    s.fd = open(SegmentPath(dir, robot, s.seq).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    s.offset = 0;
+    s.index.clear();
+    return s.fd >= 0;
+}
+
+// the index goes last so an unsealed segment is still readable
+void TelemetryStore::seal(Series& s) {
+    if (s.fd < 0)
+        return;
+
+    IndexTrailer trailer = { s.index.size(), INDEXMAGIC, 0 };
+    if (writeAll(s.fd, s.index.data(), s.index.size() * sizeof(IndexEntry)) &&
+        writeAll(s.fd, &trailer, sizeof(trailer)))
+        bytesWritten += s.index.size() * sizeof(IndexEntry) + sizeof(trailer);
+
+    close(s.fd);
+    s.fd = -1;
+    s.seq++;
+}
+
+void TelemetryStore::writeChunk(int robot, Series& s, bool partial) {
+    while (s.samples.size() >= CHUNKSAMPLES || (partial && !s.samples.empty())) {
+        uint32_t count = (uint32_t)std::min<size_t>(s.samples.size(), CHUNKSAMPLES);
+        if (s.fd < 0 && !openSegment(robot, s)) {
+            // disk trouble, drop the samples rather than grow without bound
+            s.timeMs.clear();
+            s.samples.clear();
+            return;
+        }
+
+        ChunkHeader header = {};
+        header.magic = CHUNKMAGIC;
+        header.count = count;
+        header.firstMs = *std::min_element(s.timeMs.begin(), s.timeMs.begin() + count);
+        header.lastMs = *std::max_element(s.timeMs.begin(), s.timeMs.begin() + count);
+
+        scratch.assign(sizeof(header), 0);
+        size_t start = scratch.size();
+        encodeColumn(scratch, count, [&](size_t i) { return s.timeMs[i]; });
+        header.columnBytes[0] = (uint32_t)(scratch.size() - start);
+        for (int f = 0; f < TELEMETRY_FIELDS; f++) {
+            start = scratch.size();
+            encodeColumn(scratch, count, [&](size_t i) {
+                return (int64_t)((const uint8_t*)&s.samples[i])[f];
+            });
+            header.columnBytes[1 + f] = (uint32_t)(scratch.size() - start);
+        }
+        memcpy(scratch.data(), &header, sizeof(header));
+
+        if (writeAll(s.fd, scratch.data(), scratch.size())) {
+            s.index.push_back({ header.firstMs, header.lastMs, s.offset, count, 0 });
+            s.offset += scratch.size();
+            bytesWritten += scratch.size();
+            samplesWritten += count;
+        }
+
+        s.timeMs.erase(s.timeMs.begin(), s.timeMs.begin() + count);
+        s.samples.erase(s.samples.begin(), s.samples.begin() + count);
+        s.oldest = Clock::now();
+        if (s.index.size() >= SEGMENTCHUNKS)
+            seal(s);
+    }
+}
+
+void TelemetryStore::run() {
+    std::vector<Pending> batch;
+    std::unique_lock<std::mutex> lk(lock);
+    while (true) {
+        // wake for new samples, a flush, shutdown or the oldest partial chunk coming due
+        auto due = Clock::time_point::max();
+        for (auto& [robot, s] : series)
+            if (!s.samples.empty())
+                due = std::min(due, s.oldest + std::chrono::milliseconds(flushMs.load()));
+        auto ready = [&] {
+            return !incoming.empty() || flushRequested != flushDone || !running || Clock::now() >= due;
+        };
+        if (due == Clock::time_point::max())
+            wakeup.wait(lk, ready);
+        else
+            wakeup.wait_until(lk, due, ready);
+
+        batch.swap(incoming);
+        uint64_t ticket = flushRequested;
+        bool stopping = !running;
+        lk.unlock();
+
+        auto now = Clock::now();
+        for (auto& p : batch) {
+            Series& s = series[p.robot];
+            if (s.samples.empty())
+                s.oldest = now;
+            s.timeMs.push_back(p.timeMs);
+            s.samples.push_back(p.data);
+        }
+        batch.clear();
+
+        bool flushAll = stopping || ticket != flushDone;
+        for (auto& [robot, s] : series) {
+            bool partial = flushAll || (!s.samples.empty() && now >= s.oldest + std::chrono::milliseconds(flushMs.load()));
+            writeChunk(robot, s, partial);
+            if (stopping)
+                seal(s);
+        }
+
+        lk.lock();
+        flushDone = ticket;
+        flushed.notify_all();
+        if (stopping && incoming.empty())
+            break;
+    }
+}
+
+TelemetryReader::TelemetryReader(const std::string& dir, int robot) {
+    for (int seq : TelemetryStore::Segments(dir, robot))
+        load(TelemetryStore::SegmentPath(dir, robot, seq));
+}
+
+TelemetryReader::~TelemetryReader() {
+    for (auto& segment : segments)
+        munmap((void*)segment.base, segment.size);
+}
+
+void TelemetryReader::load(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ChunkHeader)) {
+        close(fd);
+        return;
+    }
+
+    Segment segment;
+    segment.size = st.st_size;
+    void* base = mmap(nullptr, segment.size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return;
+    segment.base = (const uint8_t*)base;
+
+    // sealed: the index is at the end
+    IndexTrailer trailer;
+    memcpy(&trailer, segment.base + segment.size - sizeof(trailer), sizeof(trailer));
+    size_t indexBytes = trailer.entries * sizeof(IndexEntry);
+    if (trailer.magic == INDEXMAGIC && trailer.entries <= segment.size / sizeof(IndexEntry) &&
+        indexBytes + sizeof(trailer) <= segment.size) {
+        const uint8_t* index = segment.base + segment.size - sizeof(trailer) - indexBytes;
+        segment.index.resize(trailer.entries);
+        memcpy(segment.index.data(), index, indexBytes);
+        if (segment.index.empty() || segment.index[0].offset == 0) {
+            segments.push_back(std::move(segment));
+            return;
+        }
+        segment.index.clear();
+    }
+
+    // unsealed: walk the chunk headers, a torn last chunk ends the walk
+    uint64_t offset = 0;
+    while (offset + sizeof(ChunkHeader) <= segment.size) {
+        ChunkHeader header;
+        memcpy(&header, segment.base + offset, sizeof(header));
+        if (header.magic != CHUNKMAGIC || header.count == 0 || header.count > TelemetryStore::CHUNKSAMPLES)
+            break;
+
+        uint64_t size = sizeof(header);
+        for (uint32_t bytes : header.columnBytes)
+            size += bytes;
+        if (offset + size > segment.size)
+            break;
+
+        segment.index.push_back({ header.firstMs, header.lastMs, offset, header.count, 0 });
+        offset += size;
+    }
+    segments.push_back(std::move(segment));
+}
+
+size_t TelemetryReader::Chunks() const {
+    size_t chunks = 0;
+    for (auto& segment : segments)
+        chunks += segment.index.size();
+    return chunks;
+}
+
+size_t TelemetryReader::Scan(int64_t fromMs, int64_t toMs, const std::function<bool(const TelemetryColumns&)>& fn) const {
+    TelemetryColumns columns;
+    size_t passed = 0;
+
+    for (auto& segment : segments) {
+        if (segment.index.empty() || segment.index.back().lastMs < fromMs || segment.index.front().firstMs > toMs)
+            continue;
+
+        // first chunk that can still reach fromMs
+        auto it = std::lower_bound(segment.index.begin(), segment.index.end(), fromMs,
+            [](const IndexEntry& entry, int64_t t) { return entry.lastMs < t; });
+
+        for (; it != segment.index.end() && it->firstMs <= toMs; ++it) {
+            if (it->offset + sizeof(ChunkHeader) > segment.size)
+                break;
+            ChunkHeader header;
+            memcpy(&header, segment.base + it->offset, sizeof(header));
+            uint64_t size = sizeof(header);
+            for (uint32_t bytes : header.columnBytes)
+                size += bytes;
+            if (header.magic != CHUNKMAGIC || header.count > TelemetryStore::CHUNKSAMPLES ||
+                it->offset + size > segment.size)
+                continue;
+
+            columns.Resize(header.count);
+            const uint8_t* p = segment.base + it->offset + sizeof(header);
+            bool good = decodeColumn(p, p + header.columnBytes[0], header.count, columns.timeMs.data());
+            p += header.columnBytes[0];
+            for (int f = 0; good && f < TELEMETRY_FIELDS; f++) {
+                good = decodeColumn(p, p + header.columnBytes[1 + f], header.count, columns.fields[f].data());
+                p += header.columnBytes[1 + f];
+            }
+            if (!good)
+                continue;
+
+            // chunks at the edges of the range keep only the samples inside it
+            if (header.firstMs < fromMs || header.lastMs > toMs) {
+                size_t kept = 0;
+                for (size_t i = 0; i < columns.count; i++) {
+                    if (columns.timeMs[i] < fromMs || columns.timeMs[i] > toMs)
+                        continue;
+                    columns.timeMs[kept] = columns.timeMs[i];
+                    for (auto& field : columns.fields)
+                        field[kept] = field[i];
+                    kept++;
+                }
+                columns.Resize(kept);
+                if (kept == 0)
+                    continue;
+            }
+
+            passed += columns.count;
+            if (!fn(columns))
+                return passed;
+        }
+    }
+    return passed;
+}
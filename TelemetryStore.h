@@ -0,0 +1,149 @@
+#pragma once
+#include "PktDef.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// the uint8_t members of telemetry, in declaration order
+const int TELEMETRY_FIELDS = 6;
+extern const char* const TELEMETRY_FIELD_NAMES[TELEMETRY_FIELDS];
+
+// A run of decoded samples, struct of arrays so a scan walks one column at a time.
+struct TelemetryColumns {
+    size_t count = 0;
+    std::vector<int64_t> timeMs;                    // wall clock
+    std::vector<uint8_t> fields[TELEMETRY_FIELDS];
+
+    void Resize(size_t n);
+};
+
+// On-disk layout, host byte order. Each robot has a series of segment files
+// robot<id>-<seq>.tcol holding chunks of up to CHUNKSAMPLES samples:
+//   ChunkHeader, then the time column and the six field columns.
+// A column is delta encoded and the deltas run-length encoded: per run one
+// varint of zigzag(delta) << 1 | more, followed by a varint run length when
+// more is set. A sealed segment ends with an index of its chunks and an
+// IndexTrailer; one cut short by a crash is indexed by walking the headers.
+struct ChunkHeader {
+    uint32_t magic;
+    uint32_t count;
+    int64_t firstMs;
+    int64_t lastMs;
+    uint32_t columnBytes[1 + TELEMETRY_FIELDS];
+    uint32_t reserved;
+};
+
+struct IndexEntry {
+    int64_t firstMs;
+    int64_t lastMs;
+    uint64_t offset;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct IndexTrailer {
+    uint64_t entries;
+    uint32_t magic;
+    uint32_t reserved;
+};
+
+// Append-only store for sampled telemetry. Append only queues the sample,
+// a writer thread encodes full chunks, and partial ones once their oldest
+// sample has waited flushMs, so readers see data at most that late.
+// Segments are sealed after SEGMENTCHUNKS chunks and on shutdown.
+class TelemetryStore {
+public:
+    static const uint32_t CHUNKSAMPLES = 4096;
+    static const size_t SEGMENTCHUNKS = 256;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pending {
+        int robot;
+        int64_t timeMs;
+        telemetry data;
+    };
+
+    // writer thread only
+    struct Series {
+        std::vector<int64_t> timeMs;
+        std::vector<telemetry> samples;
+        Clock::time_point oldest;               // when the first unwritten sample arrived
+        int fd = -1;
+        int seq = -1;
+        uint64_t offset = 0;
+        std::vector<IndexEntry> index;
+    };
+
+    std::string dir;
+    std::atomic<int>& flushMs;
+    bool ok;
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::condition_variable flushed;
+    bool running;
+    uint64_t flushRequested;
+    uint64_t flushDone;
+    std::vector<Pending> incoming;
+    std::map<int, Series> series;
+    std::vector<uint8_t> scratch;
+    std::atomic<uint64_t> bytesWritten;
+    std::atomic<uint64_t> samplesWritten;
+    std::thread worker;
+
+    void run();
+    void writeChunk(int robot, Series& s, bool partial);
+    bool openSegment(int robot, Series& s);
+    void seal(Series& s);
+
+public:
+    TelemetryStore(std::string dir, std::atomic<int>& flushMs);
+    ~TelemetryStore();
+
+    bool Ok() const;
+    const std::string& Dir() const;
+    void Append(int robot, const telemetry& sample);
+    void Append(int robot, const telemetry& sample, int64_t timeMs);   // wall clock ms
+    // returns once everything appended before the call is on disk
+    void Flush();
+    uint64_t BytesWritten() const;
+    uint64_t SamplesWritten() const;
+
+    static std::string SegmentPath(const std::string& dir, int robot, int seq);
+    static std::vector<int> Segments(const std::string& dir, int robot);   // seqs, ascending
+};
+
+// Read side, works from the files alone. Every segment of the robot is
+// mmapped when the reader is made, later writes are not seen.
+class TelemetryReader {
+private:
+    struct Segment {
+        const uint8_t* base = nullptr;
+        size_t size = 0;
+        std::vector<IndexEntry> index;
+    };
+
+    std::vector<Segment> segments;
+
+    void load(const std::string& path);
+
+public:
+    TelemetryReader(const std::string& dir, int robot);
+    ~TelemetryReader();
+    TelemetryReader(const TelemetryReader&) = delete;
+    TelemetryReader& operator=(const TelemetryReader&) = delete;
+
+    size_t Chunks() const;
+    // decodes the chunks that overlap [fromMs, toMs] one at a time, trimmed
+    // to the range, and hands each to fn until it returns false. Seeking
+    // assumes time only goes forward within a robot's series.
+    size_t Scan(int64_t fromMs, int64_t toMs, const std::function<bool(const TelemetryColumns&)>& fn) const;
+};
@@ -0,0 +1,302 @@
+#include "TelemetryStream.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+static const char STREAMHEADER[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "\r\n";
+
+static const char NOTFOUND[] =
+    "HTTP/1.1 404 Not Found\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+static const char DATAPREFIX[] = "data: ";
+static const char DATASUFFIX[] = "\n\n";
+static const char KEEPALIVE[] = ": keepalive\n\n";
+static const int MAXIOV = 48;
+
+// one backlog entry on the wire: the shared JSON framed as an event, or a keepalive
+static int framePieces(const PacketBuffer& event, struct iovec* parts) {
+    if (!event) {
+        parts[0] = { (void*)KEEPALIVE, sizeof(KEEPALIVE) - 1 };
+        return 1;
+    }
+    parts[0] = { (void*)DATAPREFIX, sizeof(DATAPREFIX) - 1 };
+    parts[1] = { (void*)event.Data(), (size_t)event.Size() };
+    parts[2] = { (void*)DATASUFFIX, sizeof(DATASUFFIX) - 1 };
+    return 3;
+}
+
+static size_t frameSize(const PacketBuffer& event) {
+    if (!event)
+        return sizeof(KEEPALIVE) - 1;
+    return sizeof(DATAPREFIX) - 1 + event.Size() + sizeof(DATASUFFIX) - 1;
+}
+
+TelemetryStream::TelemetryStream(TelemetryHub& hub, int port, std::atomic<int>& backlogLimit)
+    : hub(hub), feed(std::make_shared<Feed>(this)), listenFd(-1), wakeFd(-1),
+      backlogLimit(backlogLimit), running(false)
+{
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (listenFd < 0)
+        return;
+
+    int on = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd, 64) < 0) {
+        close(listenFd);
+        listenFd = -1;
+        return;
+    }
+
+    wakeFd = eventfd(0, EFD_NONBLOCK);
+    running = true;
+    worker = std::thread(&TelemetryStream::run, this);
+}
+
+TelemetryStream::~TelemetryStream() {
+    if (running) {
+        running = false;
+        wake();
+        worker.join();
+    }
+    for (auto& entry : watchers)
+        hub.Unsubscribe(entry.first, feed);
+    for (auto& entry : clients)
+        close(entry.first);
+    if (wakeFd >= 0)
+        close(wakeFd);
+    if (listenFd >= 0)
+        close(listenFd);
+}
+
+bool TelemetryStream::Ok() const {
+    return listenFd >= 0;
+}
+
+void TelemetryStream::wake() {
+    uint64_t one = 1;
+    ssize_t unused = write(wakeFd, &one, sizeof(one));
+    (void)unused;
+}
+
+void TelemetryStream::acceptClients() {
+    for (;;) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK);
+        if (fd < 0)
+            return;
+        clients[fd];
+    }
+}
+
+// GET /telemetry/stream?robot=N, anything else gets a 404
+bool TelemetryStream::readRequest(int fd, Client& client) {
+    char buffer[1024];
+    ssize_t bytes = recv(fd, buffer, sizeof(buffer), 0);
+    if (bytes <= 0)
+        return bytes < 0 && errno == EAGAIN;
+
+    client.request.append(buffer, bytes);
+    if (client.request.find("\r\n\r\n") == std::string::npos)
+        return client.request.size() < MAXREQUEST;
+
+    std::string line = client.request.substr(0, client.request.find("\r\n"));
+    const std::string path = "GET /telemetry/stream";
+    if (line.compare(0, path.size(), path) != 0 || (line[path.size()] != ' ' && line[path.size()] != '?')) {
+        send(fd, NOTFOUND, sizeof(NOTFOUND) - 1, MSG_NOSIGNAL);
+        return false;
+    }
+
+    size_t param = line.find("robot=");
+    client.robot = (param != std::string::npos && param < line.rfind(' ')) ? atoi(line.c_str() + param + 6) : 0;
+    client.request.clear();
+    client.request.shrink_to_fit();
+
+    // a fresh socket always takes the header whole
+    if (send(fd, STREAMHEADER, sizeof(STREAMHEADER) - 1, MSG_NOSIGNAL) != (ssize_t)(sizeof(STREAMHEADER) - 1))
+        return false;
+    client.streaming = true;
+    if (watchers[client.robot]++ == 0)
+        hub.Subscribe(client.robot, feed);
+    return true;
+}
+
+// the oldest event not yet started is dropped, a half sent one has to finish
+void TelemetryStream::queue(Client& client, const PacketBuffer& event) {
+    size_t limit = (size_t)std::max(1, backlogLimit.load(std::memory_order_relaxed));
+    while (client.backlog.size() >= limit) {
+        size_t victim = (client.offset > 0) ? 1 : 0;
+        if (victim >= client.backlog.size())
+            break;
+        client.backlog.erase(client.backlog.begin() + victim);
+    }
+    client.backlog.push_back(event);
+}
+
+// as much of the backlog as the socket takes in one call, false when the peer is gone
+bool TelemetryStream::flush(int fd, Client& client) {
+    while (!client.backlog.empty()) {
+        struct iovec iov[MAXIOV];
+        int count = 0;
+        size_t skip = client.offset;
+        for (auto& event : client.backlog) {
+            struct iovec parts[3];
+            int pieces = framePieces(event, parts);
+            if (count + pieces > MAXIOV)
+                break;
+            for (int i = 0; i < pieces; i++) {
+                if (skip >= parts[i].iov_len) {
+                    skip -= parts[i].iov_len;
+                    continue;
+                }
+                iov[count].iov_base = (char*)parts[i].iov_base + skip;
+                iov[count].iov_len = parts[i].iov_len - skip;
+                skip = 0;
+                count++;
+            }
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0)
+            return errno == EAGAIN;
+
+        while (sent > 0) {
+            size_t left = frameSize(client.backlog.front()) - client.offset;
+            if ((size_t)sent < left) {
+                client.offset += sent;
+                return true;   // socket full
+            }
+            sent -= left;
+            client.offset = 0;
+            client.backlog.pop_front();
+        }
+    }
+    return true;
+}
+
+void TelemetryStream::drop(int fd) {
+    auto it = clients.find(fd);
+    if (it->second.streaming && --watchers[it->second.robot] == 0) {
+        watchers.erase(it->second.robot);
+        hub.Unsubscribe(it->second.robot, feed);
+    }
+    close(fd);
+    clients.erase(it);
+}
+
+void TelemetryStream::run() {
+    auto lastKeepalive = std::chrono::steady_clock::now();
+    std::vector<struct pollfd> fds;
+
+    while (running) {
+        fds.clear();
+        fds.push_back({ listenFd, POLLIN, 0 });
+        fds.push_back({ wakeFd, POLLIN, 0 });
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            for (auto& [fd, client] : clients)
+                fds.push_back({ fd, (short)(POLLIN | (client.backlog.empty() ? 0 : POLLOUT)), 0 });
+        }
+
+        auto elapsed = std::chrono::steady_clock::now() - lastKeepalive;
+        int waitMs = KEEPALIVEMS - (int)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+        poll(fds.data(), fds.size(), std::max(0, waitMs));
+
+        if (fds[1].revents) {
+            uint64_t count;
+            ssize_t unused = read(wakeFd, &count, sizeof(count));
+            (void)unused;
+        }
+
+        std::lock_guard<std::mutex> lk(lock);
+        if (fds[0].revents)
+            acceptClients();
+
+        bool pingDue = std::chrono::steady_clock::now() - lastKeepalive >= std::chrono::milliseconds(KEEPALIVEMS);
+        if (pingDue)
+            lastKeepalive = std::chrono::steady_clock::now();
+
+        for (size_t i = 2; i < fds.size(); i++) {
+            int fd = fds[i].fd;
+            auto it = clients.find(fd);
+            if (it == clients.end())
+                continue;
+            Client& client = it->second;
+
+            bool keep = !client.closed && !(fds[i].revents & (POLLERR | POLLHUP | POLLNVAL));
+            if (keep && (fds[i].revents & POLLIN)) {
+                if (!client.streaming) {
+                    keep = readRequest(fd, client);
+                }
+                else {
+                    // nothing is expected from a stream, a read of 0 is the peer closing
+                    char discard[256];
+                    ssize_t bytes = recv(fd, discard, sizeof(discard), 0);
+                    keep = bytes > 0 || (bytes < 0 && errno == EAGAIN);
+                }
+            }
+            if (keep && client.streaming && pingDue && client.backlog.empty())
+                queue(client, PacketBuffer());
+            if (keep && !client.backlog.empty())
+                keep = flush(fd, client);
+
+            if (!keep)
+                drop(fd);
+        }
+    }
+}
+
+void TelemetryStream::Feed::Deliver(int robot, const telemetry&, const PacketBuffer& sample) {
+    stream->deliver(robot, sample);
+}
+
+void TelemetryStream::deliver(int robot, const PacketBuffer& sample) {
+    bool backedUp = false;
+    std::lock_guard<std::mutex> lk(lock);
+    for (auto& [fd, client] : clients) {
+        if (!client.streaming || client.closed || client.robot != robot)
+            continue;
+
+        // a dead peer is left for the loop to close, its fd may still be in the poll set
+        queue(client, sample);
+        if (!flush(fd, client))
+            client.closed = true;
+        backedUp |= client.closed || !client.backlog.empty();
+    }
+
+    // the loop has to watch for POLLOUT on clients that fell behind and reap dead ones
+    if (backedUp)
+        wake();
+}
+
+size_t TelemetryStream::Clients() {
+    std::lock_guard<std::mutex> lk(lock);
+    return clients.size();
+}
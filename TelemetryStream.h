@@ -0,0 +1,66 @@
+#pragma once
+#include "TelemetryHub.h"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Server-Sent Events listener for telemetry. Crow 1.1 can only send a
+// response whole, so streams are served from their own port by one poll()
+// loop; GET /telemetry/stream?robot=N there (Crow redirects to it).
+// The listener subscribes to the hub for each robot that has a stream and
+// queues the hub's shared JSON buffer on every stream of that robot, the SSE
+// framing goes around it at write time. A client that stops reading keeps
+// at most backlogLimit events, the oldest unsent ones are dropped first.
+// Whatever publishes to the hub has to stop before the listener goes away.
+class TelemetryStream {
+private:
+    static constexpr int KEEPALIVEMS = 15000;  // comment line to idle streams, finds dead peers
+    static const size_t MAXREQUEST = 4096;
+
+    struct Client {
+        int robot = -1;
+        bool streaming = false;
+        bool closed = false;                // peer gone, the loop closes the fd
+        std::string request;                // until the header is complete
+        std::deque<PacketBuffer> backlog;   // an empty handle is a keepalive
+        size_t offset = 0;                  // bytes of backlog.front() already sent
+    };
+
+    // the listener's hub subscription, shared by all of its robots
+    struct Feed : TelemetrySubscriber {
+        TelemetryStream* stream;
+        explicit Feed(TelemetryStream* stream) : stream(stream) {}
+        void Deliver(int robot, const telemetry& raw, const PacketBuffer& sample) override;
+    };
+
+    TelemetryHub& hub;
+    std::shared_ptr<Feed> feed;
+    int listenFd;
+    int wakeFd;
+    std::atomic<int>& backlogLimit;
+    std::atomic<bool> running;
+    std::mutex lock;
+    std::unordered_map<int, Client> clients;   // by fd
+    std::unordered_map<int, int> watchers;     // open streams per robot
+    std::thread worker;
+
+    void run();
+    void acceptClients();
+    bool readRequest(int fd, Client& client);
+    bool flush(int fd, Client& client);
+    void queue(Client& client, const PacketBuffer& event);
+    void drop(int fd);
+    void deliver(int robot, const PacketBuffer& sample);
+    void wake();
+
+public:
+    TelemetryStream(TelemetryHub& hub, int port, std::atomic<int>& backlogLimit);
+    ~TelemetryStream();
+
+    bool Ok() const;
+    size_t Clients();
+};
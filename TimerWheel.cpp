@@ -0,0 +1,154 @@
+#include "TimerWheel.h"
+#include <algorithm>
+#include <sys/prctl.h>
+
+const std::chrono::microseconds TimerWheel::TICK(1000);
+
+TimerWheel::TimerWheel()
+    : start(Clock::now()), currentTick(0), nextId(1), pending(0), running(true)
+{
+    worker = std::thread(&TimerWheel::run, this);
+}
+
+TimerWheel::~TimerWheel() {
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        running = false;
+    }
+    wakeup.notify_all();
+    worker.join();
+}
+
+uint64_t TimerWheel::toTick(Clock::time_point t) const {
+    if (t <= start)
+        return 0;
+    return std::chrono::duration_cast<std::chrono::microseconds>(t - start) / TICK;
+}
+
+TimerWheel::Clock::time_point TimerWheel::tickTime(uint64_t tick) const {
+    return start + TICK * tick;
+}
+
+// level is picked from the distance to currentTick, the slot from the
+// deadline tick itself, so each entry is cascaded exactly when its range
+// comes around. Anything past the top level range is parked at its far end.
+void TimerWheel::place(Timer&& timer) {
+    const uint64_t range = 1ull << (SLOTBITS * LEVELS);
+    uint64_t tick = std::min(timer.tick, currentTick + range - 1);
+    uint64_t delta = tick - currentTick;
+
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (1ull << (SLOTBITS * (level + 1))))
+        level++;
+
+    int slot = (tick >> (SLOTBITS * level)) & (SLOTS - 1);
+    wheel[level][slot].push_back(std::move(timer));
+}
+
+void TimerWheel::cascade(int level, uint64_t tick) {
+    int slot = (tick >> (SLOTBITS * level)) & (SLOTS - 1);
+    std::vector<Timer> moving;
+    moving.swap(wheel[level][slot]);
+    for (auto& timer : moving)
+        place(std::move(timer));
+}
+
+// next tick worth waking for: a non-empty level 0 slot or the next cascade
+uint64_t TimerWheel::ticksToNextEvent() const {
+    for (uint64_t k = 1; k <= SLOTS; k++) {
+        uint64_t tick = currentTick + k;
+        if (!wheel[0][tick & (SLOTS - 1)].empty() || (tick & (SLOTS - 1)) == 0)
+            return k;
+    }
+    return SLOTS;
+}
+
+void TimerWheel::processTick(std::unique_lock<std::mutex>& lk, uint64_t tick) {
+    currentTick = tick;
+
+    // higher levels first so their entries can land in this tick's slot
+    for (int level = LEVELS - 1; level > 0; level--) {
+        uint64_t mask = (1ull << (SLOTBITS * level)) - 1;
+        if ((tick & mask) == 0)
+            cascade(level, tick);
+    }
+
+    std::vector<Timer> due;
+    due.swap(wheel[0][tick & (SLOTS - 1)]);
+    if (due.empty())
+        return;
+    pending -= due.size();
+
+    std::sort(due.begin(), due.end(), [](const Timer& a, const Timer& b) {
+        return a.deadline < b.deadline;
+    });
+
+    for (auto& timer : due) {
+        if (!live.count(timer.id))
+            continue;
+
+        // sub-tick precision, the wheel only narrows it down to this tick
+        lk.unlock();
+        std::this_thread::sleep_until(timer.deadline);
+        lk.lock();
+
+        if (live.erase(timer.id) == 0)
+            continue;   // cancelled while we slept
+        lk.unlock();
+        timer.callback();
+        lk.lock();
+    }
+}
+
+void TimerWheel::run() {
+    // default 50 us timer slack would dominate the per-deadline sleeps
+    prctl(PR_SET_TIMERSLACK, 1);
+
+    std::unique_lock<std::mutex> lk(lock);
+    while (running) {
+        if (pending == 0) {
+            wakeup.wait(lk);
+            continue;
+        }
+
+        uint64_t target = currentTick + ticksToNextEvent();
+        if (Clock::now() < tickTime(target)) {
+            wakeup.wait_until(lk, tickTime(target));
+            continue;   // a new timer may have moved the next event
+        }
+
+        // catch up on every tick that is due, not just the target
+        while (running && tickTime(currentTick + 1) <= Clock::now())
+            processTick(lk, currentTick + 1);
+    }
+}
+
+uint64_t TimerWheel::Schedule(Clock::time_point deadline, std::function<void()> callback) {
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lk(lock);
+
+        // an idle wheel can jump straight to now, nothing is left to cascade
+        uint64_t now = toTick(Clock::now());
+        if (pending == 0 && now > currentTick + 1)
+            currentTick = now - 1;
+
+        id = nextId++;
+        Timer timer{ id, std::max(toTick(deadline), currentTick + 1), deadline, std::move(callback) };
+        place(std::move(timer));
+        live.insert(id);
+        pending++;
+    }
+    wakeup.notify_one();
+    return id;
+}
+
+void TimerWheel::Cancel(uint64_t id) {
+    std::lock_guard<std::mutex> lk(lock);
+    live.erase(id);
+}
+
+size_t TimerWheel::Pending() {
+    std::lock_guard<std::mutex> lk(lock);
+    return live.size();
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// Hierarchical timer wheel with its own dispatch thread.
+// Deadlines are bucketed by 1 ms tick across 4 levels of 64 slots (~4.6 h
+// range, later deadlines wait in the top level and cascade down). When a
+// tick comes due its timers are fired in exact deadline order, sleeping
+// until each one, so dispatch is not quantized to the tick.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOTBITS = 6;
+    static const int SLOTS = 1 << SLOTBITS;
+
+    struct Timer {
+        uint64_t id;
+        uint64_t tick;
+        Clock::time_point deadline;
+        std::function<void()> callback;
+    };
+
+    std::vector<Timer> wheel[LEVELS][SLOTS];
+    std::unordered_set<uint64_t> live;      // scheduled and not cancelled
+    Clock::time_point start;
+    uint64_t currentTick;
+    uint64_t nextId;
+    size_t pending;                         // entries still in the wheel, cancelled or not
+
+    std::mutex lock;
+    std::condition_variable wakeup;
+    bool running;
+    std::thread worker;
+
+    uint64_t toTick(Clock::time_point t) const;
+    Clock::time_point tickTime(uint64_t tick) const;
+    void place(Timer&& timer);
+    void cascade(int level, uint64_t tick);
+    void processTick(std::unique_lock<std::mutex>& lk, uint64_t tick);
+    uint64_t ticksToNextEvent() const;
+    void run();
+
+public:
+    static const std::chrono::microseconds TICK;
+
+    TimerWheel();
+    ~TimerWheel();
+
+    // callback runs on the wheel thread, it may schedule or cancel timers
+    uint64_t Schedule(Clock::time_point deadline, std::function<void()> callback);
+    void Cancel(uint64_t id);
+    size_t Pending();
+};
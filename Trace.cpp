@@ -0,0 +1,165 @@
+#include "Trace.h"
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// one recorded span. seq is a seqlock: odd while the owning thread writes,
+// so a reader racing the writer can tell a torn slot and skip it
+struct TraceSlot {
+    std::atomic<uint64_t> seq{ 0 };
+    std::atomic<const char*> name{ nullptr };
+    std::atomic<uint64_t> request{ 0 };
+    std::atomic<int64_t> start{ 0 };
+    std::atomic<int64_t> end{ 0 };
+};
+
+struct TraceRing {
+    int tid;
+    std::atomic<uint64_t> head{ 0 };
+    TraceSlot slots[Trace::RINGSIZE];
+};
+
+struct TraceEvent {
+    const char* name;
+    uint64_t request;
+    int64_t start;
+    int64_t end;
+    int tid;
+};
+
+static std::atomic<int> captures{ 0 };
+static std::atomic<uint64_t> nextRequest{ 1 };
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+// rings outlive their threads so a capture can still read what they recorded
+static std::mutex registryLock;
+static std::vector<std::shared_ptr<TraceRing>> rings;
+
+static thread_local std::shared_ptr<TraceRing> localRing;
+static thread_local uint64_t currentRequest = 0;
+
+static TraceRing& ring() {
+    if (!localRing) {
+        localRing = std::make_shared<TraceRing>();
+        localRing->tid = (int)syscall(SYS_gettid);
+        std::lock_guard<std::mutex> lk(registryLock);
+        rings.push_back(localRing);
+    }
+    return *localRing;
+}
+
+bool Trace::Enabled() {
+    return captures.load(std::memory_order_relaxed) > 0;
+}
+
+int64_t Trace::Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Trace::Start() {
+    captures.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Trace::Stop() {
+    captures.fetch_sub(1, std::memory_order_relaxed);
+}
+
+uint64_t Trace::NewRequest() {
+    return nextRequest.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Trace::CurrentRequest() {
+    return currentRequest;
+}
+
+void Trace::setCurrentRequest(uint64_t id) {
+    currentRequest = id;
+}
+
+void Trace::Record(const char* name, int64_t start, int64_t end) {
+    TraceRing& r = ring();
+    uint64_t index = r.head.load(std::memory_order_relaxed);
+    TraceSlot& slot = r.slots[index % RINGSIZE];
+
+    uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.request.store(currentRequest, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    slot.seq.store(seq + 2, std::memory_order_release);
+
+    r.head.store(index + 1, std::memory_order_release);
+}
+
+static void snapshot(const TraceRing& r, int64_t since, std::vector<TraceEvent>& out) {
+    uint64_t head = r.head.load(std::memory_order_acquire);
+    uint64_t count = std::min<uint64_t>(head, Trace::RINGSIZE);
+    for (uint64_t i = head - count; i < head; i++) {
+        const TraceSlot& slot = r.slots[i % Trace::RINGSIZE];
+        uint64_t before = slot.seq.load(std::memory_order_acquire);
+        TraceEvent event{
+            slot.name.load(std::memory_order_relaxed),
+            slot.request.load(std::memory_order_relaxed),
+            slot.start.load(std::memory_order_relaxed),
+            slot.end.load(std::memory_order_relaxed),
+            r.tid
+        };
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ((before & 1) || before != slot.seq.load(std::memory_order_relaxed))
+            continue;   // being overwritten right now
+        if (event.name && event.start >= since)
+            out.push_back(event);
+    }
+}
+
+// Chrome trace "complete" events, timestamps in microseconds
+std::string Trace::ExportChrome(int64_t since) {
+    std::vector<TraceEvent> events;
+    {
+        std::lock_guard<std::mutex> lk(registryLock);
+        for (auto& r : rings)
+            snapshot(*r, since, events);
+    }
+    std::sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+        return a.start < b.start;
+    });
+
+    std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    char line[256];
+    for (size_t i = 0; i < events.size(); i++) {
+        const TraceEvent& e = events[i];
+        snprintf(line, sizeof(line),
+            "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"request\":%llu}}",
+            i ? "," : "", e.name, e.tid, e.start / 1000.0, (e.end - e.start) / 1000.0,
+            (unsigned long long)e.request);
+        out += line;
+    }
+    out += "]}";
+    return out;
+}
+
+TraceSpan::TraceSpan(const char* name)
+    : name(name), start(Trace::Enabled() ? Trace::Now() : -1)
+{
+}
+
+TraceSpan::~TraceSpan() {
+    if (start >= 0)
+        Trace::Record(name, start, Trace::Now());
+}
+
+TraceRequest::TraceRequest() : previous(Trace::CurrentRequest()) {
+    Trace::setCurrentRequest(Trace::NewRequest());
+}
+
+TraceRequest::~TraceRequest() {
+    Trace::setCurrentRequest(previous);
+}
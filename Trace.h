@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Lightweight span tracing. Each thread records completed spans into its own
+// fixed ring (single writer, no locks on the hot path); a reader snapshots
+// the rings and exports them as Chrome/Perfetto trace JSON. Spans cost one
+// relaxed load while no capture is running.
+class Trace {
+public:
+    static const int RINGSIZE = 4096;       // spans kept per thread, oldest overwritten
+
+    static bool Enabled();
+    static int64_t Now();                   // ns on the trace clock
+
+    // captures nest, recording stays on until the last one stops
+    static void Start();
+    static void Stop();
+
+    // every span recorded since the given time, as a Chrome trace document
+    static std::string ExportChrome(int64_t since);
+
+    static uint64_t NewRequest();
+    static uint64_t CurrentRequest();
+    static void Record(const char* name, int64_t start, int64_t end);
+
+private:
+    friend class TraceRequest;
+    static void setCurrentRequest(uint64_t id);
+};
+
+// times the enclosing scope, name must be a string literal
+class TraceSpan {
+private:
+    const char* name;
+    int64_t start;
+
+public:
+    explicit TraceSpan(const char* name);
+    ~TraceSpan();
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+// tags every span on this thread with a fresh request id for its scope
+class TraceRequest {
+private:
+    uint64_t previous;
+
+public:
+    TraceRequest();
+    ~TraceRequest();
+    TraceRequest(const TraceRequest&) = delete;
+    TraceRequest& operator=(const TraceRequest&) = delete;
+};
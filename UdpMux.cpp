@@ -0,0 +1,186 @@
+#include "UdpMux.h"
+#include "FlightRecorder.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+UdpMux::UdpMux(int count, int port, int receiveSize, int writerCpu)
+    : port(port), receiveSize(receiveSize > 0 ? receiveSize : DEFAULT_SIZE), running(false),
+      received(0), batches(0), unknown(0), dropped(0)
+{
+    for (int i = 0; i < count; i++) {
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            break;
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(this->port);
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            break;
+        }
+        // the first bind picked the port when none was given
+        socklen_t size = sizeof(addr);
+        getsockname(fd, (sockaddr*)&addr, &size);
+        this->port = ntohs(addr.sin_port);
+
+        MySocket::AttachPacketFilter(fd, nullptr);
+        sockets.push_back(fd);
+    }
+    if ((int)sockets.size() != count) {
+        for (int fd : sockets)
+            close(fd);
+        sockets.clear();
+    }
+    for (size_t i = 0; i < sockets.size(); i++)
+        writers.push_back(std::make_unique<SharedWriter>(writerCpu));
+}
+
+// endpoints belong to the sessions, all detached by now since they hold the mux
+UdpMux::~UdpMux() {
+    for (int fd : sockets)
+        close(fd);
+}
+
+bool UdpMux::Ok() const {
+    return !sockets.empty();
+}
+
+void UdpMux::Start() {
+    if (running.exchange(true))
+        return;
+    for (int fd : sockets)
+        Reactor::Instance().Spawn(read(shared_from_this(), fd));
+}
+
+void UdpMux::Stop() {
+    running = false;
+}
+
+int UdpMux::GetPort() const {
+    return port;
+}
+
+int UdpMux::Socket(int robot) const {
+    return sockets[(unsigned)robot % sockets.size()];
+}
+
+SharedWriter& UdpMux::Writer(int robot) {
+    return *writers[(unsigned)robot % writers.size()];
+}
+
+uint64_t UdpMux::Source(const sockaddr_in& addr) {
+    return (1ull << 48) | ((uint64_t)ntohl(addr.sin_addr.s_addr) << 16) | ntohs(addr.sin_port);
+}
+
+uint64_t UdpMux::Source(const std::string& ip, int port) {
+    sockaddr_in addr{};
+    inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
+    addr.sin_port = htons(port);
+    return Source(addr);
+}
+
+UdpMux::Endpoint* UdpMux::Attach(const std::string& ip, int port) {
+    Endpoint* endpoint = new Endpoint;
+    std::lock_guard<std::mutex> lk(lock);
+    endpoints.Insert(Source(ip, port), endpoint);
+    return endpoint;
+}
+
+void UdpMux::Detach(const std::string& ip, int port, Endpoint* endpoint) {
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        uint64_t source = Source(ip, port);
+        if (endpoints.Find(source) == endpoint)
+            endpoints.Erase(source);
+    }
+    delete endpoint;
+}
+
+// reactor thread, under lock
+void UdpMux::dispatch(uint64_t source, PacketBuffer& datagram) {
+    Endpoint* endpoint = endpoints.Find(source);
+    if (!endpoint) {
+        unknown.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (endpoint->inbox.size() >= INBOX) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    endpoint->inbox.push_back(std::move(datagram));
+    Reactor::Instance().Wake(endpoint->parked);
+}
+
+// The wait times out now and then only to notice Stop. Buffers handed to
+// an endpoint are replaced before the next call, the rest are reused.
+Task<void> UdpMux::read(std::shared_ptr<UdpMux> self, int fd) {
+    Reactor& reactor = Reactor::Instance();
+    PacketBuffer buffers[BATCH];
+    mmsghdr messages[BATCH];
+    iovec vectors[BATCH];
+    sockaddr_in from[BATCH];
+
+    while (self->running) {
+        if (!co_await reactor.Readable(fd, 100))
+            continue;
+
+        while (true) {
+            for (int i = 0; i < BATCH; i++) {
+                if (!buffers[i])
+                    buffers[i] = BufferPool::Instance().Acquire(self->receiveSize);
+                vectors[i].iov_base = buffers[i].Data();
+                vectors[i].iov_len = self->receiveSize;
+                messages[i].msg_hdr = {};
+                messages[i].msg_hdr.msg_name = &from[i];
+                messages[i].msg_hdr.msg_namelen = sizeof(from[i]);
+                messages[i].msg_hdr.msg_iov = &vectors[i];
+                messages[i].msg_hdr.msg_iovlen = 1;
+            }
+            int n = recvmmsg(fd, messages, BATCH, MSG_DONTWAIT, nullptr);
+            if (n <= 0) {
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                    FlightRecorder::RecordText(FlightKind::SOCKET_ERROR, -1, errno, fd, "recvmmsg", 8);
+                break;
+            }
+            self->received.fetch_add(n, std::memory_order_relaxed);
+            self->batches.fetch_add(1, std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> lk(self->lock);
+            for (int i = 0; i < n; i++) {
+                buffers[i].SetSize((int)messages[i].msg_len);
+                self->dispatch(Source(from[i]), buffers[i]);
+            }
+            if (n < BATCH)
+                break;
+        }
+    }
+}
+
+Task<int> UdpMux::Receive(Endpoint& endpoint, PacketBuffer& datagram, int timeoutMs) {
+    Reactor& reactor = Reactor::Instance();
+    auto deadline = Reactor::Clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (endpoint.inbox.empty()) {
+        int left = -1;
+        if (timeoutMs >= 0)
+            left = (int)std::max<long long>(0, std::chrono::ceil<std::chrono::milliseconds>(
+                deadline - Reactor::Clock::now()).count());
+        if (!co_await reactor.Park(endpoint.parked, left)) {
+            errno = EAGAIN;
+            co_return -1;
+        }
+    }
+    datagram = std::move(endpoint.inbox.front());
+    endpoint.inbox.pop_front();
+    co_return datagram.Size();
+}
+
+UdpMuxStats UdpMux::Stats() const {
+    return { received.load(), batches.load(), unknown.load(), dropped.load() };
+}
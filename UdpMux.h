@@ -0,0 +1,180 @@
+#pragma once
+#include "BufferPool.h"
+#include "MySocket.h"
+#include "Reactor.h"
+#include "SendRing.h"
+#include "Task.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Open-addressing hash table from a 64 bit key to a small value: one flat
+// array, linear probing from a Fibonacci hash, erase by backward shift so
+// there are no tombstones. A lookup is a multiply, a shift and usually one
+// cache line, where std::unordered_map walks a bucket list of nodes. Key 0
+// marks an empty slot and cannot be stored. Not thread safe.
+template <typename T>
+class DemuxTable {
+private:
+    struct Entry {
+        uint64_t key = 0;
+        T value{};
+    };
+
+    std::vector<Entry> entries;
+    size_t count = 0;
+    int shift = 61;                         // 64 - log2(entries.size())
+
+    size_t home(uint64_t key) const {
+        return (size_t)((key * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+
+    void grow() {
+        std::vector<Entry> old(entries.size() * 2);
+        old.swap(entries);
+        shift--;
+        count = 0;
+        for (auto& entry : old)
+            if (entry.key)
+                Insert(entry.key, entry.value);
+    }
+
+public:
+    DemuxTable() : entries(8) {}
+
+    size_t Size() const { return count; }
+
+    // false when the key was there already, its value is then replaced
+    bool Insert(uint64_t key, T value) {
+        if ((count + 1) * 2 > entries.size())
+            grow();
+        size_t mask = entries.size() - 1;
+        for (size_t i = home(key);; i = (i + 1) & mask) {
+            if (entries[i].key == key) {
+                entries[i].value = value;
+                return false;
+            }
+            if (!entries[i].key) {
+                entries[i].key = key;
+                entries[i].value = value;
+                count++;
+                return true;
+            }
+        }
+    }
+
+    // the value, or T{} when the key is not there
+    T Find(uint64_t key) const {
+        size_t mask = entries.size() - 1;
+        for (size_t i = home(key);; i = (i + 1) & mask) {
+            if (entries[i].key == key)
+                return entries[i].value;
+            if (!entries[i].key)
+                return T{};
+        }
+    }
+
+    // the value it held, or T{}
+    T Erase(uint64_t key) {
+        size_t mask = entries.size() - 1;
+        size_t i = home(key);
+        for (; entries[i].key != key; i = (i + 1) & mask)
+            if (!entries[i].key)
+                return T{};
+        T value = entries[i].value;
+
+        // pull later entries of the run back into the hole unless that
+        // would move one in front of its home slot
+        for (size_t j = (i + 1) & mask; entries[j].key; j = (j + 1) & mask) {
+            size_t want = home(entries[j].key);
+            if (((j - want) & mask) >= ((j - i) & mask)) {
+                entries[i] = entries[j];
+                i = j;
+            }
+        }
+        entries[i] = Entry{};
+        count--;
+        return value;
+    }
+};
+
+struct UdpMuxStats {
+    uint64_t received;          // datagrams read off the sockets
+    uint64_t batches;           // recvmmsg calls that returned something
+    uint64_t unknown;           // from a source no endpoint is attached for
+    uint64_t dropped;           // for an endpoint whose inbox was full
+};
+
+// A handful of UDP sockets shared by every robot, instead of one socket
+// (and one fd in the reactor) per robot. The sockets are bound to the same
+// port with SO_REUSEPORT so the kernel spreads the robots over them, each
+// has a reader coroutine on the reactor that takes whatever is waiting
+// with one recvmmsg and hands every datagram to its robot's endpoint,
+// found by source address and port in a DemuxTable: a lookup per packet
+// however many robots there are. The sockets carry the packet filter
+// without the peer check, the demux does that part. Sends go the same way:
+// one SharedWriter per socket drains the send rings of all its robots.
+// The readers own the mux until Stop, so make it with make_shared and
+// have the sessions that send on it hold it too.
+class UdpMux : public std::enable_shared_from_this<UdpMux> {
+public:
+    static const int BATCH = 32;            // datagrams per recvmmsg
+    static const size_t INBOX = 8;          // replies an endpoint holds before new ones are dropped
+
+    // one attached robot, its inbox and parking are reactor thread only
+    struct Endpoint {
+        std::deque<PacketBuffer> inbox;
+        Reactor::Parking parked;
+    };
+
+private:
+    std::vector<int> sockets;
+    std::vector<std::unique_ptr<SharedWriter>> writers;    // one per socket
+    int port;
+    int receiveSize;
+    std::mutex lock;                        // endpoints, taken once per batch by the readers
+    DemuxTable<Endpoint*> endpoints;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> received;
+    std::atomic<uint64_t> batches;
+    std::atomic<uint64_t> unknown;
+    std::atomic<uint64_t> dropped;
+
+    static Task<void> read(std::shared_ptr<UdpMux> self, int fd);
+    void dispatch(uint64_t source, PacketBuffer& datagram);
+
+public:
+    // port 0 lets the kernel pick one for the first socket, the rest join it
+    // writerCpu >= 0 pins the writer threads
+    UdpMux(int count, int port = 0, int receiveSize = DEFAULT_SIZE, int writerCpu = -1);
+    ~UdpMux();
+
+    bool Ok() const;
+    // readers on the reactor, one per socket
+    void Start();
+    // the readers let go within 100 ms, the last owner closes the sockets
+    void Stop();
+    int GetPort() const;
+    // the socket a robot sends on, spread by robot id
+    int Socket(int robot) const;
+    // the writer thread for that socket, for the robot's SendRing
+    SharedWriter& Writer(int robot);
+
+    // demux key, never 0
+    static uint64_t Source(const sockaddr_in& addr);
+    static uint64_t Source(const std::string& ip, int port);
+
+    // Any thread. A second endpoint for the same robot takes over its
+    // datagrams, Detach only removes the endpoint it is given and frees it.
+    Endpoint* Attach(const std::string& ip, int port);
+    void Detach(const std::string& ip, int port, Endpoint* endpoint);
+
+    // the next datagram from the endpoint's robot, -1 with errno EAGAIN after
+    // timeoutMs (< 0 waits for ever). Reactor thread only
+    Task<int> Receive(Endpoint& endpoint, PacketBuffer& datagram, int timeoutMs);
+    UdpMuxStats Stats() const;
+};
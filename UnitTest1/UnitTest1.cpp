@@ -2,6 +2,8 @@
 #include "CppUnitTest.h"
 #include "../robotMilestone1/PktDef.h"
 #include "../robotMilestone1/MySocket.h"
+#include <chrono>
+#include <thread>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -264,5 +266,82 @@ namespace PktDefTests
             Assert::AreEqual(binary[0], recv[0]);
         }
 
+        TEST_METHOD(MySocketFramedTCPTest)
+        {
+            MySocket server(SocketType::SERVER, "127.0.0.1", 9200, ConnectionType::TCP, 512);
+            MySocket client(SocketType::CLIENT, "127.0.0.1", 9200, ConnectionType::TCP, 512);
+            Assert::IsTrue(server.SetFramed(true));
+            Assert::IsTrue(client.SetFramed(true));
+
+            std::thread acceptor([&server] { server.ConnectTCP(); });
+            client.ConnectTCP();
+            acceptor.join();
+
+            PktDef sleepPkt;
+            sleepPkt.setCMD(CMDType::SLEEP);
+            unsigned char* sleepRaw = sleepPkt.genPacket();
+
+            PktDef drivePkt;
+            drivePkt.setCMD(CMDType::DRIVE);
+            unsigned char body[] = { FORWARD, 5, 50 };
+            drivePkt.setBodyData(body, 3);
+            unsigned char* driveRaw = drivePkt.genPacket();
+
+            // two frames coalesced into one write, then one frame split in two
+            client.QueueData((char*)sleepRaw, sleepPkt.getLength());
+            client.QueueData((char*)driveRaw, drivePkt.getLength());
+            client.Flush();
+            client.SendData((char*)driveRaw, 2);
+            client.SendData((char*)driveRaw + 2, drivePkt.getLength() - 2);
+
+            char frame[512] = {};
+            Assert::AreEqual((int)sleepPkt.getLength(), server.GetData(frame));
+            Assert::AreEqual((int)drivePkt.getLength(), server.GetData(frame));
+            Assert::AreEqual((int)drivePkt.getLength(), server.GetData(frame));
+            Assert::IsTrue(drivePkt.checkCRC((unsigned char*)frame, drivePkt.getLength()));
+
+            client.DisconnectTCP();
+        }
+
+        TEST_METHOD(MySocketFramedUDPRejectedTest)
+        {
+            MySocket sock(SocketType::CLIENT, "127.0.0.1", 8800, ConnectionType::UDP, 512);
+            Assert::IsFalse(sock.SetFramed(true));
+            Assert::IsFalse(sock.GetFramed());
+        }
+
+        TEST_METHOD(MySocketPooledReceiveTest)
+        {
+            MySocket receiver(SocketType::SERVER, "127.0.0.1", 9300, ConnectionType::UDP, 512);
+            MySocket sender(SocketType::CLIENT, "127.0.0.1", 9300, ConnectionType::UDP, 512);
+
+            sender.SendData("Hello", 5);
+            PacketBuffer first;
+            Assert::AreEqual(5, receiver.GetData(first));
+            Assert::AreEqual(5, first.Size());
+            Assert::IsTrue(first.Capacity() >= 512);
+
+            // copies share the slab, the second receive gets a buffer of its own
+            PacketBuffer shared = first;
+            Assert::IsTrue(shared.Data() == first.Data());
+            sender.SendData("World", 5);
+            PacketBuffer second;
+            Assert::AreEqual(5, receiver.GetData(second));
+            Assert::IsFalse(second.Data() == first.Data());
+            Assert::AreEqual(std::string("Hello"), std::string(shared.Data(), shared.Size()));
+            Assert::AreEqual(std::string("World"), std::string(second.Data(), second.Size()));
+        }
+
+        TEST_METHOD(MySocketReceiveTimeoutTest)
+        {
+            MySocket receiver(SocketType::SERVER, "127.0.0.1", 9400, ConnectionType::UDP, 512);
+            Assert::IsTrue(receiver.SetReceiveTimeout(50));
+
+            char buffer[512];
+            auto start = std::chrono::steady_clock::now();
+            Assert::AreEqual(-1, receiver.GetData(buffer));
+            Assert::IsTrue(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(40));
+        }
+
     };
 }
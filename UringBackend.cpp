@@ -0,0 +1,343 @@
+#include "UringBackend.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+IoUring::IoUring()
+    : fd(-1), sqRing(MAP_FAILED), sqRingSize(0), cqRing(MAP_FAILED), cqRingSize(0),
+      sqes((io_uring_sqe*)MAP_FAILED), sqesSize(0)
+{
+}
+
+IoUring::~IoUring() {
+    Close();
+}
+
+void IoUring::Close() {
+    if (sqes != MAP_FAILED)
+        munmap(sqes, sqesSize);
+    if (cqRing != MAP_FAILED && cqRing != sqRing)
+        munmap(cqRing, cqRingSize);
+    if (sqRing != MAP_FAILED)
+        munmap(sqRing, sqRingSize);
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+    sqRing = cqRing = MAP_FAILED;
+    sqes = (io_uring_sqe*)MAP_FAILED;
+}
+
+bool IoUring::Init(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+        return false;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cqRingSize > sqRingSize)
+            sqRingSize = cqRingSize;
+        cqRingSize = sqRingSize;
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED)
+        return false;
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        cqRing = sqRing;
+    else
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED)
+        return false;
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe*)mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+        return false;
+
+    char* sq = (char*)sqRing;
+    sqHead = (unsigned*)(sq + params.sq_off.head);
+    sqTail = (unsigned*)(sq + params.sq_off.tail);
+    sqArray = (unsigned*)(sq + params.sq_off.array);
+    sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+
+    char* cq = (char*)cqRing;
+    cqHead = (unsigned*)(cq + params.cq_off.head);
+    cqTail = (unsigned*)(cq + params.cq_off.tail);
+    cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    return true;
+}
+
+int IoUring::GetFd() const {
+    return fd;
+}
+
+io_uring_sqe* IoUring::GetSqe() {
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    unsigned tail = *sqTail;
+    if (tail - head >= sqEntries)
+        return nullptr;
+
+    unsigned index = tail & sqMask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+int IoUring::Enter(unsigned toSubmit, unsigned minComplete) {
+    unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+    int ret;
+    do {
+        ret = syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+bool IoUring::PopCqe(io_uring_cqe& cqe) {
+    unsigned head = *cqHead;
+    if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+        return false;
+
+    cqe = cqes[head & cqMask];
+    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+UringBackend::UringBackend(int sock, int slotSize, std::atomic<unsigned long long>& syscalls)
+    : sock(sock), slotSize(slotSize), ok(false), sendBuffers(nullptr), inflight(0), queued(0),
+      recvBuffers(nullptr), recvQueued(0), armed(false), syscalls(syscalls)
+{
+    if (!sendRing.Init(SLOTS) || !recvRing.Init(2 * SLOTS))
+        return;
+
+    // send side: one registered buffer per in-flight send
+    sendBuffers = new char[SLOTS * slotSize];
+    iovec iov[SLOTS];
+    for (unsigned i = 0; i < SLOTS; i++) {
+        iov[i].iov_base = sendBuffers + i * slotSize;
+        iov[i].iov_len = slotSize;
+        freeSlots.push_back(SLOTS - 1 - i);
+    }
+    if (syscall(__NR_io_uring_register, sendRing.GetFd(), IORING_REGISTER_BUFFERS, iov, SLOTS) < 0)
+        return;
+
+    // receive side: the whole buffer group goes in with the first submit
+    recvBuffers = new char[SLOTS * slotSize];
+    provide(0, SLOTS);
+
+    ok = true;
+}
+
+// Closing a ring only starts its teardown, the kernel may still be writing
+// into a provided buffer or reading a registered one. Sends are cancelled
+// and reaped, the registration dropped, the multishot receive cancelled
+// and waited for, and only then is the memory freed.
+UringBackend::~UringBackend() {
+    if (ok) {
+        std::lock_guard<std::mutex> lk(sendLock);
+        io_uring_sqe* sqe = getSqe(sendRing, queued);
+        if (sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+            sqe->user_data = CANCELTAG;
+            queued++;
+        }
+        while (inflight > 0) {
+            if (enter(sendRing, queued, 1) < 0)
+                break;
+            queued = 0;
+            reapSends();
+        }
+        syscall(__NR_io_uring_register, sendRing.GetFd(), IORING_UNREGISTER_BUFFERS, nullptr, 0);
+    }
+    if (ok) {
+        std::lock_guard<std::mutex> lk(recvLock);
+        reapReceives();
+        if (armed) {
+            io_uring_sqe* sqe = getSqe(recvRing, recvQueued);
+            if (sqe) {
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->addr = RECVTAG;
+                sqe->user_data = CANCELTAG;
+                recvQueued++;
+            }
+        }
+        while (armed) {
+            int ret = enter(recvRing, recvQueued, 1);
+            if (ret < 0)
+                break;
+            recvQueued -= ret;
+            reapReceives();
+        }
+    }
+    sendRing.Close();
+    recvRing.Close();
+    delete[] sendBuffers;
+    delete[] recvBuffers;
+}
+
+bool UringBackend::Ok() const {
+    return ok;
+}
+
+int UringBackend::enter(IoUring& ring, unsigned toSubmit, unsigned minComplete) {
+    syscalls.fetch_add(1, std::memory_order_relaxed);
+    return ring.Enter(toSubmit, minComplete);
+}
+
+// send completions only free slots, no syscall
+void UringBackend::reapSends() {
+    io_uring_cqe cqe;
+    while (sendRing.PopCqe(cqe)) {
+        if (cqe.user_data == CANCELTAG)
+            continue;
+        freeSlots.push_back((unsigned)cqe.user_data);
+        inflight--;
+    }
+}
+
+// a full submission queue is submitted to make room, null if that fails
+io_uring_sqe* UringBackend::getSqe(IoUring& ring, unsigned& pending) {
+    io_uring_sqe* sqe = ring.GetSqe();
+    if (sqe)
+        return sqe;
+    int ret = enter(ring, pending, 0);
+    if (ret < 0)
+        return nullptr;
+    pending -= std::min(pending, (unsigned)ret);
+    return ring.GetSqe();
+}
+
+bool UringBackend::Send(const char* data, int size, bool submit) {
+    std::lock_guard<std::mutex> lk(sendLock);
+    if (size > slotSize) {
+        errno = EMSGSIZE;
+        return false;
+    }
+
+    reapSends();
+    while (freeSlots.empty()) {
+        enter(sendRing, queued, 1);
+        queued = 0;
+        reapSends();
+    }
+
+    unsigned slot = freeSlots.back();
+    freeSlots.pop_back();
+    char* buffer = sendBuffers + slot * slotSize;
+    memcpy(buffer, data, size);
+
+    io_uring_sqe* sqe = getSqe(sendRing, queued);
+    if (!sqe) {
+        freeSlots.push_back(slot);
+        return false;
+    }
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = sock;
+    sqe->addr = (unsigned long long)buffer;
+    sqe->len = size;
+    sqe->buf_index = slot;
+    sqe->user_data = slot;
+    inflight++;
+    queued++;
+
+    if (submit) {
+        enter(sendRing, queued, 0);
+        queued = 0;
+    }
+    return true;
+}
+
+void UringBackend::Flush() {
+    std::lock_guard<std::mutex> lk(sendLock);
+    if (queued == 0)
+        return;
+    enter(sendRing, queued, 0);
+    queued = 0;
+}
+
+void UringBackend::provide(unsigned bid, unsigned count) {
+    io_uring_sqe* sqe = getSqe(recvRing, recvQueued);
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->fd = count;
+    sqe->addr = (unsigned long long)(recvBuffers + bid * slotSize);
+    sqe->len = slotSize;
+    sqe->off = bid;
+    sqe->buf_group = 0;
+    sqe->user_data = PROVIDETAG;
+    recvQueued++;
+}
+
+void UringBackend::reapReceives() {
+    io_uring_cqe cqe;
+    while (recvRing.PopCqe(cqe)) {
+        if (cqe.user_data == PROVIDETAG || cqe.user_data == CANCELTAG)
+            continue;
+
+        if (cqe.flags & IORING_CQE_F_BUFFER)
+            ready.emplace_back(cqe.flags >> IORING_CQE_BUFFER_SHIFT, cqe.res);
+        else if (cqe.res != -ENOBUFS)
+            ready.emplace_back(RECVTAG, cqe.res < 0 ? -1 : cqe.res);   // EOF or socket error
+
+        // out of buffers or an error ends the multishot, it is re-armed on demand
+        if (!(cqe.flags & IORING_CQE_F_MORE))
+            armed = false;
+    }
+}
+
+void UringBackend::arm() {
+    io_uring_sqe* sqe = getSqe(recvRing, recvQueued);
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sock;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->buf_group = 0;
+    sqe->user_data = RECVTAG;
+    recvQueued++;
+    armed = true;
+}
+
+int UringBackend::Receive(char* dest, int maxSize) {
+    std::lock_guard<std::mutex> lk(recvLock);
+
+    reapReceives();
+    while (ready.empty()) {
+        if (!armed)
+            arm();
+
+        // buffer hand-backs and a re-arm go in with the wait, one call
+        int ret = enter(recvRing, recvQueued, 1);
+        if (ret < 0)
+            return -1;
+        recvQueued -= ret;
+        reapReceives();
+    }
+
+    auto [bid, bytes] = ready.front();
+    ready.pop_front();
+    if (bid == RECVTAG)
+        return bytes;
+
+    if (bytes > maxSize)
+        bytes = maxSize;
+    memcpy(dest, recvBuffers + bid * slotSize, bytes);
+    provide(bid, 1);
+    return bytes;
+}
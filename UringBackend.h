@@ -0,0 +1,100 @@
+#pragma once
+#include <linux/io_uring.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Minimal io_uring wrapper over the raw syscalls (no liburing dependency).
+class IoUring {
+private:
+    int fd;
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    io_uring_sqe* sqes;
+    size_t sqesSize;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqArray;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    io_uring_cqe* cqes;
+
+public:
+    IoUring();
+    ~IoUring();
+
+    bool Init(unsigned entries);
+    void Close();
+    int GetFd() const;
+
+    // next free SQE, published to the kernel on the following Enter
+    io_uring_sqe* GetSqe();
+    int Enter(unsigned toSubmit, unsigned minComplete);
+    bool PopCqe(io_uring_cqe& cqe);
+};
+
+// io_uring backend for one MySocket.
+// Sends copy into registered (fixed) buffers and go out as WRITE_FIXED,
+// either one submit per send or batched until Flush. Receives use a single
+// multishot RECV picking from a provided buffer group, so a datagram that
+// has already arrived is picked up without any syscall. Consumed buffers
+// are handed back with PROVIDE_BUFFERS entries that ride along with the
+// next submit instead of costing a call of their own.
+// Send and receive use separate rings so a reader blocked waiting for a
+// reply never holds up senders on other threads.
+class UringBackend {
+private:
+    static constexpr unsigned SLOTS = 64;          // send buffers and receive buffers each
+    static constexpr unsigned RECVTAG = ~0u;       // user_data of the multishot receive
+    static constexpr unsigned PROVIDETAG = ~1u;    // user_data of buffer hand-backs
+    static constexpr unsigned CANCELTAG = ~2u;     // user_data of the teardown cancel
+
+    int sock;
+    int slotSize;
+    bool ok;
+
+    IoUring sendRing;
+    char* sendBuffers;
+    std::vector<unsigned> freeSlots;
+    unsigned inflight;
+    unsigned queued;
+    std::mutex sendLock;
+
+    IoUring recvRing;
+    char* recvBuffers;
+    unsigned recvQueued;                        // SQEs written but not yet submitted
+    bool armed;
+    std::deque<std::pair<unsigned, int>> ready;   // buffer id, bytes
+    std::mutex recvLock;
+
+    std::atomic<unsigned long long>& syscalls;
+
+    int enter(IoUring& ring, unsigned toSubmit, unsigned minComplete);
+    io_uring_sqe* getSqe(IoUring& ring, unsigned& pending);
+    void reapSends();
+    void provide(unsigned bid, unsigned count);
+    void reapReceives();
+    void arm();
+
+public:
+    UringBackend(int sock, int slotSize, std::atomic<unsigned long long>& syscalls);
+    // waits out the sends and the receive before the buffers go
+    ~UringBackend();
+
+    bool Ok() const;
+    // copies data, so the caller's buffer is free on return. false (errno
+    // EMSGSIZE) for a frame larger than a send slot, nothing is sent
+    bool Send(const char* data, int size, bool submit);
+    void Flush();
+    // blocks until one datagram (or stream chunk) is available
+    int Receive(char* dest, int maxSize);
+};
@@ -7455,7 +7455,12 @@ namespace crow
                 }
                 if (complete_request_handler_)
                 {
-                    complete_request_handler_();
+                    // the connection clears complete_request_handler_ from inside it and,
+                    // for a response ended after its handler returned, that copy is the
+                    // last owner of the connection, so run it from a local
+                    std::function<void()> handler;
+                    handler.swap(complete_request_handler_);
+                    handler();
                 }
             }
         }